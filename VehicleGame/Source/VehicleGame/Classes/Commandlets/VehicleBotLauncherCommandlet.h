@@ -0,0 +1,18 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleBotLauncherCommandlet.generated.h"
+
+/**
+ * Launches headless bot clients against a race server and collects their stats.
+ *
+ * Usage: VehicleGame -run=VehicleBotLauncher [-Bots=32] [-Server=127.0.0.1] [-Duration=600] [-Stagger=0.5]
+ */
+UCLASS()
+class UVehicleBotLauncherCommandlet : public UCommandlet
+{
+	GENERATED_UCLASS_BODY()
+
+	// Begin Commandlet overrides
+	virtual int32 Main(const FString& Params) override;
+	// End Commandlet overrides
+};
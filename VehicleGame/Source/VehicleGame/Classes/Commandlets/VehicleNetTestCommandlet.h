@@ -0,0 +1,61 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleNetTestCommandlet.generated.h"
+
+/** Simulated network conditions, applied to server and clients with engine's packet simulation */
+USTRUCT()
+struct FVehicleNetTestProfile
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** name of profile, also used in result file names */
+	UPROPERTY(config)
+	FString Name;
+
+	/** added latency in ms */
+	UPROPERTY(config)
+	int32 PktLag;
+
+	/** random latency variation in ms */
+	UPROPERTY(config)
+	int32 PktLagVariance;
+
+	/** chance of packet loss in % */
+	UPROPERTY(config)
+	int32 PktLoss;
+
+	/** if set, packets can arrive out of order */
+	UPROPERTY(config)
+	int32 PktOrder;
+
+	FVehicleNetTestProfile()
+		: PktLag(0), PktLagVariance(0), PktLoss(0), PktOrder(0)
+	{
+	}
+};
+
+/**
+ * Runs a race on loopback server with headless bot clients for each network profile,
+ * then checks that all clients agreed with server about race state. Race is played until everyone finished,
+ * Duration is only time limit, and a race nobody finished fails.
+ *
+ * Usage: VehicleGame -run=VehicleNetTest [-Bots=4] [-Duration=300] [-Profile=Name] [-Map=/Game/Maps/DesertRallyRace]
+ */
+UCLASS(config=Game)
+class UVehicleNetTestCommandlet : public UCommandlet
+{
+	GENERATED_UCLASS_BODY()
+
+	/** network conditions to test */
+	UPROPERTY(config)
+	TArray<FVehicleNetTestProfile> Profiles;
+
+	// Begin Commandlet overrides
+	virtual int32 Main(const FString& Params) override;
+	// End Commandlet overrides
+
+protected:
+
+	/** run race with given profile, returns true if it passed */
+	bool RunProfile(const FVehicleNetTestProfile& Profile, const FString& Map, int32 NumBots, float Duration);
+};
@@ -0,0 +1,23 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleServerHostCommandlet.generated.h"
+
+/**
+ * Runs pool of dedicated race servers on this machine, each pinned to its own CPU core and port.
+ * Crashed servers are restarted, servers whose match ended are recycled as fresh processes.
+ *
+ * Local allocation API, one text command per connection to 127.0.0.1:ApiPort:
+ *   ALLOCATE - reserve free server for new match, answers "OK <port>" or "FULL"
+ *   STATUS   - one line per server with its state, players, tick time and memory, then "END"
+ *
+ * Usage: VehicleGame -run=VehicleServerHost [-Servers=4] [-BasePort=7777] [-ApiPort=7700] [-FirstCore=0] [-MaxRssMB=0] [-Map=/Game/Maps/DesertRallyRace]
+ */
+UCLASS()
+class UVehicleServerHostCommandlet : public UCommandlet
+{
+	GENERATED_UCLASS_BODY()
+
+	// Begin Commandlet overrides
+	virtual int32 Main(const FString& Params) override;
+	// End Commandlet overrides
+};
@@ -92,6 +92,10 @@ class AVehicleImpactEffect : public AActor
 	UPROPERTY(BlueprintReadOnly, Category=Impact)
 	FHitResult HitSurface;
 
+	/** surface type used when HitSurface has no physical material, e.g. impact reported by server */
+	UPROPERTY(BlueprintReadOnly, Category=Impact)
+	TEnumAsByte<EPhysicalSurface> SurfaceType;
+
 	/** impact force */
 	UPROPERTY(BlueprintReadOnly, Category=Impact)
 	FVector HitForce;
@@ -13,6 +13,9 @@ class ABuggyPawn : public AWheeledVehicle
 	virtual void Tick(float DeltaSeconds) override;
 	virtual void ReceiveHit(class UPrimitiveComponent* MyComp, class AActor* Other, class UPrimitiveComponent* OtherComp, bool bSelfMoved, FVector HitLocation, FVector HitNormal, FVector NormalForce, const FHitResult& Hit) override;
 	virtual void FellOutOfWorld(const class UDamageType& dmgType) override;
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+	virtual bool IsNetRelevantFor(const APlayerController* RealViewer, const AActor* Viewer, const FVector& SrcLocation) const override;
+	virtual float GetNetPriority(const FVector& ViewPos, const FVector& ViewDir, APlayerController* Viewer, UActorChannel* InChannel, float Time, bool bLowBandwidth) override;
 	// End Actor overrides
 
 	// Begin Pawn overrides
@@ -38,8 +41,8 @@ class ABuggyPawn : public AWheeledVehicle
 	/** Event on death [Server/Client] */
 	virtual void OnDeath();
 
-	/** notify about touching new checkpoint */
-	void OnTrackPointReached(class AVehicleTrackPoint* TrackPoint);
+	/** spawn impact effect of collision reported by server */
+	void SpawnImpactEffect(const struct FVehicleGameEvent& Event);
 
 	/** is handbrake active? */
 	UFUNCTION(BlueprintCallable, Category="Game|Vehicle")
@@ -225,6 +228,9 @@ protected:
 	/** Plays explosion particle and audio. */
 	void PlayDestructionFX();
 
+	/** Destroys camera and audio components, used on dedicated server */
+	void ReleaseClientOnlyComponents();
+
 protected:
 	/** Returns SpringArm subobject **/
 	FORCEINLINE class USpringArmComponent* GetSpringArm() const { return SpringArm; }
@@ -1,9 +1,452 @@
 // Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
 
+#include "VehicleReplicationTypes.h"
+#include "Track/VehicleTrackLayout.h"
 #include "VehicleMovementComponentBoosted4w.generated.h"
 
+/** Move made by owning client, kept until server acknowledges it */
+struct FVehicleSavedMove
+{
+	/** client time when move was made */
+	float TimeStamp;
+
+	/** inputs used for this move */
+	float SteeringInput;
+	float ThrottleInput;
+	float BrakeInput;
+	float HandbrakeInput;
+
+	/** state of vehicle body when move was made */
+	FVector Location;
+	FQuat Rotation;
+	FVector LinearVelocity;
+	FVector AngularVelocity;
+};
+
+/** Recent states of vehicle body on server, sampled every tick into fixed size ring */
+struct FVehicleStateHistory
+{
+	/** number of samples kept, gate sweeps need only states at the end of previous and current tick */
+	static const int32 MaxSamples = 2;
+
+	/** single sample */
+	struct FSample
+	{
+		/** server clock, see AVehicleGameMode::GetServerClock */
+		double Time;
+		FVector Location;
+		FQuat Rotation;
+		FVector LinearVelocity;
+	};
+
+	FVehicleStateHistory()
+		: NewestIndex(-1)
+		, NumSamples(0)
+	{
+	}
+
+	/** add sample, overwriting the oldest one. Time must be increasing */
+	void AddSample(double Time, const FVector& Location, const FQuat& Rotation, const FVector& LinearVelocity);
+
+	/** forget all samples */
+	void Reset();
+
+	/** get number of samples */
+	FORCEINLINE int32 GetNumSamples() const
+	{
+		return NumSamples;
+	}
+
+	/** get sample, 0 is newest */
+	FORCEINLINE const FSample& GetSample(int32 Age) const
+	{
+		return Samples[(NewestIndex - Age + MaxSamples) % MaxSamples];
+	}
+
+private:
+	FSample Samples[MaxSamples];
+	int32 NewestIndex;
+	int32 NumSamples;
+};
+
+/** [client] Server states of remote vehicle, played back with delay to hide network jitter */
+struct FVehicleSnapshotBuffer
+{
+	/** number of snapshots kept */
+	static const int32 MaxSnapshots = 16;
+
+	/** single snapshot */
+	struct FSnapshot
+	{
+		float ServerTime;
+		FVector Location;
+		FQuat Rotation;
+		FVector LinearVelocity;
+	};
+
+	FVehicleSnapshotBuffer()
+		: NewestIndex(-1)
+		, NumSnapshots(0)
+		, AverageInterval(0.0f)
+	{
+	}
+
+	/** add snapshot, older than newest one is ignored */
+	void AddSnapshot(float ServerTime, const FVector& Location, const FQuat& Rotation, const FVector& LinearVelocity);
+
+	/**
+	 * Get state at server time: Hermite interpolated between snapshots, extrapolated by velocity up to MaxExtrapolation past newest one.
+	 * Returns false if buffer is empty.
+	 */
+	bool Sample(float ServerTime, float MaxExtrapolation, FVector& OutLocation, FQuat& OutRotation, FVector& OutLinearVelocity) const;
+
+	/** get smoothed time between snapshots */
+	float GetAverageInterval() const
+	{
+		return AverageInterval;
+	}
+
+	/** forget all snapshots */
+	void Reset();
+
+	/** get snapshot, 0 is newest */
+	FORCEINLINE const FSnapshot& GetSnapshot(int32 Age) const
+	{
+		return Snapshots[(NewestIndex - Age + MaxSnapshots) % MaxSnapshots];
+	}
+
+private:
+	/** store snapshot, overwriting the oldest one */
+	void PushSnapshot(float ServerTime, const FVector& Location, const FQuat& Rotation, const FVector& LinearVelocity);
+
+	FSnapshot Snapshots[MaxSnapshots];
+	int32 NewestIndex;
+	int32 NumSnapshots;
+	float AverageInterval;
+};
+
+/** Input frame received by server, waiting to be simulated */
+struct FVehicleQueuedInput
+{
+	/** quantized inputs */
+	FVehicleInputFrame Frame;
+
+	/** client time stamp of frame */
+	float TimeStamp;
+};
+
+/** Counters of input stream received by server */
+struct FVehicleInputStats
+{
+	/** frames received for the first time */
+	int32 NumReceivedFrames;
+
+	/** frames never received, all batches containing them were lost */
+	int32 NumLostFrames;
+
+	/** batches received after a newer one */
+	int32 NumLateBatches;
+
+	/** frames dropped because too many were waiting */
+	int32 NumSkippedFrames;
+
+	/** server updates simulated without new input */
+	int32 NumStarvedUpdates;
+
+	FVehicleInputStats()
+	{
+		FMemory::Memzero(this, sizeof(FVehicleInputStats));
+	}
+};
+
 UCLASS()
 class UVehicleMovementComponentBoosted4w : public UWheeledVehicleMovementComponent4W
 {
 	GENERATED_UCLASS_BODY()
+
+	// Begin ActorComponent overrides
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction *ThisTickFunction) override;
+	// End ActorComponent overrides
+
+	/** is owning client predicting movement of this vehicle? */
+	bool IsPredictingLocally() const;
+
+	/** is this remote vehicle moved kinematically from snapshot buffer instead of simulated? */
+	bool IsKinematicProxy() const;
+
+	/** get number of corrections applied by client since spawn */
+	int32 GetNumCorrections() const;
+
+	/** [server] get recent states of vehicle */
+	const FVehicleStateHistory& GetStateHistory() const;
+
+	/** [server] get how far owning client sees its vehicle ahead of server */
+	float GetLagCompensationTime() const;
+
+	/** [server] get net update frequency wanted for current motion of vehicle */
+	float GetDesiredNetUpdateFrequency() const;
+
+	/** [server] get counters of inputs received from owning client */
+	const FVehicleInputStats& GetInputStats() const;
+
+	/** [server] quantize current body state into replicated vehicle state */
+	void UpdateReplicatedVehicleState();
+
+	/** get last replicated vehicle state */
+	const FVehicleQuantizedState& GetReplicatedVehicleState() const;
+
+	/** [client] use vehicle state from late join snapshot, replicated states that arrived already win */
+	void ApplyRaceSnapshot(const FVehicleQuantizedState& State, float ServerTime);
+
+	/** get position of vehicle on track, updated once per frame. Returns false if track is unknown */
+	bool GetTrackPosition(FVehicleTrackPosition& OutPosition) const;
+
+	/** get distance of vehicle along track, updated once per frame. Returns false if track is unknown */
+	bool GetTrackDistance(float& OutDistance) const;
+
+	/** get distance along track from viewer's vehicle to this one, positive when this one is ahead */
+	bool GetTrackGapFrom(const APlayerController* Viewer, float& OutGap) const;
+
+	/** decide relevancy for viewer by distance along track. Returns false if it can't be decided that way */
+	bool GetTrackNetRelevancy(const APlayerController* RealViewer, const FVector& SrcLocation, bool& bOutRelevant) const;
+
+	/** get net priority scale for viewer by distance along track. Returns false if it can't be decided that way */
+	bool GetTrackNetPriorityScale(const APlayerController* Viewer, float& OutScale) const;
+
+	//////////////////////////////////////////////////////////////////////////
+	// Replication
+
+	/** send inputs of recent predicted moves to server */
+	UFUNCTION(unreliable, server, WithValidation)
+	void ServerMoveInputBatch(const FVehicleInputBatch& Batch);
+
+	/** authoritative state of vehicle, valid at given client time */
+	UFUNCTION(unreliable, client)
+	void ClientAckVehicleState(float TimeStamp, FVector_NetQuantize100 InLocation, FRotator InRotation, FVector_NetQuantize10 InLinearVelocity, FVector_NetQuantize10 InAngularVelocity);
+
+	/** apply received vehicle state */
+	UFUNCTION()
+	void OnRep_VehicleState();
+
+protected:
+
+	/** if set, owning client will predict its movement and reconcile with server acks */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	uint32 bEnablePrediction:1;
+
+	/** position error (in cm) ignored by client */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float MaxPositionError;
+
+	/** rotation error (in degrees) ignored by client */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float MaxRotationError;
+
+	/** position errors larger than this are corrected at once, smaller ones are blended in */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float SnapPositionError;
+
+	/** part of the error corrected by each ack when blending */
+	UPROPERTY(EditDefaultsOnly, Category=Replication, meta=(ClampMin="0.0", ClampMax="1.0", UIMin="0.0", UIMax="1.0"))
+	float CorrectionBlendAlpha;
+
+	/** how often server acknowledges state to owning client */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float ServerAckInterval;
+
+	/** how often owning client sends batch of inputs */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float InputBatchInterval;
+
+	/** number of most recent frames in each input batch, older ones are resent for redundancy */
+	UPROPERTY(EditDefaultsOnly, Category=Replication, meta=(ClampMin="1", ClampMax="15", UIMin="1", UIMax="15"))
+	int32 MaxInputFramesPerBatch;
+
+	/** max number of received input frames waiting on server, more means client is ahead and oldest are dropped */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	int32 MaxQueuedInputFrames;
+
+	/** vehicles further away along track are not relevant */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float NetRelevantTrackDistance;
+
+	/** vehicles closer than this are relevant regardless of track distance, e.g. where track crosses itself */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float NetRelevantMinDistance;
+
+	/** distance along track at which net priority drops to normal, closer vehicles get up to twice as much */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float NetPriorityTrackDistance;
+
+	/** net update frequency of parked or steadily moving vehicle */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float MinNetUpdateFrequency;
+
+	/** net update frequency during crashes, jumps and slides */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float MaxNetUpdateFrequency;
+
+	/** change of velocity (in cm/s^2) that needs max net update frequency */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float HighActivityAcceleration;
+
+	/** angular velocity (in deg/s) that needs max net update frequency */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float HighActivityAngularSpeed;
+
+	/** speed (in cm/s) at which steady driving needs half of max net update frequency */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float HighActivitySpeed;
+
+	/** tire slip that needs max net update frequency */
+	UPROPERTY(EditDefaultsOnly, Category=Replication, meta=(ClampMin="0.0", UIMin="0.0", ClampMax="1.0", UIMax="1.0"))
+	float HighActivitySlipThreshold;
+
+	/** how long motion has to stay calm before net update frequency starts to drop */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float NetUpdateFrequencyCooldown;
+
+	/** how fast net update frequency drops after cooldown, in Hz per second */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float NetUpdateFrequencyDecayRate;
+
+	/** max time (in seconds) events of owning client are moved back for its latency */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float MaxLagCompensation;
+
+	/** if set, vehicles of other players are moved from received states without running physics on clients */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	uint32 bKinematicSimulatedProxies:1;
+
+	/** min delay (in seconds) of remote vehicles behind server, so there are states to interpolate between */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float MinInterpolationDelay;
+
+	/** max delay (in seconds) of remote vehicles behind server, when states arrive rarely */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float MaxInterpolationDelay;
+
+	/** how long (in seconds) remote vehicle keeps moving by velocity when states stop arriving */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	float MaxExtrapolationTime;
+
+	/** max number of moves kept waiting for ack */
+	UPROPERTY(EditDefaultsOnly, Category=Replication)
+	int32 MaxSavedMoves;
+
+	/** quantized body and wheel state, replaces replicated movement of owning pawn */
+	UPROPERTY(Transient, ReplicatedUsing=OnRep_VehicleState)
+	FVehicleReplicatedState VehicleState;
+
+	/** position on track, cached for current frame */
+	mutable FVehicleTrackPosition CachedTrackPosition;
+
+	/** time when CachedTrackPosition was computed */
+	mutable float CachedTrackPositionTime;
+
+	/** origin of quantized positions, shared by server and clients */
+	FVector TrackOrigin;
+
+	/** is TrackOrigin computed? */
+	bool bTrackOriginValid;
+
+	/** moves waiting for ack, oldest first */
+	TArray<FVehicleSavedMove> SavedMoves;
+
+	/** [server] body state of every tick */
+	FVehicleStateHistory StateHistory;
+
+	/** [server] net update frequency wanted for current motion */
+	float DesiredNetUpdateFrequency;
+
+	/** [server] velocity in last update of DesiredNetUpdateFrequency */
+	FVector LastActivityVelocity;
+
+	/** [server] time since motion needed higher frequency than current one */
+	float CalmActivityTime;
+
+	/** [client] most recent input frames, oldest first */
+	TArray<FVehicleInputFrame> RecentInputFrames;
+
+	/** [client] sequence number of newest input frame */
+	uint16 InputSequence;
+
+	/** [client] time when last input batch was sent */
+	float LastInputBatchTime;
+
+	/** [client] number of frames made since last input batch */
+	int32 NumUnsentInputFrames;
+
+	/** [server] received input frames waiting to be simulated, oldest first */
+	TArray<FVehicleQueuedInput> QueuedInputs;
+
+	/** [server] sequence number of newest input frame received */
+	uint16 LastReceivedInputSequence;
+
+	/** [server] was any input received yet? */
+	bool bReceivedInput;
+
+	/** [server] time left to simulate current input frame */
+	float CurrentInputTimeLeft;
+
+	/** [server] counters of received inputs */
+	FVehicleInputStats InputStats;
+
+	/** [server] client time stamp of input frame being simulated */
+	float LastClientMoveTimeStamp;
+
+	/** [server] time when simulation of current input frame started */
+	float LastClientMoveReceiveTime;
+
+	/** [server] time of last ack sent to client */
+	float LastServerAckTime;
+
+	/** [client] received states of remote vehicle */
+	FVehicleSnapshotBuffer SnapshotBuffer;
+
+	/** [client] current delay of remote vehicle behind server, follows snapshot rate */
+	float InterpolationDelay;
+
+	/** [client] was physics of remote vehicle turned off? */
+	bool bKinematicProxyActive;
+
+	/** [client] number of corrections applied */
+	int32 NumCorrections;
+
+	// Begin WheeledVehicleMovementComponent overrides
+	virtual void UpdateState(float DeltaTime) override;
+	// End WheeledVehicleMovementComponent overrides
+
+	/** store current inputs and body state as new move */
+	void SaveMove(float TimeStamp);
+
+	/** [client] send recent input frames to server */
+	void SendInputBatch(float TimeStamp);
+
+	/** [server] update DesiredNetUpdateFrequency from speed, angular velocity and tire slip */
+	void UpdateDesiredNetUpdateFrequency(float DeltaTime);
+
+	/** [server] pick input frame for this update from received ones */
+	void ConsumeQueuedInput(float DeltaTime);
+
+	/** [server] send current body state to owning client */
+	void SendStateAck();
+
+	/** [client] predicted state at given time, interpolated from saved moves. Returns false if move is no longer known */
+	bool GetPredictedState(float TimeStamp, FVehicleSavedMove& OutMove) const;
+
+	/** [client] move remote vehicle to interpolated state */
+	void UpdateKinematicProxy(float DeltaTime);
+
+	/** [client] give vehicle back to physics when it stops being remote one, e.g. when torn off at death */
+	void StopKinematicProxy();
+
+	/** [client] shift current state and remaining saved moves by error */
+	void ApplyCorrection(const FVector& LocationError, const FQuat& RotationError, const FVector& LinearVelocityError, const FVector& AngularVelocityError);
+
+	/** get origin for quantized positions: center of track points, snapped to 1 m grid */
+	const FVector& GetTrackOrigin();
+
+	/** get state of simulated body */
+	void GetBodyState(FVector& OutLocation, FQuat& OutRotation, FVector& OutLinearVelocity, FVector& OutAngularVelocity) const;
 };
@@ -0,0 +1,322 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+//
+// Compact network representations of vehicle state
+//
+
+#include "VehicleTypes.h"
+#include "VehicleReplicationTypes.generated.h"
+#pragma once
+
+/** number of wheels with replicated steering */
+#define VEHICLE_REPLICATED_WHEELS	4
+
+/** Vehicle state in network precision. Only integers, so it can be compared with memcmp */
+struct FVehicleQuantizedState
+{
+	/** location relative to track origin, 1 cm units */
+	int32 Position[3];
+
+	/** rotation, smallest three: index of dropped component and remaining ones in 10 bit precision */
+	int32 RotationIndex;
+	int32 RotationComponents[3];
+
+	/** linear velocity, 1 cm/s units */
+	int32 LinearVelocity[3];
+
+	/** angular velocity, 0.1 deg/s units */
+	int32 AngularVelocity[3];
+
+	/** steering angle of each wheel, 90/127 degree units. Suspension isn't sent, wheels of proxies still find ground on their own */
+	int32 WheelSteering[VEHICLE_REPLICATED_WHEELS];
+
+	/** ERigidBodyFlags of body */
+	int32 Flags;
+
+	FVehicleQuantizedState()
+	{
+		FMemory::Memzero(this, sizeof(FVehicleQuantizedState));
+	}
+
+	bool operator==(const FVehicleQuantizedState& Other) const
+	{
+		return FMemory::Memcmp(this, &Other, sizeof(FVehicleQuantizedState)) == 0;
+	}
+
+	bool operator!=(const FVehicleQuantizedState& Other) const
+	{
+		return !(*this == Other);
+	}
+
+	/** quantize rigid body state and wheel data */
+	void FromRigidBodyState(const FRigidBodyState& InState, const FVector& TrackOrigin, const float* InWheelSteering);
+
+	/** restore rigid body state */
+	void ToRigidBodyState(const FVector& TrackOrigin, FRigidBodyState& OutState) const;
+
+	/** get steering angle of wheel in degrees */
+	float GetWheelSteerAngle(int32 WheelIndex) const;
+
+	/** write or read difference from Base. Using zero state as base gives full state */
+	void SerializeDelta(FArchive& Ar, const FVehicleQuantizedState& Base);
+};
+
+/**
+ * Replicated vehicle state, sent as delta from last state sent to each connection.
+ * Every few updates full state is sent, so clients that missed a baseline catch up quickly.
+ */
+USTRUCT()
+struct FVehicleReplicatedState
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** current state: set on server, received on clients */
+	FVehicleQuantizedState State;
+
+	/** server world time when State was taken, for interpolation on clients */
+	float ServerTime;
+
+	/** [server] class of owning actor, for net benchmark */
+	const UClass* StatsClass;
+
+	/** how many deltas can be sent before full state is forced */
+	static const int32 KeyframeInterval = 16;
+
+	/** number of received states remembered as baselines */
+	static const int32 NumReceivedBaselines = 8;
+
+	FVehicleReplicatedState()
+		: ServerTime(0.0f)
+		, StatsClass(NULL)
+	{
+		FMemory::Memzero(ReceivedSequences, sizeof(ReceivedSequences));
+		FMemory::Memzero(bReceivedBaselineValid, sizeof(bReceivedBaselineValid));
+	}
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms);
+
+private:
+	/** [client] recently received states, indexed by sequence */
+	FVehicleQuantizedState ReceivedBaselines[NumReceivedBaselines];
+	uint8 ReceivedSequences[NumReceivedBaselines];
+	bool bReceivedBaselineValid[NumReceivedBaselines];
+};
+
+template<>
+struct TStructOpsTypeTraits<FVehicleReplicatedState> : public TStructOpsTypeTraitsBase
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
+
+/** Inputs of single client frame in network precision */
+struct FVehicleInputFrame
+{
+	/** steering and throttle, -127..127 */
+	int8 Steering;
+	int8 Throttle;
+
+	/** brake, 0..255 */
+	uint8 Brake;
+
+	/** is handbrake pulled? */
+	uint8 bHandbrake;
+
+	/** length of frame in ms */
+	uint8 DeltaMs;
+
+	FVehicleInputFrame()
+		: Steering(0), Throttle(0), Brake(0), bHandbrake(0), DeltaMs(0)
+	{
+	}
+
+	/** quantize inputs used for frame */
+	void SetInputs(float InSteering, float InThrottle, float InBrake, float InHandbrake, float DeltaTime);
+
+	float GetSteeringInput() const { return Steering / 127.0f; }
+	float GetThrottleInput() const { return Throttle / 127.0f; }
+	float GetBrakeInput() const { return Brake / 255.0f; }
+	float GetHandbrakeInput() const { return bHandbrake ? 1.0f : 0.0f; }
+	float GetDeltaTime() const { return DeltaMs * 0.001f; }
+};
+
+/**
+ * Most recent input frames of owning client, sent to server once per net tick.
+ * Frames already sent are repeated in following batches, so losing a packet doesn't leave a gap in server's inputs.
+ */
+USTRUCT()
+struct FVehicleInputBatch
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** max number of frames in single batch */
+	static const int32 MaxFrames = 15;
+
+	/** client time stamp of newest frame */
+	float TimeStamp;
+
+	/** sequence number of newest frame */
+	uint16 Sequence;
+
+	/** gear selected by client */
+	int8 CurrentGear;
+
+	/** input frames, oldest first */
+	TArray<FVehicleInputFrame, TInlineAllocator<MaxFrames> > Frames;
+
+	/** [server] bits read when batch was received, for net benchmark */
+	int32 NumReceivedBits;
+
+	FVehicleInputBatch()
+		: TimeStamp(0.0f), Sequence(0), CurrentGear(0), NumReceivedBits(0)
+	{
+	}
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FVehicleInputBatch> : public TStructOpsTypeTraitsBase
+{
+	enum
+	{
+		WithNetSerializer = true,
+	};
+};
+
+/** Gameplay event in network precision, see EVehicleGameEvent */
+struct FVehicleGameEvent
+{
+	/** EVehicleGameEvent */
+	uint8 Type;
+
+	/** vehicle event is about, NULL for race events */
+	TWeakObjectPtr<AActor> Actor;
+
+	/** [Impact] location, 0.1 cm precision */
+	FVector Location;
+
+	/** [Impact] surface normal, 8 bit components */
+	FVector Normal;
+
+	/** [Impact] log2 of normal force in 1/8 steps */
+	uint8 Magnitude;
+
+	/** [Impact] EPhysicalSurface of hit surface */
+	uint8 SurfaceType;
+
+	/** event specific: track point index, number of deaths, 1 if impact was landing on wheels */
+	int32 Value;
+
+	FVehicleGameEvent()
+		: Type(0), Location(FVector::ZeroVector), Normal(FVector::UpVector), Magnitude(0), SurfaceType(0), Value(0)
+	{
+	}
+
+	/** set normal force of impact */
+	void SetForce(float Force);
+
+	/** get normal force of impact */
+	float GetForce() const;
+
+	/** is event about single vehicle? */
+	bool HasActor() const
+	{
+		return Type != EVehicleGameEvent::RaceStarted && Type != EVehicleGameEvent::RaceFinished;
+	}
+};
+
+/**
+ * Gameplay events gathered on server during few frames, sent to each client in single unreliable call.
+ * Events are cosmetic or duplicate replicated state, so losing a batch is fine.
+ */
+USTRUCT()
+struct FVehicleGameEventBatch
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** max number of events in single batch, extra ones are dropped */
+	static const int32 MaxEvents = 32;
+
+	TArray<FVehicleGameEvent, TInlineAllocator<8> > Events;
+
+	/** [server] class of receiving player controller, for net benchmark */
+	const UClass* StatsClass;
+
+	FVehicleGameEventBatch()
+		: StatsClass(NULL)
+	{
+	}
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FVehicleGameEventBatch> : public TStructOpsTypeTraitsBase
+{
+	enum
+	{
+		WithNetSerializer = true,
+	};
+};
+
+/** State of single racer in race snapshot */
+struct FVehicleRaceSnapshotRacer
+{
+	/** PlayerId of racer's player state */
+	int32 PlayerId;
+
+	FVehicleRaceProgress Progress;
+
+	/** does racer have vehicle on track? it doesn't while dead or waiting for respawn */
+	bool bHasVehicle;
+
+	/** state of racer's vehicle */
+	FVehicleQuantizedState VehicleState;
+
+	FVehicleRaceSnapshotRacer()
+		: PlayerId(0), bHasVehicle(false)
+	{
+	}
+};
+
+/**
+ * Whole race in one reliable call, sent to client joining running race.
+ * Racers are identified by PlayerId, since their actors may not exist on client yet.
+ */
+USTRUCT()
+struct FVehicleRaceSnapshot
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** server world time when snapshot was taken */
+	float ServerTime;
+
+	/** race clock, see AVehicleGameState */
+	float RaceStartServerTime;
+	float RaceFinishServerTime;
+	bool bIsRaceActive;
+
+	TArray<FVehicleRaceSnapshotRacer> Racers;
+
+	/** [server] class of receiving player controller, for net benchmark */
+	const UClass* StatsClass;
+
+	FVehicleRaceSnapshot()
+		: ServerTime(0.0f), RaceStartServerTime(0.0f), RaceFinishServerTime(0.0f), bIsRaceActive(false), StatsClass(NULL)
+	{
+	}
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FVehicleRaceSnapshot> : public TStructOpsTypeTraitsBase
+{
+	enum
+	{
+		WithNetSerializer = true,
+	};
+};
@@ -1,5 +1,6 @@
 // Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
 
+#include "VehicleReplicationTypes.h"
 #include "VehiclePlayerController.generated.h"
 
 UCLASS()
@@ -8,15 +9,25 @@ class AVehiclePlayerController : public APlayerController
 	GENERATED_UCLASS_BODY()
 
 	/** checkpoint on track */
-	UPROPERTY(BlueprintReadWrite, transient, Category=Game)
+	UPROPERTY(BlueprintReadWrite, transient, replicated, Category=Game)
 	class AVehicleTrackPoint* LastTrackPoint;
 	
 	// Begin PlayerController overrides
 	virtual void UnFreeze() override;
+	virtual void PlayerTick(float DeltaTime) override;
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+	virtual void BeginPlay() override;
 	// End PlayerController overrides
 
-	/** notify about touching new checkpoint */
-	void OnTrackPointReached(class AVehicleTrackPoint* TrackPoint);
+	/** [server] notify about crossing gate of next checkpoint at given server clock, see AVehicleGameMode::GetServerClock */
+	void OnTrackPointReached(class AVehicleTrackPoint* TrackPoint, double CrossingTime);
+
+	/** [server] notify that LastTrackPoint was the finish line of this player's race */
+	void OnFinishLineReached();
+
+	/** get server time when LastTrackPoint was crossed, as seen by this player */
+	UFUNCTION(BlueprintCallable, Category=Game)
+	float GetLastTrackPointTime() const;
 
 	/** toggles in game menu */
 	void OnToggleInGameMenu();
@@ -27,8 +38,35 @@ class AVehiclePlayerController : public APlayerController
 	/** set handbrake forced */
 	void SetHandbrakeForced(bool bNewForced);
 
+	/** [server] set platform time when player's login started, join time is measured from it */
+	void SetLoginStartTime(double Time);
+
 	void Suicide();
 
+	/** get difference between server's and local world time, estimated from ping samples */
+	float GetServerTimeOffset() const;
+
+	/** get current world time of server */
+	float GetServerWorldTime() const;
+
+	/** notify about death of player's vehicle, counted only on server */
+	void OnVehicleDied();
+
+	/** set playback speed of race replay */
+	UFUNCTION(exec)
+	void ReplaySpeed(float Speed);
+
+	/** jump to time from start of race replay */
+	UFUNCTION(exec)
+	void ReplaySeek(float Time);
+
+	/** view next vehicle in race replay */
+	UFUNCTION(exec)
+	void ReplayViewNext();
+
+	/** get race state as seen by this player */
+	FVehicleRaceDigest GetRaceDigest() const;
+
 	//////////////////////////////////////////////////////////////////////////
 	// Replication
 
@@ -36,11 +74,83 @@ class AVehiclePlayerController : public APlayerController
 	UFUNCTION(reliable, server, WithValidation)
 	void ServerSuicide();
 
+	/** ask server for its time */
+	UFUNCTION(unreliable, server, WithValidation)
+	void ServerRequestTime(float ClientSendTime);
+
+	/** server's time when request sent at ClientSendTime arrived */
+	UFUNCTION(unreliable, client)
+	void ClientReportServerTime(float ClientSendTime, float ServerTime);
+
+	/** gameplay events relevant to this player, sent by game mode few times per second */
+	UFUNCTION(unreliable, client)
+	void ClientReceiveGameEvents(const FVehicleGameEventBatch& Batch);
+
+	/** whole race state, sent when joining running race */
+	UFUNCTION(reliable, client)
+	void ClientReceiveRaceSnapshot(const FVehicleRaceSnapshot& Snapshot);
+
+	/** client can race now. SnapshotWaitTime is time since late join snapshot arrived, negative without snapshot */
+	UFUNCTION(reliable, server, WithValidation)
+	void ServerReportJoined(float SnapshotWaitTime, uint8 NumSnapshotRacers, uint8 NumSyncedRacers);
+
+	/** race state seen by client, for network tests */
+	UFUNCTION(unreliable, server, WithValidation)
+	void ServerReportRaceDigest(const FVehicleRaceDigest& Digest, int32 NumCorrections);
+
 protected:
 
 	/** if set, handbrake will be forced */
 	UPROPERTY(transient, replicated)
 	bool bHandbrakeOverride;
 
+	/** server clock when LastTrackPoint was crossed, compensated for player's latency */
+	double LastTrackPointTime;
+
+	/** [client] bot driving and race digest reports, only on test clients */
+	TSharedPtr<class FVehicleClientTestHarness> TestHarness;
+
+	/** [client] racers of late join snapshot not applied yet, waiting for their actors */
+	TArray<FVehicleRaceSnapshotRacer> PendingSnapshotRacers;
+
+	/** [client] server time of late join snapshot */
+	float RaceSnapshotServerTime;
+
+	/** [client] time when late join snapshot arrived, 0 if none did */
+	float RaceSnapshotReceiveTime;
+
+	/** [client] number of racers in late join snapshot */
+	int32 NumRaceSnapshotRacers;
+
+	/** [client] was playable state reported to server? */
+	bool bJoinReported;
+
+	/** [server] platform time when player's login started, 0 once join was logged */
+	double LoginStartTime;
+
+	/** [client] apply snapshot to racers whose actors arrived */
+	void ApplyRaceSnapshot();
+
+	/** [client] report playable state to server once player can race */
+	void UpdateJoinReport();
+
+	/** number of recent time samples, the one with shortest round trip is used */
+	static const int32 NumTimeSyncSamples = 8;
+
+	/** round trip time of each time sample */
+	float TimeSyncRoundTrips[NumTimeSyncSamples];
+
+	/** server time offset measured by each time sample */
+	float TimeSyncOffsets[NumTimeSyncSamples];
+
+	/** number of time samples received */
+	int32 NumTimeSyncReplies;
+
+	/** time when last time request was sent */
+	float LastTimeSyncRequestTime;
+
+	/** estimated difference between server's and local world time */
+	float ServerTimeOffset;
+
 	virtual void SetupInputComponent() override;
 };
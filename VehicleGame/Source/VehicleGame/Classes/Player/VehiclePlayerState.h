@@ -0,0 +1,117 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleTypes.h"
+#include "VehiclePlayerState.generated.h"
+#pragma once
+
+/** [server] Lap and sector clock of single racer, in race seconds. Fixed size, nothing allocates during race */
+struct FVehicleLapTimer
+{
+	/** race time when current lap and sector started */
+	double LapStartTime;
+	double SectorStartTime;
+
+	/** sector being driven */
+	int32 Sector;
+
+	/** times of last and best lap, 0 if there is none */
+	double LastLapTime;
+	double BestLapTime;
+
+	/** times of each sector in last lap and best ones, 0 if there is none */
+	double LastSectorTimes[FVehicleRaceProgress::NumSectors];
+	double BestSectorTimes[FVehicleRaceProgress::NumSectors];
+
+	FVehicleLapTimer()
+	{
+		Reset();
+	}
+
+	/** forget all times, next lap starts at race start */
+	void Reset()
+	{
+		FMemory::Memzero(this, sizeof(FVehicleLapTimer));
+	}
+
+	/** sector ended at given race time, returns its time */
+	double FinishSector(double RaceTime);
+
+	/** lap ended at given race time, returns its time */
+	double FinishLap(double RaceTime);
+};
+
+UCLASS()
+class AVehiclePlayerState : public APlayerState
+{
+	GENERATED_UCLASS_BODY()
+
+	// Begin Actor overrides
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+	// End Actor overrides
+
+	/** get race progress of this player */
+	UFUNCTION(BlueprintCallable, Category=Race)
+	FVehicleRaceProgress GetRaceProgress() const;
+
+	/** [server] forget progress of previous race */
+	void ResetRaceProgress();
+
+	/** [server] checkpoint crossed at given race time, times are kept only while bTimed is set and player hasn't finished */
+	void OnTrackPointReached(int32 TrackPointIndex, const struct FVehicleTrackLayout& TrackLayout, double RaceTime, bool bTimed);
+
+	/** [server] race finished for this player at given race time */
+	void OnRaceFinished(double RaceTime);
+
+	/** [server] player's vehicle died */
+	void OnVehicleDied();
+
+	/** get number of times player's vehicle died */
+	int32 GetNumDeaths() const;
+
+	/** [client] use progress from late join snapshot until replicated one arrives */
+	void ApplyRaceSnapshot(const FVehicleRaceProgress& Progress);
+
+	/** get index of last checkpoint, INDEX_NONE before first one */
+	int32 GetTrackPointIndex() const;
+
+	/** get number of completed laps */
+	UFUNCTION(BlueprintCallable, Category=Race)
+	int32 GetLap() const;
+
+	/** get times in seconds, 0 if not known yet */
+	UFUNCTION(BlueprintCallable, Category=Race)
+	float GetLastLapTime() const;
+
+	UFUNCTION(BlueprintCallable, Category=Race)
+	float GetBestLapTime() const;
+
+	UFUNCTION(BlueprintCallable, Category=Race)
+	float GetFinishTime() const;
+
+	/** get race time in seconds when current lap started */
+	UFUNCTION(BlueprintCallable, Category=Race)
+	float GetLapStartTime() const;
+
+	/** get time in seconds of sector in last lap and best one, 0 if not known yet */
+	UFUNCTION(BlueprintCallable, Category=Race)
+	float GetLastSectorTime(int32 Sector) const;
+
+	UFUNCTION(BlueprintCallable, Category=Race)
+	float GetBestSectorTime(int32 Sector) const;
+
+protected:
+
+	/** progress of this player, sent only when it changes */
+	UPROPERTY(Transient, Replicated)
+	FVehicleRaceProgress RaceProgress;
+
+	/** number of times player's vehicle died, replicated because clients may not see the death through the controller */
+	UPROPERTY(Transient, Replicated)
+	int32 NumDeaths;
+
+	/** [server] lap and sector times at full precision */
+	FVehicleLapTimer LapTimer;
+
+	/** [server] update progress, sending it at once if it changed */
+	void SetRaceProgress(const FVehicleRaceProgress& NewProgress);
+};
@@ -0,0 +1,74 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleReplayPlayer.generated.h"
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FVehicleReplayEventDelegate, TEnumAsByte<EVehicleGameEvent::Type>, EventType, AActor*, Vehicle, int32, Value);
+
+/** Plays race replay recorded by server, spawning vehicles without physics */
+UCLASS()
+class AVehicleReplayPlayer : public AActor
+{
+	GENERATED_UCLASS_BODY()
+
+	// Begin Actor overrides
+	virtual void Tick(float DeltaSeconds) override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	// End Actor overrides
+
+	/** load replay and show its first frame */
+	UFUNCTION(BlueprintCallable, Category=Replay)
+	bool LoadReplay(const FString& Filename);
+
+	/** jump to time from start of replay */
+	UFUNCTION(BlueprintCallable, Category=Replay)
+	void SeekTo(float Time);
+
+	/** set playback speed, 1 is real time, 0 pauses */
+	UFUNCTION(BlueprintCallable, Category=Replay)
+	void SetPlaybackSpeed(float NewSpeed);
+
+	UFUNCTION(BlueprintCallable, Category=Replay)
+	float GetPlaybackSpeed() const;
+
+	/** get time from start of replay */
+	UFUNCTION(BlueprintCallable, Category=Replay)
+	float GetPlaybackTime() const;
+
+	/** get length of replay */
+	UFUNCTION(BlueprintCallable, Category=Replay)
+	float GetDuration() const;
+
+	/** get vehicle spawned for replay, cycling through them with Offset relative to Current */
+	UFUNCTION(BlueprintCallable, Category=Replay)
+	AActor* GetNextVehicle(AActor* Current, int32 Offset) const;
+
+	/** called for recorded events when playback passes them */
+	UPROPERTY(BlueprintAssignable)
+	FVehicleReplayEventDelegate OnReplayEvent;
+
+protected:
+
+	/** loaded replay */
+	TSharedPtr<class FVehicleReplayReader> Reader;
+
+	/** playback position, server time of recording */
+	float PlaybackTime;
+
+	/** playback speed multiplier */
+	float PlaybackSpeed;
+
+	/** index of last frame whose events were reported */
+	int32 LastEventFrame;
+
+	/** vehicles spawned for replay, by recorded id */
+	TMap<int32, TWeakObjectPtr<AActor> > Vehicles;
+
+	/** move vehicles to PlaybackTime, interpolating between frames */
+	void UpdateVehicles();
+
+	/** report events of frames up to FrameIndex */
+	void ReportEvents(int32 FrameIndex);
+
+	/** get vehicle for recorded id, spawning it if needed */
+	AActor* GetVehicle(int32 Id);
+};
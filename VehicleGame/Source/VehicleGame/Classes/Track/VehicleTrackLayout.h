@@ -0,0 +1,164 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleTrackLayout.generated.h"
+#pragma once
+
+/** Where world position lies relative to track centerline */
+struct FVehicleTrackPosition
+{
+	/** index of track point starting the segment, INDEX_NONE if there is no track */
+	int32 Segment;
+
+	/** distance along track */
+	float Distance;
+
+	/** signed distance from centerline, positive to the right */
+	float LateralOffset;
+
+	FVehicleTrackPosition()
+		: Segment(INDEX_NONE)
+		, Distance(0.0f)
+		, LateralOffset(0.0f)
+	{
+	}
+};
+
+/** Rectangle across track at track point, crossed in direction of its normal */
+struct FVehicleTrackGate
+{
+	FVector Origin;
+	FVector Normal;
+	FVector Right;
+	FVector Up;
+
+	/** half of gate width and its height above origin */
+	float HalfWidth;
+	float Height;
+};
+
+/** Move of vehicle during last tick, tested against one gate */
+struct FVehicleGateSweep
+{
+	FVector Start;
+	FVector End;
+
+	/** server clock at start and end, see AVehicleGameMode::GetServerClock */
+	double StartTime;
+	double EndTime;
+
+	/** index of gate in layout */
+	int32 Gate;
+};
+
+/** Point of baked centerline */
+struct FVehicleTrackSample
+{
+	FVector Location;
+
+	/** distance along track */
+	float Distance;
+
+	/** index of track point starting the segment */
+	int32 Segment;
+};
+
+/** Bounding box of consecutive centerline edges, node of search tree */
+struct FVehicleTrackNode
+{
+	FBox Bounds;
+
+	/** edge from sample FirstEdge to the next one is the first one in box */
+	int32 FirstEdge;
+	int32 NumEdges;
+
+	/** first child directly follows its parent, INDEX_NONE for leaves */
+	int32 SecondChild;
+};
+
+/**
+ * Track points of current level in track order, with centerline baked as spline through them.
+ * Built locally from level actors, so server and clients get the same layout without replicating it.
+ * Centerline is sampled into arc length table, with tree of bounding boxes for fast projection of positions.
+ */
+USTRUCT()
+struct FVehicleTrackLayout
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** track points, sorted by TrackIndex, or chained by distance when indices aren't set */
+	UPROPERTY(Transient)
+	TArray<class AVehicleTrackPoint*> TrackPoints;
+
+	/** distance along centerline from first point to each point */
+	TArray<float> PointDistances;
+
+	/** gate of each track point */
+	TArray<FVehicleTrackGate> Gates;
+
+	/** length of whole centerline */
+	float TrackLength;
+
+	/** does last point connect back to first one? */
+	bool bClosedLoop;
+
+	FVehicleTrackLayout()
+		: TrackLength(0.0f)
+		, bClosedLoop(false)
+	{
+	}
+
+	/** collect track points of world */
+	void Build(UWorld* World);
+
+	/** is there enough track points to measure distances? */
+	bool IsValid() const;
+
+	/** project location on closest part of centerline, O(log n) in number of samples */
+	FVehicleTrackPosition GetTrackPosition(const FVector& Location) const;
+
+	/** get distance along track of location projected on centerline */
+	float GetDistanceAlongTrack(const FVector& Location) const;
+
+	/** get point on centerline at given distance along track */
+	FVector GetLocationAtDistance(float Distance) const;
+
+	/** get horizontal direction of centerline at given distance along track */
+	FVector GetDirectionAtDistance(float Distance) const;
+
+	/**
+	 * Test vehicle moves against their gates in one pass, without touching physics scene.
+	 * OutAlphas gets fraction of each move where its gate was crossed, or -1 if it wasn't.
+	 */
+	void FindGateCrossings(const TArray<FVehicleGateSweep>& Sweeps, TArray<double>& OutAlphas) const;
+
+	/** get next gate racer must cross after given one, INDEX_NONE after last gate of open track */
+	int32 GetNextGate(int32 TrackPointIndex) const;
+
+	/** get index of track point ending sector when lap is split into NumSectors parts, last one ends lap */
+	int32 GetSectorEndPoint(int32 Sector, int32 NumSectors) const;
+
+	/** get signed distance along track from one position to another, shortest way around on closed tracks */
+	float GetTrackGap(float FromDistance, float ToDistance) const;
+
+private:
+	/** centerline samples, last one closes the loop on closed tracks */
+	TArray<FVehicleTrackSample> Samples;
+
+	/** search tree over edges between samples, root first */
+	TArray<FVehicleTrackNode> Nodes;
+
+	/** get number of segments between track points */
+	int32 GetNumSegments() const;
+
+	/** sample spline through track points, measuring distances along it */
+	void BuildCenterline();
+
+	/** add tree node for range of edges with all its children, returns its index */
+	int32 BuildNodes(int32 FirstEdge, int32 NumEdges);
+
+	/** get distance within track, wrapped around on closed tracks */
+	float WrapDistance(float Distance) const;
+
+	/** get index of edge containing given distance along track */
+	int32 FindEdge(float Distance) const;
+};
@@ -17,8 +17,17 @@ private:
 public:
 #endif
 
-	/** set checkpoint for touching vehicle */
-	virtual void ReceiveActorBeginOverlap(class AActor* Other) override;
+	/** position of this point in track order, starting at 0 */
+	UPROPERTY(EditInstanceOnly, Category=Track)
+	int32 TrackIndex;
+
+	/** width of gate vehicles must drive through, centered on this point across its forward direction */
+	UPROPERTY(EditInstanceOnly, Category=Track)
+	float GateWidth;
+
+	/** height of gate above this point */
+	UPROPERTY(EditInstanceOnly, Category=Track)
+	float GateHeight;
 
 #if WITH_EDITORONLY_DATA
 	/** Returns SpriteComponent subobject **/
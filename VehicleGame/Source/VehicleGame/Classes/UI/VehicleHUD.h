@@ -36,6 +36,15 @@ namespace ETextAlignV
 	};
 };
 
+/** Message shown for a while after gameplay event */
+struct FVehicleHUDMessage
+{
+	FText Text;
+
+	/** world time when message was added */
+	float Time;
+};
+
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnHighscoreNameAccepted, const FString&, NewHighscoreName);
 
 UCLASS()
@@ -54,6 +63,8 @@ class AVehicleHUD : public AHUD
 
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	/** shows/hides in game menu */
 	void ToggleGameMenu();
 
@@ -63,6 +74,9 @@ class AVehicleHUD : public AHUD
 	/** enables/disables game HUD display */
 	void EnableHUD(bool bEnable);
 
+	/** show message about gameplay event sent by server */
+	void OnGameEvent(const struct FVehicleGameEvent& Event);
+
 protected:
 
 	/** if game HUD should be drawn */
@@ -113,6 +127,33 @@ protected:
 	/** quits the game */
 	void Quit();
 
+	/** recent gameplay event messages, oldest first */
+	TArray<FVehicleHUDMessage> EventMessages;
+
+	/** draw recent gameplay event messages, dropping expired ones */
+	void DrawEventMessages();
+
+	/** draw place of local player in race */
+	void DrawRacePosition();
+
+	/** draw current, last and best lap of local player with sector times */
+	void DrawLapTimes();
+
+	/** draw letters of highscore name with buttons to change them */
+	void DrawHighscorePrompt();
+
+	/** draw best race times of track and rank of submitted name */
+	void DrawLeaderboard();
+
+	/** leaderboard of current track, NULL on dedicated server */
+	TSharedPtr<class FVehicleLeaderboard> Leaderboard;
+
+	/** name submitted to leaderboard after finishing race */
+	FString SubmittedName;
+
+	/** [listen server] draw counters of inputs received from remote players, summed over their vehicles */
+	void DrawInputStats();
+
 	/** Used to display debug/helper messages eg Server/Client. */
 	void DrawDebugInfoString(const FString& Text, float PosX, float PosY, bool bAlignLeft, bool bAlignTop, const FColor& TextColor);
 
@@ -145,6 +186,9 @@ protected:
 	/* if we should show enter name prompt */
 	uint8 bEnterNamePromptActive : 1;
 
+	/** if times of finished race were already submitted to leaderboard */
+	uint8 bHighscoreSubmitted : 1;
+
 	/** up button texture */
 	UTexture2D* UpButtonTexture;
 
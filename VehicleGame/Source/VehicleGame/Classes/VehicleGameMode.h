@@ -1,11 +1,85 @@
 // Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
 
+#include "VehicleReplicationTypes.h"
 #include "VehicleGameMode.generated.h"
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FRaceStartingDelegate);
 
 // Forward declarations
 class AVehicleGameState;
+class FVehicleReplayRecorder;
+class FVehicleServerTestHarness;
+
+/**
+ * Landscape backed spawn locations around start spot, found when level loads.
+ * Each respawn reserves a slot, it's free again when vehicle drives away.
+ */
+struct FVehicleSpawnSlots
+{
+	/** max number of candidate locations tested around start spot */
+	static const int32 MaxCandidates = 15;
+
+	/** id for matching async trace results */
+	uint32 Id;
+
+	/** location of start spot when slots were found, slots are found again if it moves */
+	FVector StartLocation;
+
+	/** validated locations in order of preference, empty if start spot has no landscape around */
+	TArray<FVector, TInlineAllocator<MaxCandidates> > Slots;
+
+	/** vehicle spawned at each slot, until it leaves */
+	TArray<TWeakObjectPtr<APawn>, TInlineAllocator<MaxCandidates> > Reservations;
+
+	/** async traces still running, slots can't be used until it's 0 */
+	int32 NumPendingTraces;
+
+	/** candidates of async traces and their results */
+	int32 NumCandidates;
+	FVector CandidateLocations[MaxCandidates];
+	bool bCandidateValid[MaxCandidates];
+
+	FVehicleSpawnSlots()
+		: Id(0), StartLocation(FVector::ZeroVector), NumPendingTraces(0), NumCandidates(0)
+	{
+		FMemory::Memzero(bCandidateValid, sizeof(bCandidateValid));
+	}
+
+	/** add validated slot */
+	void AddSlot(const FVector& Location)
+	{
+		Slots.Add(Location);
+		Reservations.Add(NULL);
+	}
+};
+
+/** Spawn waiting until its start spot has a validated, free slot */
+struct FVehicleSpawnRequest
+{
+	/** player to spawn */
+	TWeakObjectPtr<AController> Controller;
+
+	/** start spot chosen for spawn */
+	TWeakObjectPtr<AActor> StartSpot;
+};
+
+/** Gates crossed by single racer, tracked whether race is running or not */
+struct FVehicleGateProgress
+{
+	/** last gate crossed, INDEX_NONE before first one */
+	int32 LastGate;
+
+	/** number of laps completed since race start */
+	int32 NumLaps;
+
+	/** did racer cross finish line of current race? */
+	bool bFinished;
+
+	FVehicleGateProgress()
+		: LastGate(INDEX_NONE), NumLaps(0), bFinished(false)
+	{
+	}
+};
 
 UCLASS()
 class AVehicleGameMode : public AGameMode
@@ -27,6 +101,9 @@ class AVehicleGameMode : public AGameMode
 	virtual class AActor* FindPlayerStart(AController* Player, const FString& IncomingName = TEXT("")) override;
 	virtual APawn* SpawnDefaultPawnFor(AController* NewPlayer, class AActor* StartSpot) override;
 	virtual void Tick(float DeltaSeconds) override;
+	virtual void StartPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void Logout(AController* Exiting) override;
 	// End AGameMode interface
 
 	/** Check if race is active */
@@ -38,6 +115,21 @@ class AVehicleGameMode : public AGameMode
 	/** Check if race has finished */
 	bool HasRaceFinished() const;
 
+	/** [server] Get time of current frame summed from frame times in double precision, float world time loses resolution over long sessions */
+	double GetServerClock();
+
+	/** [server] Get server clock when race started */
+	double GetRaceStartClock() const;
+
+	/** Check if every racer crossed finish line */
+	bool HaveAllRacersFinished() const;
+
+	/** [server] Pass race digest reported by client to network test, if one is running */
+	void OnRaceDigestReported(class AVehiclePlayerController* VehiclePC, const FVehicleRaceDigest& Digest, int32 NumCorrections);
+
+	/** [server] Queue gameplay event for relevant clients and replay of current race */
+	void AddGameEvent(const FVehicleGameEvent& Event);
+
 	/** Get time elapsed from race start */
 	UFUNCTION(BlueprintCallable, Category=Game)
 	float GetRaceTimer() const;
@@ -72,9 +164,139 @@ class AVehicleGameMode : public AGameMode
 
 protected:
 
+	/** max sum of net update frequencies of all vehicles, adaptive rates are scaled down to fit */
+	UPROPERTY(config)
+	float VehicleNetUpdateBudget;
+
+	/** Apply net update frequencies wanted by vehicles, within VehicleNetUpdateBudget */
+	void UpdateVehicleNetFrequencies();
+
+	/** time between batches of gameplay events sent to clients */
+	UPROPERTY(config)
+	float GameEventSendInterval;
+
+	/** impacts further than this from player's view aren't sent to him */
+	UPROPERTY(config)
+	float ImpactEventRadius;
+
+	/** time when gameplay events were sent last time */
+	float LastGameEventSendTime;
+
+	/** gameplay events waiting for next batch */
+	TArray<FVehicleGameEvent> PendingGameEvents;
+
+	/** Send pending gameplay events to clients, each gets only ones relevant to him */
+	void SendGameEvents();
+
+	/** moves of vehicles in last tick, each against gate its racer has to cross next */
+	TArray<FVehicleGateSweep> GateSweeps;
+
+	/** owners of GateSweeps */
+	TArray<class AVehiclePlayerController*> GateSweepControllers;
+
+	/** result of gate test for each of GateSweeps */
+	TArray<double> GateSweepAlphas;
+
+	/** gates crossed by each racer */
+	TMap<TWeakObjectPtr<AVehiclePlayerController>, FVehicleGateProgress> GateProgress;
+
+	/** number of laps of closed track, open track is finished at its last gate */
+	UPROPERTY(config)
+	int32 NumRaceLaps;
+
+	/** Test every racer's last move against its next gate */
+	void UpdateTrackGates();
+
+	/** Advance racer past gate crossed at given server time, finishing race for him at finish line */
+	void OnGateCrossed(AVehiclePlayerController* VehiclePC, int32 Gate, double CrossingTime);
+
+
+	/** net benchmark, network test and hosted server stats, only on servers started for them */
+	TSharedPtr<FVehicleServerTestHarness> TestHarness;
+
+	/** if set, every race on server is recorded to Saved/Replays */
+	UPROPERTY(config)
+	bool bRecordReplays;
+
+	/** time between recorded replay frames */
+	UPROPERTY(config)
+	float ReplaySampleInterval;
+
+	/** time when replay frame was recorded last time */
+	float LastReplaySampleTime;
+
+	/** records current race */
+	TSharedPtr<FVehicleReplayRecorder> ReplayRecorder;
+
+	/** replay to show instead of racing (-VehicleReplay=) */
+	FString ReplayFilename;
+
+	/** PlayerStart with pawn closer than this (2D) is occupied */
+	static const float PlayerStartOccupancyRadius;
+
+	/** PlayerStarts indexed by grid cell of OccupancyRadius size */
+	TMultiMap<FIntPoint, int32> PlayerStartGrid;
+
+	/** number of PlayerStarts when PlayerStartGrid was built */
+	int32 NumGridPlayerStarts;
+
+	/** occupied flag of each PlayerStart */
+	TBitArray<> PlayerStartOccupancy;
+
+	/** frame when PlayerStartOccupancy was built, pawns are moving after that */
+	uint64 PlayerStartOccupancyFrame;
+
+	/** Find occupied PlayerStarts, once per frame */
+	void UpdatePlayerStartOccupancy();
+
+	/** validated spawn locations of PlayerStarts and track points */
+	TMap<TWeakObjectPtr<AActor>, FVehicleSpawnSlots> SpawnSlotCache;
+
+	/** id of next SpawnSlotCache entry */
+	uint32 NextSpawnSlotsId;
+
+	/** Find spawn slots of all PlayerStarts and track points in level */
+	void BakeSpawnSlots();
+
+	/** Get spawn slots of start spot. If they aren't known (or it moved), async traces are started and NULL is returned */
+	FVehicleSpawnSlots* FindSpawnSlots(AActor* StartSpot);
+
+	/** Get candidate locations around start spot in order of preference, returns their number */
+	int32 GetSpawnCandidates(AActor* StartSpot, FVector* OutCandidates) const;
+
+	/** Reserve first slot that is neither reserved nor blocked by other vehicle, returns INDEX_NONE if all are taken */
+	int32 ReserveSpawnSlot(FVehicleSpawnSlots& SpawnSlots);
+
+	/** Check if location has landscape under it */
+	bool IsSpawnCandidateValid(const FHitResult& Hit) const;
+
+	/** Store result of async spawn slot trace */
+	void OnSpawnSlotTraceDone(const FTraceHandle& TraceHandle, FTraceDatum& TraceData);
+
+	/** spawns that couldn't be placed yet, oldest first */
+	TArray<FVehicleSpawnRequest> PendingSpawns;
+
+	/** Add player to PendingSpawns, or update start spot it waits for */
+	void QueueSpawn(AController* NewPlayer, AActor* StartSpot);
+
+	/** Check if pawn can be spawned at start spot now: its slots are known and one of them is free */
+	bool CanSpawnAt(AActor* StartSpot);
+
+	/** Restart players waiting in PendingSpawns whose start spots are ready */
+	void UpdatePendingSpawns();
+
 	/** Information text at the bottom of the screen */
 	FString GameInfoText;
 
+	/** frame times summed since game mode started */
+	double ServerClock;
+
+	/** frame when ServerClock was advanced last time */
+	uint64 ServerClockFrame;
+
+	/** ServerClock at race start */
+	double RaceStartClock;
+
 	/** Timestamp of race start */
 	float RaceStartTime;
 
@@ -87,12 +309,21 @@ protected:
 	/* Lock all players until race starts */
 	virtual void HandleMatchHasStarted() override;
 
+	/** Remember when remote player started logging in */
+	virtual void PreLogin(const FString& Options, const FString& Address, const TSharedPtr<class FUniqueNetId>& UniqueId, FString& ErrorMessage) override;
+
 	/** Lock player movement if needed */
 	virtual void PostLogin(APlayerController* NewPlayer) override;
 
+	/** platform time when each login in progress started, by remote address */
+	TMultiMap<FString, double> PendingLoginTimes;
+
 	/** Notify all clients about race state */
 	void BroadcastRaceState();
 
+	/** Send whole race state to player joining running race, and get everything replicated to him at once */
+	void SendRaceSnapshot(AVehiclePlayerController* VehiclePC);
+
 	/** Delegate to broadcast about race starting */
 	UPROPERTY(BlueprintAssignable)
 	FRaceStartingDelegate OnRaceStarting;
@@ -1,7 +1,58 @@
 // Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
 
+#include "Track/VehicleTrackLayout.h"
 #include "VehicleGameState.generated.h"
 
+/** Race order, replicated as one small array and sent only when it changes */
+USTRUCT()
+struct FVehicleStandings
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** PlayerId of every racer, leader first */
+	UPROPERTY()
+	TArray<int32> PlayerIds;
+
+	bool operator==(const FVehicleStandings& Other) const
+	{
+		return PlayerIds == Other.PlayerIds;
+	}
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FVehicleStandings> : public TStructOpsTypeTraitsBase
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true,
+	};
+};
+
+/** [server] Racer being ranked, with key describing how far it got */
+struct FVehicleStandingsEntry
+{
+	TWeakObjectPtr<class AVehiclePlayerState> PlayerState;
+
+	/** lap and checkpoint in high bits, progress past checkpoint in low bits, bigger is better */
+	int64 SortKey;
+
+	/** last known distance (in cm) past checkpoint, kept while racer has no vehicle */
+	float CheckpointGap;
+
+	/** is player racing? spectators keep their entry, but aren't ranked */
+	bool bRanked;
+
+	FVehicleStandingsEntry()
+		: SortKey(MIN_int64)
+		, CheckpointGap(0.0f)
+		, bRanked(false)
+	{
+	}
+};
+
 UCLASS()
 class AVehicleGameState : public AGameState
 {
@@ -11,10 +62,18 @@ class AVehicleGameState : public AGameState
 	UPROPERTY(Transient, Replicated)
 	int32 NumRacers;
 
-	/** total race time */
-	UPROPERTY(Transient, Replicated)
+	/** total race time, computed locally from race start and finish times */
+	UPROPERTY(Transient)
 		float TotalTime;
 
+	/** server world time when race started, 0 if it didn't start yet */
+	UPROPERTY(Transient, Replicated)
+		float RaceStartServerTime;
+
+	/** server world time when race finished, 0 while it's running */
+	UPROPERTY(Transient, Replicated)
+		float RaceFinishServerTime;
+
 	/** is timer paused? */
 	UPROPERTY(Transient, Replicated)
 		bool bTimerPaused;
@@ -26,6 +85,59 @@ class AVehicleGameState : public AGameState
 	UFUNCTION(BlueprintCallable, Category = Game)
 		float GetTotalTime();
 
+	/** get current world time of server, estimated on clients */
+	float GetServerWorldTime() const;
+
+	// Begin Actor overrides
+	virtual void Tick(float DeltaSeconds) override;
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+	// End Actor overrides
+
+	// Begin GameState overrides
+	virtual void AddPlayerState(class APlayerState* PlayerState) override;
+	virtual void RemovePlayerState(class APlayerState* PlayerState) override;
+	// End GameState overrides
+
 	UFUNCTION(BlueprintCallable, Category = Game)
 		bool IsRaceActive() const;
+
+	/** get track points of current level in track order */
+	const FVehicleTrackLayout& GetTrackLayout();
+
+	/** get place of player in race starting at 1, 0 if not ranked yet */
+	int32 GetRacePosition(const APlayerState* PlayerState) const;
+
+	/** get number of ranked racers */
+	int32 GetNumRankedRacers() const;
+
+	/** get race order */
+	const FVehicleStandings& GetStandings() const;
+
+protected:
+
+	/** race order, updated by server every tick */
+	UPROPERTY(Transient, Replicated)
+	FVehicleStandings Standings;
+
+	/** [server] racers in race order */
+	TArray<FVehicleStandingsEntry> StandingsEntries;
+
+	/** [server] were racers added or removed since Standings was built? */
+	bool bStandingsMembersChanged;
+
+	/** [server] rank racers, rebuilding Standings only when order changes */
+	void UpdateStandings();
+
+	/** [server] get ranking key of racer */
+	int64 GetStandingsKey(FVehicleStandingsEntry& Entry);
+
+	/** [server] is player racing, not just watching? */
+	bool IsRankedRacer(const APlayerState* PlayerState) const;
+
+	/** track points in track order, built on first use */
+	UPROPERTY(Transient)
+	FVehicleTrackLayout TrackLayout;
+
+	/** was TrackLayout built? */
+	bool bTrackLayoutBuilt;
 };
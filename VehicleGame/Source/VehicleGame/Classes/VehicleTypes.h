@@ -72,3 +72,214 @@ namespace EPhysMaterialType
 #define VEHICLE_SURFACE_Grass		SurfaceType7
 #define VEHICLE_SURFACE_Gravel		SurfaceType8
 
+
+/** Race progress of single racer, replicated to everyone in a few bytes */
+USTRUCT(BlueprintType)
+struct FVehicleRaceProgress
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** value of TrackPointIndex before first checkpoint */
+	static const uint8 NoTrackPoint = 255;
+
+	/** number of timed sectors in lap */
+	static const int32 NumSectors = 3;
+
+	/** index of last checkpoint in track layout */
+	UPROPERTY(BlueprintReadOnly, Category=Race)
+	uint8 TrackPointIndex;
+
+	/** number of completed laps */
+	UPROPERTY(BlueprintReadOnly, Category=Race)
+	uint8 Lap;
+
+	/** race time (in ms) when last checkpoint was crossed */
+	UPROPERTY(BlueprintReadOnly, Category=Race)
+	int32 TrackPointTimeMs;
+
+	/** time (in ms) of last and best completed lap, 0 if there is none */
+	UPROPERTY(BlueprintReadOnly, Category=Race)
+	int32 LastLapTimeMs;
+
+	UPROPERTY(BlueprintReadOnly, Category=Race)
+	int32 BestLapTimeMs;
+
+	/** race time (in ms) when current lap started */
+	UPROPERTY(BlueprintReadOnly, Category=Race)
+	int32 LapStartTimeMs;
+
+	/** time (in ms) of each sector in last lap and best one, 0 if there is none */
+	UPROPERTY()
+	int32 LastSectorTimesMs[NumSectors];
+
+	UPROPERTY()
+	int32 BestSectorTimesMs[NumSectors];
+
+	/** race time (in ms) when racer finished, 0 while racing */
+	UPROPERTY(BlueprintReadOnly, Category=Race)
+	int32 FinishTimeMs;
+
+	FVehicleRaceProgress()
+		: TrackPointIndex(NoTrackPoint), Lap(0), TrackPointTimeMs(0), LastLapTimeMs(0), BestLapTimeMs(0), LapStartTimeMs(0), FinishTimeMs(0)
+	{
+		FMemory::Memzero(LastSectorTimesMs);
+		FMemory::Memzero(BestSectorTimesMs);
+	}
+
+	bool operator==(const FVehicleRaceProgress& Other) const
+	{
+		return TrackPointIndex == Other.TrackPointIndex && Lap == Other.Lap && TrackPointTimeMs == Other.TrackPointTimeMs &&
+			LastLapTimeMs == Other.LastLapTimeMs && BestLapTimeMs == Other.BestLapTimeMs && LapStartTimeMs == Other.LapStartTimeMs &&
+			FinishTimeMs == Other.FinishTimeMs &&
+			FMemory::Memcmp(LastSectorTimesMs, Other.LastSectorTimesMs, sizeof(LastSectorTimesMs)) == 0 &&
+			FMemory::Memcmp(BestSectorTimesMs, Other.BestSectorTimesMs, sizeof(BestSectorTimesMs)) == 0;
+	}
+
+	bool operator!=(const FVehicleRaceProgress& Other) const
+	{
+		return !(*this == Other);
+	}
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+	/** packed fields without net stats, also used inside race snapshot */
+	void SerializePacked(FArchive& Ar);
+};
+
+template<>
+struct TStructOpsTypeTraits<FVehicleRaceProgress> : public TStructOpsTypeTraitsBase
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true,
+	};
+};
+
+/** Race state as seen by one peer, compared between server and clients by network tests */
+USTRUCT()
+struct FVehicleRaceDigest
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** is race running? */
+	UPROPERTY()
+	bool bRaceActive;
+
+	/** number of racers */
+	UPROPERTY()
+	int32 NumRacers;
+
+	/** index of player's last checkpoint in track layout */
+	UPROPERTY()
+	int32 TrackPointIndex;
+
+	/** number of times player's vehicle died */
+	UPROPERTY()
+	int32 NumDeaths;
+
+	/** PlayerId of every ranked racer, leader first */
+	UPROPERTY()
+	TArray<int32> Standings;
+
+	/** PlayerId of every finished racer, winner first */
+	UPROPERTY()
+	TArray<int32> FinishOrder;
+
+	/** lap and checkpoint (Lap * 256 + TrackPointIndex) of every racer in Standings */
+	UPROPERTY()
+	TArray<int32> RacerProgress;
+
+	FVehicleRaceDigest()
+		: bRaceActive(false)
+		, NumRacers(0)
+		, TrackPointIndex(INDEX_NONE)
+		, NumDeaths(0)
+	{
+	}
+
+	bool operator==(const FVehicleRaceDigest& Other) const
+	{
+		return bRaceActive == Other.bRaceActive && NumRacers == Other.NumRacers &&
+			TrackPointIndex == Other.TrackPointIndex && NumDeaths == Other.NumDeaths &&
+			Standings == Other.Standings && FinishOrder == Other.FinishOrder && RacerProgress == Other.RacerProgress;
+	}
+
+	bool operator!=(const FVehicleRaceDigest& Other) const
+	{
+		return !(*this == Other);
+	}
+
+	/** get readable description for logs */
+	FString ToString() const
+	{
+		FString Result = FString::Printf(TEXT("RaceActive=%d NumRacers=%d TrackPoint=%d Deaths=%d Standings="), bRaceActive ? 1 : 0, NumRacers, TrackPointIndex, NumDeaths);
+		for (int32 i = 0; i < Standings.Num(); i++)
+		{
+			Result += FString::Printf(i ? TEXT(",%d") : TEXT("%d"), Standings[i]);
+		}
+		Result += TEXT(" FinishOrder=");
+		for (int32 i = 0; i < FinishOrder.Num(); i++)
+		{
+			Result += FString::Printf(i ? TEXT(",%d") : TEXT("%d"), FinishOrder[i]);
+		}
+		Result += TEXT(" Progress=");
+		for (int32 i = 0; i < RacerProgress.Num(); i++)
+		{
+			Result += FString::Printf(i ? TEXT(",%d") : TEXT("%d"), RacerProgress[i]);
+		}
+		return Result;
+	}
+};
+
+/** [server] How fast client's race digest matches server's one, measured by network tests */
+struct FVehicleRaceConvergence
+{
+	/** last digest reported by client */
+	FVehicleRaceDigest ClientDigest;
+
+	/** server's digest for client's player */
+	FVehicleRaceDigest ServerDigest;
+
+	/** time when ServerDigest last changed */
+	float ChangeTime;
+
+	/** did client report ServerDigest already? */
+	bool bConverged;
+
+	/** did client fail to report ServerDigest in time? */
+	bool bFailed;
+
+	/** number of changes client caught up with */
+	int32 NumConverges;
+
+	/** number of changes client didn't catch up with in time */
+	int32 NumFailures;
+
+	/** sum and max of times needed to catch up */
+	float TotalConvergeTime;
+	float MaxConvergeTime;
+
+	/** corrections of predicted movement reported by client */
+	int32 NumCorrections;
+
+	FVehicleRaceConvergence()
+		: ChangeTime(0.0f), bConverged(true), bFailed(false), NumConverges(0), NumFailures(0), TotalConvergeTime(0.0f), MaxConvergeTime(0.0f), NumCorrections(0)
+	{
+	}
+};
+
+/** Gameplay events sent to clients and stored in race replays, keep order for old replays */
+UENUM(BlueprintType)
+namespace EVehicleGameEvent
+{
+	enum Type
+	{
+		RaceStarted,
+		RaceFinished,
+		TrackPointReached,
+		VehicleDied,
+		Impact,
+		MAX,
+	};
+}
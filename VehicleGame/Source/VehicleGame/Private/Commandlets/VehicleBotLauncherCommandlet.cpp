@@ -0,0 +1,172 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleGame.h"
+
+/** Bot client process and last stats it reported */
+struct FVehicleBotProcess
+{
+	FProcHandle Handle;
+	void* ReadPipe;
+	void* WritePipe;
+
+	/** output not ending with new line yet */
+	FString PendingOutput;
+
+	bool bRunning;
+	bool bHasStats;
+	int32 Ping;
+	int32 Corrections;
+	int32 InBytesPerSecond;
+
+	FVehicleBotProcess()
+		: ReadPipe(NULL), WritePipe(NULL), bRunning(false), bHasStats(false), Ping(0), Corrections(0), InBytesPerSecond(0)
+	{
+	}
+};
+
+UVehicleBotLauncherCommandlet::UVehicleBotLauncherCommandlet(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UVehicleBotLauncherCommandlet::Main(const FString& Params)
+{
+	int32 NumBots = 8;
+	FString ServerAddress = TEXT("127.0.0.1");
+	float Duration = 0.0f;
+	float StaggerTime = 0.5f;
+	FParse::Value(*Params, TEXT("Bots="), NumBots);
+	FParse::Value(*Params, TEXT("Server="), ServerAddress);
+	FParse::Value(*Params, TEXT("Duration="), Duration);
+	FParse::Value(*Params, TEXT("Stagger="), StaggerTime);
+
+	// same executable, as game without rendering and audio
+	const FString ExecutablePath = FString(FPlatformProcess::BaseDir()) / FPlatformProcess::ExecutableName(false);
+	const FString ProjectArg = FPaths::IsProjectFilePathSet() ? FString::Printf(TEXT("\"%s\" "), *FPaths::GetProjectFilePath()) : FString();
+
+	UE_LOG(LogVehicle, Display, TEXT("Launching %d bots against %s"), NumBots, *ServerAddress);
+
+	TArray<FVehicleBotProcess> Bots;
+	Bots.Reserve(NumBots);
+
+	const double StartTime = FPlatformTime::Seconds();
+	double LastLaunchTime = 0.0;
+	double LastSummaryTime = StartTime;
+	while (true)
+	{
+		const double CurrentTime = FPlatformTime::Seconds();
+
+		// don't hit server with all logins at once
+		if (Bots.Num() < NumBots && CurrentTime - LastLaunchTime >= StaggerTime)
+		{
+			LastLaunchTime = CurrentTime;
+
+			const int32 BotIndex = Bots.Num();
+			FVehicleBotProcess& Bot = Bots[Bots.Add(FVehicleBotProcess())];
+			FPlatformProcess::CreatePipe(Bot.ReadPipe, Bot.WritePipe);
+
+			const FString BotParams = FString::Printf(TEXT("%s%s -game -nullrhi -nosound -nosplash -unattended -stdout -VehicleBot -log=VehicleBot%d.log"),
+				*ProjectArg, *ServerAddress, BotIndex);
+			Bot.Handle = FPlatformProcess::CreateProc(*ExecutablePath, *BotParams, false, true, true, NULL, 0, NULL, Bot.WritePipe);
+			Bot.bRunning = Bot.Handle.IsValid();
+			if (!Bot.bRunning)
+			{
+				UE_LOG(LogVehicle, Error, TEXT("Failed to launch bot %d: %s %s"), BotIndex, *ExecutablePath, *BotParams);
+			}
+		}
+
+		int32 NumRunning = 0;
+		for (int32 i = 0; i < Bots.Num(); i++)
+		{
+			FVehicleBotProcess& Bot = Bots[i];
+			if (!Bot.bRunning)
+			{
+				continue;
+			}
+
+			Bot.PendingOutput += FPlatformProcess::ReadPipe(Bot.ReadPipe);
+
+			int32 LineEnd = INDEX_NONE;
+			while (Bot.PendingOutput.FindChar(TEXT('\n'), LineEnd))
+			{
+				const FString Line = Bot.PendingOutput.Left(LineEnd);
+				Bot.PendingOutput = Bot.PendingOutput.Mid(LineEnd + 1);
+
+				// reported by FVehicleClientTestHarness::ReportBotStats
+				if (Line.Contains(TEXT("VehicleBotStats")))
+				{
+					FParse::Value(*Line, TEXT("Ping="), Bot.Ping);
+					FParse::Value(*Line, TEXT("Corrections="), Bot.Corrections);
+					FParse::Value(*Line, TEXT("InBytesPerSecond="), Bot.InBytesPerSecond);
+					Bot.bHasStats = true;
+				}
+			}
+
+			Bot.bRunning = FPlatformProcess::IsProcRunning(Bot.Handle);
+			if (Bot.bRunning)
+			{
+				NumRunning++;
+			}
+			else
+			{
+				UE_LOG(LogVehicle, Warning, TEXT("Bot %d exited"), i);
+				FPlatformProcess::CloseProc(Bot.Handle);
+			}
+		}
+
+		if (CurrentTime - LastSummaryTime >= 5.0)
+		{
+			LastSummaryTime = CurrentTime;
+
+			int32 NumReporting = 0;
+			int32 MaxPing = 0;
+			int64 TotalPing = 0;
+			int64 TotalCorrections = 0;
+			int64 TotalInBytesPerSecond = 0;
+			for (int32 i = 0; i < Bots.Num(); i++)
+			{
+				const FVehicleBotProcess& Bot = Bots[i];
+				if (Bot.bRunning && Bot.bHasStats)
+				{
+					NumReporting++;
+					MaxPing = FMath::Max(MaxPing, Bot.Ping);
+					TotalPing += Bot.Ping;
+					TotalCorrections += Bot.Corrections;
+					TotalInBytesPerSecond += Bot.InBytesPerSecond;
+				}
+			}
+
+			UE_LOG(LogVehicle, Display, TEXT("Bots: %d running, %d reporting, ping avg %d ms max %d ms, corrections %lld, received %lld B/s total (%lld B/s per bot)"),
+				NumRunning, NumReporting,
+				NumReporting ? (int32)(TotalPing / NumReporting) : 0, MaxPing,
+				TotalCorrections, TotalInBytesPerSecond,
+				NumReporting ? TotalInBytesPerSecond / NumReporting : 0);
+		}
+
+		if ((Duration > 0.0f && CurrentTime - StartTime >= Duration) || (Bots.Num() == NumBots && NumRunning == 0))
+		{
+			break;
+		}
+
+		FPlatformProcess::Sleep(0.1f);
+	}
+
+	for (int32 i = 0; i < Bots.Num(); i++)
+	{
+		FVehicleBotProcess& Bot = Bots[i];
+		if (Bot.bRunning)
+		{
+			FPlatformProcess::TerminateProc(Bot.Handle, true);
+		}
+		if (Bot.Handle.IsValid())
+		{
+			FPlatformProcess::CloseProc(Bot.Handle);
+		}
+		FPlatformProcess::ClosePipe(Bot.ReadPipe, Bot.WritePipe);
+	}
+
+	return 0;
+}
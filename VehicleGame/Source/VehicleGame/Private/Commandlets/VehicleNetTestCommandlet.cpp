@@ -0,0 +1,165 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleGame.h"
+
+UVehicleNetTestCommandlet::UVehicleNetTestCommandlet(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UVehicleNetTestCommandlet::Main(const FString& Params)
+{
+	int32 NumBots = 4;
+	float Duration = 300.0f;
+	FString OnlyProfile;
+	FString Map = TEXT("/Game/Maps/DesertRallyRace");
+	FParse::Value(*Params, TEXT("Bots="), NumBots);
+	FParse::Value(*Params, TEXT("Duration="), Duration);
+	FParse::Value(*Params, TEXT("Profile="), OnlyProfile);
+	FParse::Value(*Params, TEXT("Map="), Map);
+
+	int32 NumFailed = 0;
+	int32 NumRun = 0;
+	for (int32 i = 0; i < Profiles.Num(); i++)
+	{
+		if (OnlyProfile.Len() > 0 && Profiles[i].Name != OnlyProfile)
+		{
+			continue;
+		}
+
+		NumRun++;
+		if (!RunProfile(Profiles[i], Map, NumBots, Duration))
+		{
+			NumFailed++;
+		}
+	}
+
+	UE_LOG(LogVehicle, Display, TEXT("Net test: %d profiles run, %d failed"), NumRun, NumFailed);
+	return (NumRun > 0 && NumFailed == 0) ? 0 : 1;
+}
+
+bool UVehicleNetTestCommandlet::RunProfile(const FVehicleNetTestProfile& Profile, const FString& Map, int32 NumBots, float Duration)
+{
+	UE_LOG(LogVehicle, Display, TEXT("Net test '%s': lag %d ms +- %d ms, loss %d%%, reordering %d"),
+		*Profile.Name, Profile.PktLag, Profile.PktLagVariance, Profile.PktLoss, Profile.PktOrder);
+
+	const FString ResultsFilename = FPaths::GameSavedDir() / TEXT("NetTests") / FString::Printf(TEXT("NetTest-%s.csv"), *Profile.Name);
+	IFileManager::Get().Delete(*ResultsFilename);
+
+	const FString ExecutablePath = FString(FPlatformProcess::BaseDir()) / FPlatformProcess::ExecutableName(false);
+	const FString ProjectArg = FPaths::IsProjectFilePathSet() ? FString::Printf(TEXT("\"%s\" "), *FPaths::GetProjectFilePath()) : FString();
+	const FString PacketArgs = FString::Printf(TEXT("-PktLag=%d -PktLagVariance=%d -PktLoss=%d -PktOrder=%d"),
+		Profile.PktLag, Profile.PktLagVariance, Profile.PktLoss, Profile.PktOrder);
+
+	// both sides simulate conditions of packets they send
+	const FString ServerParams = FString::Printf(TEXT("%s%s -server -nullrhi -nosound -unattended -stdout -VehicleNetTest -BenchmarkRacers=%d -BenchmarkDuration=%.0f -BenchmarkName=%s %s -log=NetTestServer-%s.log"),
+		*ProjectArg, *Map, NumBots, Duration, *Profile.Name, *PacketArgs, *Profile.Name);
+	void* ReadPipe = NULL;
+	void* WritePipe = NULL;
+	FPlatformProcess::CreatePipe(ReadPipe, WritePipe);
+	FProcHandle ServerHandle = FPlatformProcess::CreateProc(*ExecutablePath, *ServerParams, false, true, true, NULL, 0, NULL, WritePipe);
+	if (!ServerHandle.IsValid())
+	{
+		UE_LOG(LogVehicle, Error, TEXT("Failed to launch server: %s %s"), *ExecutablePath, *ServerParams);
+		FPlatformProcess::ClosePipe(ReadPipe, WritePipe);
+		return false;
+	}
+
+	// bots connecting before map is loaded would just time out, wait until server reports it's ready
+	const double ReadyTimeout = FPlatformTime::Seconds() + 120.0;
+	FString PendingOutput;
+	bool bServerReady = false;
+	while (!bServerReady && FPlatformProcess::IsProcRunning(ServerHandle) && FPlatformTime::Seconds() < ReadyTimeout)
+	{
+		PendingOutput += FPlatformProcess::ReadPipe(ReadPipe);
+
+		int32 LineEnd = INDEX_NONE;
+		while (!bServerReady && PendingOutput.FindChar(TEXT('\n'), LineEnd))
+		{
+			// logged by AVehicleGameMode::StartPlay
+			bServerReady = PendingOutput.Left(LineEnd).Contains(TEXT("VehicleNetTestReady"));
+			PendingOutput = PendingOutput.Mid(LineEnd + 1);
+		}
+
+		if (!bServerReady)
+		{
+			FPlatformProcess::Sleep(0.1f);
+		}
+	}
+
+	if (!bServerReady)
+	{
+		UE_LOG(LogVehicle, Error, TEXT("Net test '%s': server didn't get ready"), *Profile.Name);
+		if (FPlatformProcess::IsProcRunning(ServerHandle))
+		{
+			FPlatformProcess::TerminateProc(ServerHandle, true);
+		}
+		FPlatformProcess::CloseProc(ServerHandle);
+		FPlatformProcess::ClosePipe(ReadPipe, WritePipe);
+		return false;
+	}
+
+	TArray<FProcHandle> BotHandles;
+	for (int32 i = 0; i < NumBots; i++)
+	{
+		const FString BotParams = FString::Printf(TEXT("%s127.0.0.1 -game -nullrhi -nosound -nosplash -unattended -VehicleBot -VehicleNetTest %s -log=NetTestBot-%s-%d.log"),
+			*ProjectArg, *PacketArgs, *Profile.Name, i);
+		BotHandles.Add(FPlatformProcess::CreateProc(*ExecutablePath, *BotParams, false, true, true, NULL, 0, NULL, NULL));
+		FPlatformProcess::Sleep(0.5f);
+	}
+
+	// server exits on its own after race, unless bots never joined
+	const double Timeout = FPlatformTime::Seconds() + Duration + 120.0;
+	while (FPlatformProcess::IsProcRunning(ServerHandle) && FPlatformTime::Seconds() < Timeout)
+	{
+		// keep draining output, so server never blocks on full pipe
+		FPlatformProcess::ReadPipe(ReadPipe);
+		FPlatformProcess::Sleep(1.0f);
+	}
+
+	if (FPlatformProcess::IsProcRunning(ServerHandle))
+	{
+		UE_LOG(LogVehicle, Error, TEXT("Net test '%s' timed out"), *Profile.Name);
+		FPlatformProcess::TerminateProc(ServerHandle, true);
+	}
+	FPlatformProcess::CloseProc(ServerHandle);
+	FPlatformProcess::ClosePipe(ReadPipe, WritePipe);
+
+	for (int32 i = 0; i < BotHandles.Num(); i++)
+	{
+		if (BotHandles[i].IsValid())
+		{
+			if (FPlatformProcess::IsProcRunning(BotHandles[i]))
+			{
+				FPlatformProcess::TerminateProc(BotHandles[i], true);
+			}
+			FPlatformProcess::CloseProc(BotHandles[i]);
+		}
+	}
+
+	// last line is summary written by FVehicleServerTestHarness::WriteNetTestResults
+	TArray<FString> Lines;
+	if (!FFileHelper::LoadANSITextFileToStrings(*ResultsFilename, NULL, Lines))
+	{
+		UE_LOG(LogVehicle, Error, TEXT("Net test '%s' produced no results"), *Profile.Name);
+		return false;
+	}
+
+	bool bPassed = false;
+	for (int32 i = 0; i < Lines.Num(); i++)
+	{
+		TArray<FString> Columns;
+		Lines[i].ParseIntoArray(&Columns, TEXT(","), false);
+		if (Columns.Num() >= 8 && Columns[1] == TEXT("Summary"))
+		{
+			bPassed = (Columns[7] == TEXT("1"));
+			UE_LOG(LogVehicle, Display, TEXT("Net test '%s' %s: converges %s, avg %s s, max %s s, failures %s, corrections %s"),
+				*Profile.Name, bPassed ? TEXT("passed") : TEXT("FAILED"), *Columns[2], *Columns[3], *Columns[4], *Columns[5], *Columns[6]);
+		}
+	}
+
+	return bPassed;
+}
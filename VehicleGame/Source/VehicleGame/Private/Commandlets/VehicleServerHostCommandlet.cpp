@@ -0,0 +1,415 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleGame.h"
+#include "Networking.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+
+#if PLATFORM_LINUX
+#include <sched.h>
+#endif
+
+/** Hosted server process and last stats it reported */
+struct FVehicleHostedServer
+{
+	FProcHandle Handle;
+	uint32 ProcessId;
+	void* ReadPipe;
+	void* WritePipe;
+
+	/** output not ending with new line yet */
+	FString PendingOutput;
+
+	/** game port and CPU core of this slot, kept across restarts */
+	int32 Port;
+	int32 CpuCore;
+
+	bool bRunning;
+
+	/** has server reported stats since launch? it accepts players then */
+	bool bReady;
+
+	/** is server handed out for a match? */
+	bool bAllocated;
+
+	/** did anyone join since allocation? */
+	bool bHadPlayers;
+
+	/** should process be stopped and started again when possible? */
+	bool bRecycle;
+
+	int32 NumPlayers;
+	float TickMs;
+	float MaxTickMs;
+	int32 RssMB;
+
+	/** time of last launch, exit and allocation */
+	double LaunchTime;
+	double ExitTime;
+	double AllocationTime;
+
+	/** number of times process died on its own */
+	int32 NumCrashes;
+
+	FVehicleHostedServer()
+		: ProcessId(0), ReadPipe(NULL), WritePipe(NULL), Port(0), CpuCore(INDEX_NONE), bRunning(false), bReady(false), bAllocated(false), bHadPlayers(false), bRecycle(false)
+		, NumPlayers(0), TickMs(0.0f), MaxTickMs(0.0f), RssMB(0), LaunchTime(0.0), ExitTime(0.0), AllocationTime(0.0), NumCrashes(0)
+	{
+	}
+
+	const TCHAR* GetStateName() const
+	{
+		if (!bRunning)
+		{
+			return TEXT("down");
+		}
+		if (!bReady)
+		{
+			return TEXT("starting");
+		}
+		if (bAllocated)
+		{
+			return TEXT("allocated");
+		}
+		return NumPlayers > 0 ? TEXT("busy") : TEXT("free");
+	}
+
+	bool IsFree() const
+	{
+		return bRunning && bReady && !bAllocated && !bRecycle && NumPlayers == 0;
+	}
+
+	/** can process be replaced now? not while allocated match waits for its first player */
+	bool CanRecycle() const
+	{
+		return bRunning && bRecycle && NumPlayers == 0 && (!bAllocated || bHadPlayers);
+	}
+};
+
+/** Connection to allocation API waiting for its command */
+struct FVehicleHostApiClient
+{
+	FSocket* Socket;
+	TArray<uint8> Request;
+	double AcceptTime;
+};
+
+namespace VehicleServerHost
+{
+	/** seconds before crashed server is started again */
+	const double RestartDelay = 5.0;
+
+	/** seconds allocated server waits for first player before it's offered again */
+	const double AllocationTimeout = 60.0;
+
+	/** seconds API client has to send its command */
+	const double ApiClientTimeout = 5.0;
+
+	/** restrict process to single core, threads it starts later inherit it */
+	void PinToCore(uint32 ProcessId, int32 CpuCore)
+	{
+#if PLATFORM_LINUX
+		cpu_set_t CpuSet;
+		CPU_ZERO(&CpuSet);
+		CPU_SET(CpuCore, &CpuSet);
+		if (sched_setaffinity((pid_t)ProcessId, sizeof(CpuSet), &CpuSet) != 0)
+		{
+			UE_LOG(LogVehicle, Warning, TEXT("Failed to pin process %u to core %d"), ProcessId, CpuCore);
+		}
+#endif
+	}
+
+	void LaunchServer(FVehicleHostedServer& Server, const FString& ExecutablePath, const FString& ProjectArg, const FString& Map)
+	{
+		FPlatformProcess::CreatePipe(Server.ReadPipe, Server.WritePipe);
+
+		const FString ServerParams = FString::Printf(TEXT("%s%s -server -nullrhi -nosound -unattended -stdout -VehicleHosted -Port=%d -log=HostedServer-%d.log"),
+			*ProjectArg, *Map, Server.Port, Server.Port);
+		Server.Handle = FPlatformProcess::CreateProc(*ExecutablePath, *ServerParams, false, true, true, &Server.ProcessId, 0, NULL, Server.WritePipe);
+		Server.bRunning = Server.Handle.IsValid();
+		Server.bReady = false;
+		Server.bAllocated = false;
+		Server.bHadPlayers = false;
+		Server.bRecycle = false;
+		Server.NumPlayers = 0;
+		Server.PendingOutput.Empty();
+		Server.LaunchTime = FPlatformTime::Seconds();
+
+		if (Server.bRunning)
+		{
+			PinToCore(Server.ProcessId, Server.CpuCore);
+			UE_LOG(LogVehicle, Display, TEXT("Started server on port %d (process %u, core %d)"), Server.Port, Server.ProcessId, Server.CpuCore);
+		}
+		else
+		{
+			UE_LOG(LogVehicle, Error, TEXT("Failed to start server: %s %s"), *ExecutablePath, *ServerParams);
+			FPlatformProcess::ClosePipe(Server.ReadPipe, Server.WritePipe);
+			Server.ReadPipe = Server.WritePipe = NULL;
+			Server.ExitTime = Server.LaunchTime;
+		}
+	}
+
+	void StopServer(FVehicleHostedServer& Server)
+	{
+		if (Server.bRunning)
+		{
+			FPlatformProcess::TerminateProc(Server.Handle, true);
+			Server.bRunning = false;
+		}
+
+		// every restart gets new handle, old one would leak
+		if (Server.Handle.IsValid())
+		{
+			FPlatformProcess::CloseProc(Server.Handle);
+		}
+		if (Server.ReadPipe || Server.WritePipe)
+		{
+			FPlatformProcess::ClosePipe(Server.ReadPipe, Server.WritePipe);
+			Server.ReadPipe = Server.WritePipe = NULL;
+		}
+		Server.ExitTime = FPlatformTime::Seconds();
+	}
+
+	/** parse output of server and check that it's still running */
+	void UpdateServer(FVehicleHostedServer& Server, int32 MaxRssMB)
+	{
+		Server.PendingOutput += FPlatformProcess::ReadPipe(Server.ReadPipe);
+
+		int32 LineEnd = INDEX_NONE;
+		while (Server.PendingOutput.FindChar(TEXT('\n'), LineEnd))
+		{
+			const FString Line = Server.PendingOutput.Left(LineEnd);
+			Server.PendingOutput = Server.PendingOutput.Mid(LineEnd + 1);
+
+			// reported by FVehicleServerTestHarness::ReportServerStats
+			if (Line.Contains(TEXT("VehicleServerStats")))
+			{
+				FParse::Value(*Line, TEXT("Players="), Server.NumPlayers);
+				FParse::Value(*Line, TEXT("TickMs="), Server.TickMs);
+				FParse::Value(*Line, TEXT("MaxTickMs="), Server.MaxTickMs);
+				FParse::Value(*Line, TEXT("RssMB="), Server.RssMB);
+				Server.bReady = true;
+				Server.bHadPlayers |= (Server.bAllocated && Server.NumPlayers > 0);
+			}
+		}
+
+		const double CurrentTime = FPlatformTime::Seconds();
+		if (Server.bAllocated)
+		{
+			// everyone left after match: fresh process for next one, so leaks don't pile up
+			if (Server.bHadPlayers && Server.NumPlayers == 0)
+			{
+				Server.bRecycle = true;
+			}
+			else if (!Server.bHadPlayers && CurrentTime - Server.AllocationTime > AllocationTimeout)
+			{
+				UE_LOG(LogVehicle, Warning, TEXT("Nobody joined server on port %d, offering it again"), Server.Port);
+				Server.bAllocated = false;
+			}
+		}
+
+		// match waiting for its players mustn't lose its server, it's recycled after the match instead
+		if (MaxRssMB > 0 && Server.RssMB > MaxRssMB && !Server.bRecycle && !Server.bAllocated)
+		{
+			UE_LOG(LogVehicle, Warning, TEXT("Server on port %d uses %d MB, recycling it when empty"), Server.Port, Server.RssMB);
+			Server.bRecycle = true;
+		}
+
+		Server.bRunning = FPlatformProcess::IsProcRunning(Server.Handle);
+		if (!Server.bRunning)
+		{
+			Server.NumCrashes++;
+			UE_LOG(LogVehicle, Warning, TEXT("Server on port %d exited (%d times so far), restarting in %.0f s"), Server.Port, Server.NumCrashes, RestartDelay);
+			StopServer(Server);
+		}
+	}
+
+	FString HandleApiCommand(const FString& Command, TArray<FVehicleHostedServer>& Servers)
+	{
+		if (Command == TEXT("ALLOCATE"))
+		{
+			for (int32 i = 0; i < Servers.Num(); i++)
+			{
+				FVehicleHostedServer& Server = Servers[i];
+				if (Server.IsFree())
+				{
+					Server.bAllocated = true;
+					Server.bHadPlayers = false;
+					Server.AllocationTime = FPlatformTime::Seconds();
+					return FString::Printf(TEXT("OK %d\n"), Server.Port);
+				}
+			}
+			return TEXT("FULL\n");
+		}
+
+		if (Command == TEXT("STATUS"))
+		{
+			FString Response;
+			for (int32 i = 0; i < Servers.Num(); i++)
+			{
+				const FVehicleHostedServer& Server = Servers[i];
+				Response += FString::Printf(TEXT("port=%d state=%s players=%d tickms=%.2f maxtickms=%.2f rssmb=%d crashes=%d\n"),
+					Server.Port, Server.GetStateName(), Server.NumPlayers, Server.TickMs, Server.MaxTickMs, Server.RssMB, Server.NumCrashes);
+			}
+			return Response + TEXT("END\n");
+		}
+
+		return TEXT("ERROR unknown command\n");
+	}
+}
+
+UVehicleServerHostCommandlet::UVehicleServerHostCommandlet(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UVehicleServerHostCommandlet::Main(const FString& Params)
+{
+	int32 NumServers = 4;
+	int32 BasePort = 7777;
+	int32 ApiPort = 7700;
+	int32 FirstCore = 0;
+	int32 MaxRssMB = 0;
+	FString Map = TEXT("/Game/Maps/DesertRallyRace");
+	FParse::Value(*Params, TEXT("Servers="), NumServers);
+	FParse::Value(*Params, TEXT("BasePort="), BasePort);
+	FParse::Value(*Params, TEXT("ApiPort="), ApiPort);
+	FParse::Value(*Params, TEXT("FirstCore="), FirstCore);
+	FParse::Value(*Params, TEXT("MaxRssMB="), MaxRssMB);
+	FParse::Value(*Params, TEXT("Map="), Map);
+
+	const FString ExecutablePath = FString(FPlatformProcess::BaseDir()) / FPlatformProcess::ExecutableName(false);
+	const FString ProjectArg = FPaths::IsProjectFilePathSet() ? FString::Printf(TEXT("\"%s\" "), *FPaths::GetProjectFilePath()) : FString();
+
+	// only reachable from this machine, matchmaker runs next to servers
+	FSocket* ApiSocket = FTcpSocketBuilder(TEXT("VehicleServerHostApi"))
+		.AsNonBlocking()
+		.AsReusable()
+		.BoundToEndpoint(FIPv4Endpoint(FIPv4Address(127, 0, 0, 1), ApiPort))
+		.Listening(16);
+	if (ApiSocket == NULL)
+	{
+		UE_LOG(LogVehicle, Error, TEXT("Failed to listen for allocation requests on port %d"), ApiPort);
+		return 1;
+	}
+
+	UE_LOG(LogVehicle, Display, TEXT("Hosting %d servers on ports %d-%d, allocation API on 127.0.0.1:%d"), NumServers, BasePort, BasePort + NumServers - 1, ApiPort);
+
+	// one core per server, game thread of race server is what limits number of matches
+	const int32 NumCores = FMath::Max(FPlatformMisc::NumberOfCores(), 1);
+	TArray<FVehicleHostedServer> Servers;
+	Servers.AddDefaulted(NumServers);
+	for (int32 i = 0; i < NumServers; i++)
+	{
+		Servers[i].Port = BasePort + i;
+		Servers[i].CpuCore = (FirstCore + i) % NumCores;
+		VehicleServerHost::LaunchServer(Servers[i], ExecutablePath, ProjectArg, Map);
+	}
+
+	TArray<FVehicleHostApiClient> ApiClients;
+	double LastSummaryTime = FPlatformTime::Seconds();
+	while (!GIsRequestingExit)
+	{
+		const double CurrentTime = FPlatformTime::Seconds();
+
+		for (int32 i = 0; i < Servers.Num(); i++)
+		{
+			FVehicleHostedServer& Server = Servers[i];
+			if (Server.bRunning)
+			{
+				VehicleServerHost::UpdateServer(Server, MaxRssMB);
+			}
+
+			if (Server.CanRecycle())
+			{
+				UE_LOG(LogVehicle, Display, TEXT("Recycling server on port %d"), Server.Port);
+				VehicleServerHost::StopServer(Server);
+				VehicleServerHost::LaunchServer(Server, ExecutablePath, ProjectArg, Map);
+			}
+			else if (!Server.bRunning && CurrentTime - Server.ExitTime >= VehicleServerHost::RestartDelay)
+			{
+				VehicleServerHost::LaunchServer(Server, ExecutablePath, ProjectArg, Map);
+			}
+		}
+
+		bool bHasPendingConnection = false;
+		while (ApiSocket->HasPendingConnection(bHasPendingConnection) && bHasPendingConnection)
+		{
+			FSocket* ClientSocket = ApiSocket->Accept(TEXT("VehicleServerHostApiClient"));
+			if (ClientSocket == NULL)
+			{
+				break;
+			}
+			ClientSocket->SetNonBlocking(true);
+
+			FVehicleHostApiClient& Client = ApiClients[ApiClients.AddZeroed()];
+			Client.Socket = ClientSocket;
+			Client.AcceptTime = CurrentTime;
+		}
+
+		for (int32 i = ApiClients.Num() - 1; i >= 0; i--)
+		{
+			FVehicleHostApiClient& Client = ApiClients[i];
+
+			uint8 Buffer[256];
+			int32 BytesRead = 0;
+			while (Client.Socket->Recv(Buffer, ARRAY_COUNT(Buffer), BytesRead) && BytesRead > 0)
+			{
+				Client.Request.Append(Buffer, BytesRead);
+			}
+
+			const int32 LineEnd = Client.Request.Find('\n');
+			const bool bTimedOut = CurrentTime - Client.AcceptTime > VehicleServerHost::ApiClientTimeout;
+			if (LineEnd == INDEX_NONE && !bTimedOut)
+			{
+				continue;
+			}
+
+			if (LineEnd != INDEX_NONE)
+			{
+				Client.Request[LineEnd] = 0;
+				const FString Command = FString(ANSI_TO_TCHAR((const ANSICHAR*)Client.Request.GetData())).Trim().TrimTrailing().ToUpper();
+				const FString Response = VehicleServerHost::HandleApiCommand(Command, Servers);
+
+				FTCHARToUTF8 ResponseUtf8(*Response);
+				int32 BytesSent = 0;
+				Client.Socket->Send((const uint8*)ResponseUtf8.Get(), ResponseUtf8.Length(), BytesSent);
+			}
+
+			Client.Socket->Close();
+			ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Client.Socket);
+			ApiClients.RemoveAtSwap(i);
+		}
+
+		if (CurrentTime - LastSummaryTime >= 10.0)
+		{
+			LastSummaryTime = CurrentTime;
+			for (int32 i = 0; i < Servers.Num(); i++)
+			{
+				const FVehicleHostedServer& Server = Servers[i];
+				UE_LOG(LogVehicle, Display, TEXT("Server %d: %s, %d players, tick %.2f ms (max %.2f ms), %d MB, %d crashes"),
+					Server.Port, Server.GetStateName(), Server.NumPlayers, Server.TickMs, Server.MaxTickMs, Server.RssMB, Server.NumCrashes);
+			}
+		}
+
+		FPlatformProcess::Sleep(0.1f);
+	}
+
+	for (int32 i = 0; i < ApiClients.Num(); i++)
+	{
+		ApiClients[i].Socket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(ApiClients[i].Socket);
+	}
+	ApiSocket->Close();
+	ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(ApiSocket);
+
+	for (int32 i = 0; i < Servers.Num(); i++)
+	{
+		VehicleServerHost::StopServer(Servers[i]);
+	}
+
+	return 0;
+}
@@ -6,6 +6,7 @@ AVehicleImpactEffect::AVehicleImpactEffect(const FObjectInitializer& ObjectIniti
 {
 	PrimaryActorTick.bCanEverTick = true;
 	bAutoDestroyWhenFinished = true;
+	SurfaceType = SurfaceType_Default;
 }
 
 void AVehicleImpactEffect::PostInitializeComponents()
@@ -13,7 +14,7 @@ void AVehicleImpactEffect::PostInitializeComponents()
 	Super::PostInitializeComponents();
 
 	UPhysicalMaterial* HitPhysMat = HitSurface.PhysMaterial.Get();
-	EPhysicalSurface HitSurfaceType = UPhysicalMaterial::DetermineSurfaceType(HitPhysMat);
+	EPhysicalSurface HitSurfaceType = HitPhysMat ? UPhysicalMaterial::DetermineSurfaceType(HitPhysMat) : SurfaceType.GetValue();
 
 	// show particles
 	UParticleSystem* ImpactFX = GetImpactFX(HitSurfaceType);
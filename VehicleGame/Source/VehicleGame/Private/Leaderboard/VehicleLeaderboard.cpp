@@ -0,0 +1,430 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleGame.h"
+#include "VehicleLeaderboard.h"
+
+#if PLATFORM_LINUX || PLATFORM_MAC
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace VehicleLeaderboard
+{
+	/** magic and version */
+	static const int32 HeaderSize = 8;
+
+	/** get index of first time greater than given one, new records go after older ones with the same time */
+	int32 FindInsertIndex(const TArray<int32>& SortedTimes, int32 TimeMs)
+	{
+		int32 Low = 0;
+		int32 High = SortedTimes.Num();
+		while (Low < High)
+		{
+			const int32 Middle = (Low + High) / 2;
+			if (SortedTimes[Middle] <= TimeMs)
+			{
+				Low = Middle + 1;
+			}
+			else
+			{
+				High = Middle;
+			}
+		}
+
+		return Low;
+	}
+}
+
+/** Read-only view of whole file, mapped where platform allows it so records are scanned in place */
+class FVehicleLeaderboardFileView
+{
+public:
+
+	FVehicleLeaderboardFileView(const FString& Filename)
+		: Data(NULL)
+		, Size(0)
+		, MappedData(NULL)
+	{
+#if PLATFORM_LINUX || PLATFORM_MAC
+		const int Fd = open(TCHAR_TO_UTF8(*FPaths::ConvertRelativePathToFull(Filename)), O_RDONLY);
+		struct stat FileStat;
+		if (Fd >= 0 && fstat(Fd, &FileStat) == 0 && FileStat.st_size > 0)
+		{
+			void* Mapped = mmap(NULL, FileStat.st_size, PROT_READ, MAP_PRIVATE, Fd, 0);
+			if (Mapped != MAP_FAILED)
+			{
+				MappedData = Mapped;
+				Data = (const uint8*)Mapped;
+				Size = FileStat.st_size;
+			}
+		}
+
+		// mapping stays valid without descriptor
+		if (Fd >= 0)
+		{
+			close(Fd);
+		}
+#else
+		if (FFileHelper::LoadFileToArray(LoadedData, *Filename, FILEREAD_Silent))
+		{
+			Data = LoadedData.GetData();
+			Size = LoadedData.Num();
+		}
+#endif
+	}
+
+	~FVehicleLeaderboardFileView()
+	{
+#if PLATFORM_LINUX || PLATFORM_MAC
+		if (MappedData)
+		{
+			munmap(MappedData, Size);
+		}
+#endif
+	}
+
+	const uint8* GetData() const
+	{
+		return Data;
+	}
+
+	int64 GetSize() const
+	{
+		return Size;
+	}
+
+private:
+
+	const uint8* Data;
+	int64 Size;
+
+	/** mapping to release, NULL if file was loaded */
+	void* MappedData;
+
+	/** file contents on platforms without mapping */
+	TArray<uint8> LoadedData;
+};
+
+void FVehicleLeaderboardRecord::UpdateCrc()
+{
+	Crc = 0;
+	Crc = FCrc::MemCrc32(this, sizeof(FVehicleLeaderboardRecord));
+}
+
+bool FVehicleLeaderboardRecord::IsValid() const
+{
+	FVehicleLeaderboardRecord Copy = *this;
+	Copy.UpdateCrc();
+	return Copy.Crc == Crc && Category < EVehicleLeaderboardCategory::MAX && TimeMs > 0;
+}
+
+FString FVehicleLeaderboardRecord::GetName() const
+{
+	// name fills whole array when it's long, without terminating zero
+	ANSICHAR Buffer[VehicleLeaderboard::NameLength + 1];
+	FMemory::Memcpy(Buffer, Name, sizeof(Name));
+	Buffer[VehicleLeaderboard::NameLength] = 0;
+	return FString(ANSI_TO_TCHAR(Buffer));
+}
+
+void FVehicleLeaderboardIndex::AddRecord(const FVehicleLeaderboardRecord& Record)
+{
+	int32 TopIndex = TopRecords.Num();
+	while (TopIndex > 0 && TopRecords[TopIndex - 1].TimeMs > Record.TimeMs)
+	{
+		TopIndex--;
+	}
+	if (TopIndex < VehicleLeaderboard::MaxTopRecords)
+	{
+		TopRecords.Insert(Record, TopIndex);
+		if (TopRecords.Num() > VehicleLeaderboard::MaxTopRecords)
+		{
+			TopRecords.Pop();
+		}
+	}
+
+	// player moves up in ranking only by beating own best time
+	const FString PlayerName = Record.GetName();
+	int32* BestTime = PlayerBestTimes.Find(PlayerName);
+	if (BestTime == NULL || *BestTime > Record.TimeMs)
+	{
+		if (BestTime)
+		{
+			SortedBestTimes.RemoveAt(VehicleLeaderboard::FindInsertIndex(SortedBestTimes, *BestTime - 1));
+		}
+		SortedBestTimes.Insert(Record.TimeMs, VehicleLeaderboard::FindInsertIndex(SortedBestTimes, Record.TimeMs));
+		PlayerBestTimes.Add(PlayerName, Record.TimeMs);
+	}
+}
+
+void FVehicleLeaderboardIndex::Build(TArray<FVehicleLeaderboardRecord>& Records)
+{
+	// older record wins a tie
+	Records.Sort([](const FVehicleLeaderboardRecord& A, const FVehicleLeaderboardRecord& B)
+	{
+		return (A.TimeMs != B.TimeMs) ? (A.TimeMs < B.TimeMs) : (A.DateTicks < B.DateTicks);
+	});
+
+	TopRecords.Reset();
+	TopRecords.Append(Records.GetData(), FMath::Min(Records.Num(), VehicleLeaderboard::MaxTopRecords));
+
+	SortedBestTimes.Reset();
+	PlayerBestTimes.Reset();
+	for (int32 i = 0; i < Records.Num(); i++)
+	{
+		// records are sorted, so first one of each player is the best
+		const FString PlayerName = Records[i].GetName();
+		if (!PlayerBestTimes.Contains(PlayerName))
+		{
+			PlayerBestTimes.Add(PlayerName, Records[i].TimeMs);
+			SortedBestTimes.Add(Records[i].TimeMs);
+		}
+	}
+
+	bLoaded = true;
+}
+
+FVehicleLeaderboard::FVehicleLeaderboard(const FString& InFilename)
+	: Filename(InFilename)
+	, File(NULL)
+	, WorkEvent(NULL)
+	, Thread(NULL)
+{
+	checkAtCompile(sizeof(FVehicleLeaderboardRecord) == 40, LeaderboardRecordSizeChanged);
+	FMemory::Memzero(bCategoryRequested);
+
+	if (FPlatformProcess::SupportsMultithreading())
+	{
+		WorkEvent = FPlatformProcess::CreateSynchEvent();
+		Thread = FRunnableThread::Create(this, TEXT("VehicleLeaderboard"), 0, TPri_BelowNormal);
+	}
+}
+
+FVehicleLeaderboard::~FVehicleLeaderboard()
+{
+	if (Thread)
+	{
+		Stop();
+		Thread->WaitForCompletion();
+		delete Thread;
+		Thread = NULL;
+	}
+
+	// only writes are left, loads are dropped once stop is requested
+	StopRequested.Increment();
+	ProcessRequests();
+	delete WorkEvent;
+	delete File;
+}
+
+void FVehicleLeaderboard::AddRecord(EVehicleLeaderboardCategory::Type Category, const FString& PlayerName, float Time)
+{
+	FRequest Request;
+	FMemory::Memzero(&Request, sizeof(Request));
+	Request.bLoad = false;
+
+	FVehicleLeaderboardRecord& Record = Request.Record;
+	Record.DateTicks = FDateTime::UtcNow().GetTicks();
+	Record.TimeMs = FMath::Max(FMath::RoundToInt(Time * 1000.0f), 1);
+	Record.Category = (uint8)Category;
+	for (int32 i = 0; i < FMath::Min(PlayerName.Len(), VehicleLeaderboard::NameLength); i++)
+	{
+		Record.Name[i] = (PlayerName[i] < 128) ? (ANSICHAR)PlayerName[i] : '?';
+	}
+	Record.UpdateCrc();
+
+	QueueRequest(Request);
+}
+
+bool FVehicleLeaderboard::GetTopRecords(EVehicleLeaderboardCategory::Type Category, int32 MaxEntries, TArray<FVehicleLeaderboardEntry>& OutEntries)
+{
+	RequestCategory(Category);
+	OutEntries.Reset();
+
+	FScopeLock Lock(&IndexLock);
+	const FVehicleLeaderboardIndex& Index = Indices[Category];
+	for (int32 i = 0; i < FMath::Min(MaxEntries, Index.TopRecords.Num()); i++)
+	{
+		FVehicleLeaderboardEntry& Entry = OutEntries[OutEntries.Add(FVehicleLeaderboardEntry())];
+		Entry.PlayerName = Index.TopRecords[i].GetName();
+		Entry.Time = Index.TopRecords[i].TimeMs * 0.001f;
+		Entry.Date = FDateTime(Index.TopRecords[i].DateTicks);
+	}
+
+	return Index.bLoaded;
+}
+
+bool FVehicleLeaderboard::GetPlayerRank(EVehicleLeaderboardCategory::Type Category, const FString& PlayerName, int32& OutRank)
+{
+	RequestCategory(Category);
+
+	FScopeLock Lock(&IndexLock);
+	const FVehicleLeaderboardIndex& Index = Indices[Category];
+	const int32* BestTime = Index.PlayerBestTimes.Find(PlayerName.Left(VehicleLeaderboard::NameLength));
+
+	// every player with strictly faster best is ahead, ties share the place
+	OutRank = BestTime ? VehicleLeaderboard::FindInsertIndex(Index.SortedBestTimes, *BestTime - 1) + 1 : 0;
+	return Index.bLoaded;
+}
+
+void FVehicleLeaderboard::RequestCategory(EVehicleLeaderboardCategory::Type Category)
+{
+	if (!bCategoryRequested[Category])
+	{
+		bCategoryRequested[Category] = true;
+
+		FRequest Request;
+		FMemory::Memzero(&Request, sizeof(Request));
+		Request.bLoad = true;
+		Request.Record.Category = (uint8)Category;
+		QueueRequest(Request);
+	}
+}
+
+void FVehicleLeaderboard::QueueRequest(const FRequest& Request)
+{
+	Requests.Enqueue(Request);
+
+	if (WorkEvent)
+	{
+		WorkEvent->Trigger();
+	}
+	else
+	{
+		ProcessRequests();
+	}
+}
+
+uint32 FVehicleLeaderboard::Run()
+{
+	while (StopRequested.GetValue() == 0)
+	{
+		WorkEvent->Wait(100);
+		ProcessRequests();
+	}
+
+	return 0;
+}
+
+void FVehicleLeaderboard::Stop()
+{
+	StopRequested.Increment();
+	if (WorkEvent)
+	{
+		WorkEvent->Trigger();
+	}
+}
+
+void FVehicleLeaderboard::ProcessRequests()
+{
+	FRequest Request;
+	while (Requests.Dequeue(Request))
+	{
+		if (Request.bLoad)
+		{
+			if (StopRequested.GetValue() == 0)
+			{
+				LoadCategory(Request.Record.Category);
+			}
+			continue;
+		}
+
+		WriteRecord(Request.Record);
+
+		// only this thread changes indices, reading them here needs no lock
+		FVehicleLeaderboardIndex& Index = Indices[Request.Record.Category];
+		if (Index.bLoaded)
+		{
+			FScopeLock Lock(&IndexLock);
+			Index.AddRecord(Request.Record);
+		}
+	}
+}
+
+void FVehicleLeaderboard::WriteRecord(const FVehicleLeaderboardRecord& Record)
+{
+	if (File == NULL)
+	{
+		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		IFileManager::Get().MakeDirectory(*FPaths::GetPath(Filename), true);
+		const int64 ExistingSize = PlatformFile.FileSize(*Filename);
+
+		// file torn before its header was complete has no records, it's started again
+		const bool bNewFile = ExistingSize < VehicleLeaderboard::HeaderSize;
+		File = PlatformFile.OpenWrite(*Filename, !bNewFile);
+		if (File == NULL)
+		{
+			UE_LOG(LogVehicle, Warning, TEXT("Failed to open leaderboard %s"), *Filename);
+			return;
+		}
+
+		TArray<uint8> Header;
+		if (bNewFile)
+		{
+			FMemoryWriter Ar(Header);
+			uint32 Magic = VehicleLeaderboard::Magic;
+			uint32 Version = VehicleLeaderboard::Version;
+			Ar << Magic << Version;
+		}
+		else if ((ExistingSize - VehicleLeaderboard::HeaderSize) % sizeof(FVehicleLeaderboardRecord) != 0)
+		{
+			// pad torn record, so new ones stay aligned. Padded one fails its checksum
+			const int32 TornSize = (ExistingSize - VehicleLeaderboard::HeaderSize) % sizeof(FVehicleLeaderboardRecord);
+			Header.AddZeroed(sizeof(FVehicleLeaderboardRecord) - TornSize);
+		}
+
+		if (Header.Num() > 0 && !File->Write(Header.GetData(), Header.Num()))
+		{
+			UE_LOG(LogVehicle, Warning, TEXT("Failed to write leaderboard %s"), *Filename);
+			delete File;
+			File = NULL;
+			return;
+		}
+	}
+
+	if (!File->Write((const uint8*)&Record, sizeof(FVehicleLeaderboardRecord)))
+	{
+		UE_LOG(LogVehicle, Warning, TEXT("Failed to write leaderboard %s"), *Filename);
+		delete File;
+		File = NULL;
+	}
+}
+
+void FVehicleLeaderboard::LoadCategory(uint8 Category)
+{
+	FVehicleLeaderboardFileView View(Filename);
+	const uint8* Data = View.GetData();
+	const int64 Size = View.GetSize();
+
+	TArray<FVehicleLeaderboardRecord> Records;
+	if (Size >= VehicleLeaderboard::HeaderSize)
+	{
+		uint32 Header[2];
+		FMemory::Memcpy(Header, Data, sizeof(Header));
+		if (Header[0] == VehicleLeaderboard::Magic && Header[1] == VehicleLeaderboard::Version)
+		{
+			for (int64 Offset = VehicleLeaderboard::HeaderSize; Offset + (int64)sizeof(FVehicleLeaderboardRecord) <= Size; Offset += sizeof(FVehicleLeaderboardRecord))
+			{
+				FVehicleLeaderboardRecord Record;
+				FMemory::Memcpy(&Record, Data + Offset, sizeof(Record));
+				if (Record.Category == Category && Record.IsValid())
+				{
+					Records.Add(Record);
+				}
+			}
+		}
+		else
+		{
+			UE_LOG(LogVehicle, Warning, TEXT("%s is not a leaderboard of this version"), *Filename);
+		}
+	}
+
+	// sorted outside of lock, game thread only waits for the swap
+	FVehicleLeaderboardIndex NewIndex;
+	NewIndex.Build(Records);
+
+	FScopeLock Lock(&IndexLock);
+	Exchange(Indices[Category], NewIndex);
+}
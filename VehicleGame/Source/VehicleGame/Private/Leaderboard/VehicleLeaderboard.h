@@ -0,0 +1,180 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+//
+// Local leaderboard of single track: header followed by fixed size records, only ever appended.
+// Torn record at the end of interrupted write fails its checksum and is skipped when loading.
+//
+
+namespace VehicleLeaderboard
+{
+	/** file identification, "VLBD" */
+	static const uint32 Magic = 0x44424C56;
+
+	/** increase when format changes */
+	static const uint32 Version = 1;
+
+	/** number of best records kept with names for each category */
+	static const int32 MaxTopRecords = 100;
+
+	/** characters of player name stored in record */
+	static const int32 NameLength = 20;
+}
+
+namespace EVehicleLeaderboardCategory
+{
+	enum Type
+	{
+		RaceTime,
+		BestLap,
+		MAX
+	};
+}
+
+/** Single record as stored in file */
+struct FVehicleLeaderboardRecord
+{
+	/** UTC time when record was set, in FDateTime ticks */
+	int64 DateTicks;
+
+	int32 TimeMs;
+
+	/** checksum of record with this field set to 0 */
+	uint32 Crc;
+
+	/** player name, zero padded */
+	ANSICHAR Name[VehicleLeaderboard::NameLength];
+
+	/** EVehicleLeaderboardCategory */
+	uint8 Category;
+
+	uint8 Reserved[3];
+
+	/** fill checksum */
+	void UpdateCrc();
+
+	/** is checksum right and category known? */
+	bool IsValid() const;
+
+	FString GetName() const;
+};
+
+/** Record returned by queries */
+struct FVehicleLeaderboardEntry
+{
+	FString PlayerName;
+
+	/** time in seconds */
+	float Time;
+
+	FDateTime Date;
+};
+
+/** Loaded records of single category */
+struct FVehicleLeaderboardIndex
+{
+	/** best records, fastest first */
+	TArray<FVehicleLeaderboardRecord> TopRecords;
+
+	/** best time of every player, fastest first, to rank players outside of TopRecords */
+	TArray<int32> SortedBestTimes;
+
+	/** best time of each player */
+	TMap<FString, int32> PlayerBestTimes;
+
+	/** was category read from file? */
+	bool bLoaded;
+
+	FVehicleLeaderboardIndex()
+		: bLoaded(false)
+	{
+	}
+
+	/** add record written after category was loaded */
+	void AddRecord(const FVehicleLeaderboardRecord& Record);
+
+	/** build index from all records of category found in file */
+	void Build(TArray<FVehicleLeaderboardRecord>& Records);
+};
+
+/**
+ * Leaderboard of single track, stored in append-only file.
+ * Worker thread does all file access: writes new records and loads categories on first query,
+ * so game thread only ever reads indices in memory.
+ */
+class FVehicleLeaderboard : public FRunnable
+{
+public:
+
+	/** nothing is read until category is queried */
+	FVehicleLeaderboard(const FString& InFilename);
+
+	/** writes all queued records and closes file */
+	virtual ~FVehicleLeaderboard();
+
+	/** queue record for writing, queries see it once it's written */
+	void AddRecord(EVehicleLeaderboardCategory::Type Category, const FString& PlayerName, float Time);
+
+	/** get up to MaxEntries best records, fastest first. Returns false while category is loading */
+	bool GetTopRecords(EVehicleLeaderboardCategory::Type Category, int32 MaxEntries, TArray<FVehicleLeaderboardEntry>& OutEntries);
+
+	/** get place of player's best time starting at 1, 0 if player has none. Returns false while category is loading */
+	bool GetPlayerRank(EVehicleLeaderboardCategory::Type Category, const FString& PlayerName, int32& OutRank);
+
+	// Begin FRunnable interface
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+	// End FRunnable interface
+
+private:
+
+	/** work for worker thread, done in order of queueing */
+	struct FRequest
+	{
+		/** load category of Record instead of writing it */
+		bool bLoad;
+
+		FVehicleLeaderboardRecord Record;
+	};
+
+	/** queue request, wake worker */
+	void QueueRequest(const FRequest& Request);
+
+	/** make sure category is loaded or being loaded */
+	void RequestCategory(EVehicleLeaderboardCategory::Type Category);
+
+	/** [worker] do everything queued so far */
+	void ProcessRequests();
+
+	/** [worker] append record to file, creating it if needed */
+	void WriteRecord(const FVehicleLeaderboardRecord& Record);
+
+	/** [worker] read all records of category from file */
+	void LoadCategory(uint8 Category);
+
+	FString Filename;
+
+	/** [worker] file opened for appending, on first write */
+	IFileHandle* File;
+
+	/** requests waiting for worker */
+	TQueue<FRequest, EQueueMode::Spsc> Requests;
+
+	/** [game thread] categories already asked from worker */
+	bool bCategoryRequested[EVehicleLeaderboardCategory::MAX];
+
+	/** guards Indices, worker updates them while game thread queries */
+	FCriticalSection IndexLock;
+
+	FVehicleLeaderboardIndex Indices[EVehicleLeaderboardCategory::MAX];
+
+	/** triggered when new request is queued */
+	FEvent* WorkEvent;
+
+	/** set when worker should exit */
+	FThreadSafeCounter StopRequested;
+
+	/** NULL if platform doesn't support threads, requests are done right away then */
+	FRunnableThread* Thread;
+};
@@ -0,0 +1,109 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleGame.h"
+#include "VehicleNetStats.h"
+
+bool FVehicleNetStats::bEnabled = false;
+TMap<FName, FVehicleNetStats::FClassStats> FVehicleNetStats::Stats;
+
+FVehicleNetStats::FScopedReplicationTimer::FScopedReplicationTimer(const UClass* InClass)
+	: Class(bEnabled ? InClass : NULL)
+	, StartTime(bEnabled ? FPlatformTime::Seconds() : 0.0)
+{
+}
+
+FVehicleNetStats::FScopedReplicationTimer::~FScopedReplicationTimer()
+{
+	if (Class && bEnabled)
+	{
+		FClassStats& ClassStats = GetClassStats(Class);
+		ClassStats.NetUpdates++;
+		ClassStats.PreReplicationSeconds += FPlatformTime::Seconds() - StartTime;
+	}
+}
+
+void FVehicleNetStats::Start()
+{
+	Stats.Reset();
+	bEnabled = true;
+}
+
+void FVehicleNetStats::Stop()
+{
+	bEnabled = false;
+}
+
+FVehicleNetStats::FClassStats& FVehicleNetStats::GetClassStats(const UClass* Class)
+{
+	return Stats.FindOrAdd(Class ? Class->GetFName() : NAME_None);
+}
+
+void FVehicleNetStats::AddPropertyUpdate(const UClass* Class, int32 NumBits)
+{
+	if (bEnabled)
+	{
+		FClassStats& ClassStats = GetClassStats(Class);
+		ClassStats.PropertyUpdates++;
+		ClassStats.PropertyBits += NumBits;
+	}
+}
+
+void FVehicleNetStats::AddRpcSent(const UClass* Class, int32 NumBits)
+{
+	if (bEnabled)
+	{
+		FClassStats& ClassStats = GetClassStats(Class);
+		ClassStats.RpcsSent++;
+		ClassStats.RpcSentBits += NumBits;
+	}
+}
+
+void FVehicleNetStats::AddRpcReceived(const UClass* Class, int32 NumBits)
+{
+	if (bEnabled)
+	{
+		FClassStats& ClassStats = GetClassStats(Class);
+		ClassStats.RpcsReceived++;
+		ClassStats.RpcReceivedBits += NumBits;
+	}
+}
+
+int64 FVehicleNetStats::GetArchiveBits(FArchive& Ar)
+{
+	if (!bEnabled)
+	{
+		return 0;
+	}
+
+	return Ar.IsSaving() ? static_cast<FBitWriter&>(Ar).GetNumBits() : static_cast<FBitReader&>(Ar).GetPosBits();
+}
+
+bool FVehicleNetStats::WriteCsv(const FString& Filename, const FString& RunName, float Duration, int32 NumClients, int64 EstimatedTotalBytes)
+{
+	const float InvDuration = (Duration > 0.0f) ? 1.0f / Duration : 0.0f;
+
+	// BytesPerSecond is what server sends, received RPCs have columns of their own. Per class bytes are only what game code serializes
+	FString Csv = TEXT("Run,Class,Clients,DurationSeconds,BytesPerSecond,GameCodePropertyBytesPerSecond,GameCodeRpcSentBytesPerSecond,GameCodeRpcReceivedBytesPerSecond,NetUpdatesPerSecond,PropertyUpdatesPerSecond,RpcsSentPerSecond,RpcsReceivedPerSecond,PreReplicationMsPerSecond\n");
+
+	int64 CountedBytesSent = 0;
+	for (TMap<FName, FClassStats>::TConstIterator It(Stats); It; ++It)
+	{
+		const FClassStats& ClassStats = It.Value();
+		const int64 PropertyBytes = (ClassStats.PropertyBits + 7) / 8;
+		const int64 RpcSentBytes = (ClassStats.RpcSentBits + 7) / 8;
+		const int64 RpcReceivedBytes = (ClassStats.RpcReceivedBits + 7) / 8;
+		CountedBytesSent += PropertyBytes + RpcSentBytes;
+
+		Csv += FString::Printf(TEXT("%s,%s,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.3f\n"),
+			*RunName, *It.Key().ToString(), NumClients, Duration,
+			(PropertyBytes + RpcSentBytes) * InvDuration, PropertyBytes * InvDuration, RpcSentBytes * InvDuration, RpcReceivedBytes * InvDuration,
+			ClassStats.NetUpdates * InvDuration, ClassStats.PropertyUpdates * InvDuration, ClassStats.RpcsSent * InvDuration, ClassStats.RpcsReceived * InvDuration,
+			ClassStats.PreReplicationSeconds * 1000.0 * InvDuration);
+	}
+
+	// packet headers, engine serialized properties and RPCs
+	Csv += FString::Printf(TEXT("%s,%s,%d,%.1f,%.1f,,,,,,,,\n"), *RunName, TEXT("EstimatedEngineOverhead"), NumClients, Duration, FMath::Max<int64>(EstimatedTotalBytes - CountedBytesSent, 0) * InvDuration);
+	Csv += FString::Printf(TEXT("%s,%s,%d,%.1f,%.1f,,,,,,,,\n"), *RunName, TEXT("EstimatedTotal"), NumClients, Duration, EstimatedTotalBytes * InvDuration);
+
+	return FFileHelper::SaveStringToFile(Csv, *Filename);
+}
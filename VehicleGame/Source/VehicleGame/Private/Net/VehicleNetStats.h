@@ -0,0 +1,88 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+/**
+ * Replication cost counters per actor class, collected while net benchmark is running.
+ * These are game code only estimates: bits are counted only where game code serializes data itself,
+ * RPCs with parameters serialized by engine are counted as calls without bits, engine's headers are not included.
+ * Total bytes are not counted, they are estimated from connections' send rate.
+ */
+class FVehicleNetStats
+{
+public:
+
+	/** counters of single actor class */
+	struct FClassStats
+	{
+		/** net updates considered (PreReplication calls) */
+		int32 NetUpdates;
+
+		/** custom serialized properties sent */
+		int32 PropertyUpdates;
+
+		/** bits of custom serialized properties */
+		int64 PropertyBits;
+
+		/** RPCs sent by server */
+		int32 RpcsSent;
+
+		/** bits of parameters of RPCs sent by server */
+		int64 RpcSentBits;
+
+		/** RPCs received by server */
+		int32 RpcsReceived;
+
+		/** bits of parameters of RPCs received by server */
+		int64 RpcReceivedBits;
+
+		/** time spent in PreReplication of actors, engine's property comparison and serialization are not included */
+		double PreReplicationSeconds;
+
+		FClassStats()
+			: NetUpdates(0), PropertyUpdates(0), PropertyBits(0), RpcsSent(0), RpcSentBits(0), RpcsReceived(0), RpcReceivedBits(0), PreReplicationSeconds(0.0)
+		{
+		}
+	};
+
+	/** measures PreReplication of actor */
+	class FScopedReplicationTimer
+	{
+	public:
+		FScopedReplicationTimer(const UClass* InClass);
+		~FScopedReplicationTimer();
+
+	private:
+		const UClass* Class;
+		double StartTime;
+	};
+
+	/** start collecting, clearing previous counters */
+	static void Start();
+
+	/** stop collecting */
+	static void Stop();
+
+	/** are counters being collected? */
+	FORCEINLINE static bool IsEnabled()
+	{
+		return bEnabled;
+	}
+
+	static void AddPropertyUpdate(const UClass* Class, int32 NumBits);
+	static void AddRpcSent(const UClass* Class, int32 NumBits);
+	static void AddRpcReceived(const UClass* Class, int32 NumBits);
+
+	/** bits written to or read from net archive so far, 0 while not collecting. Net serializers always get bit archives */
+	static int64 GetArchiveBits(FArchive& Ar);
+
+	/** write one line per class. EstimatedTotalBytes are bytes sent to clients estimated from send rate, remainder after counted properties and sent RPCs is reported as estimated engine overhead */
+	static bool WriteCsv(const FString& Filename, const FString& RunName, float Duration, int32 NumClients, int64 EstimatedTotalBytes);
+
+private:
+
+	static FClassStats& GetClassStats(const UClass* Class);
+
+	static bool bEnabled;
+	static TMap<FName, FClassStats> Stats;
+};
@@ -0,0 +1,420 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleGame.h"
+#include "VehicleTestHarness.h"
+#include "VehicleNetStats.h"
+
+FVehicleServerTestHarness::FVehicleServerTestHarness()
+{
+	bNetTest = FParse::Param(FCommandLine::Get(), TEXT("VehicleNetTest"));
+	bNetBenchmark = bNetTest || FParse::Param(FCommandLine::Get(), TEXT("VehicleNetBenchmark"));
+	bNetBenchmarkRunning = false;
+	NetBenchmarkRacers = 8;
+	NetBenchmarkDuration = 120.0f;
+	NetBenchmarkName = TEXT("Default");
+	FParse::Value(FCommandLine::Get(), TEXT("BenchmarkRacers="), NetBenchmarkRacers);
+	FParse::Value(FCommandLine::Get(), TEXT("BenchmarkDuration="), NetBenchmarkDuration);
+	FParse::Value(FCommandLine::Get(), TEXT("BenchmarkName="), NetBenchmarkName);
+	NetBenchmarkStartTime = 0.0f;
+	NetBenchmarkSampleTime = 0.0f;
+	NetBenchmarkEstimatedBytesSent = 0;
+
+	NetTestConvergeTimeout = 5.0f;
+	FParse::Value(FCommandLine::Get(), TEXT("ConvergeTimeout="), NetTestConvergeTimeout);
+	NetTestRaceOverTime = 0.0f;
+
+	bHostedServer = FParse::Param(FCommandLine::Get(), TEXT("VehicleHosted"));
+	LastServerStatsTime = 0.0f;
+	ServerTickTimeTotal = 0.0f;
+	ServerTickTimeMax = 0.0f;
+	NumServerTickSamples = 0;
+}
+
+TSharedPtr<FVehicleServerTestHarness> FVehicleServerTestHarness::CreateFromCommandLine()
+{
+	TSharedPtr<FVehicleServerTestHarness> Harness = MakeShareable(new FVehicleServerTestHarness());
+	if (!Harness->bNetBenchmark && !Harness->bHostedServer)
+	{
+		Harness.Reset();
+	}
+	return Harness;
+}
+
+void FVehicleServerTestHarness::OnStartPlay(AVehicleGameMode* GameMode)
+{
+	// map is loaded and server is listening, VehicleNetTest commandlet starts its bots after this line
+	if (bNetTest)
+	{
+		UE_LOG(LogVehicle, Display, TEXT("VehicleNetTestReady"));
+	}
+}
+
+void FVehicleServerTestHarness::Tick(AVehicleGameMode* GameMode)
+{
+	if (bNetBenchmark)
+	{
+		UpdateNetBenchmark(GameMode);
+	}
+
+	if (bHostedServer)
+	{
+		// work done by game thread in last frame, without waiting for next tick
+		const float TickTime = FPlatformTime::ToMilliseconds(GGameThreadTime);
+		ServerTickTimeTotal += TickTime;
+		ServerTickTimeMax = FMath::Max(ServerTickTimeMax, TickTime);
+		NumServerTickSamples++;
+
+		if (GameMode->GetWorld()->GetRealTimeSeconds() - LastServerStatsTime >= 5.0f)
+		{
+			LastServerStatsTime = GameMode->GetWorld()->GetRealTimeSeconds();
+			ReportServerStats(GameMode);
+		}
+	}
+}
+
+void FVehicleServerTestHarness::UpdateNetBenchmark(AVehicleGameMode* GameMode)
+{
+	UNetDriver* NetDriver = GameMode->GetWorld()->GetNetDriver();
+	if (NetDriver == NULL)
+	{
+		return;
+	}
+
+	const float CurrentTime = GameMode->GetWorld()->GetTimeSeconds();
+	if (!bNetBenchmarkRunning)
+	{
+		// bots drive the same track every run, so results are comparable
+		if (NetBenchmarkStartTime == 0.0f && GameMode->NumPlayers >= NetBenchmarkRacers)
+		{
+			UE_LOG(LogVehicle, Display, TEXT("Net benchmark '%s' started with %d racers"), *NetBenchmarkName, GameMode->NumPlayers);
+			GameMode->StartRace();
+			bNetBenchmarkRunning = true;
+
+			// race digests of network test would be counted as game traffic, it only checks correctness
+			if (!bNetTest)
+			{
+				FVehicleNetStats::Start();
+			}
+			NetBenchmarkStartTime = CurrentTime;
+			NetBenchmarkSampleTime = CurrentTime;
+			NetBenchmarkEstimatedBytesSent = 0;
+		}
+		return;
+	}
+
+	// connections only know bytes per second, add them up once per second as estimate of total
+	if (CurrentTime - NetBenchmarkSampleTime >= 1.0f)
+	{
+		for (int32 i = 0; i < NetDriver->ClientConnections.Num(); i++)
+		{
+			UNetConnection* Connection = NetDriver->ClientConnections[i];
+			if (Connection)
+			{
+				NetBenchmarkEstimatedBytesSent += (int64)(Connection->OutBytesPerSecond * (CurrentTime - NetBenchmarkSampleTime));
+			}
+		}
+		NetBenchmarkSampleTime = CurrentTime;
+	}
+
+	if (bNetTest)
+	{
+		for (FConstPlayerControllerIterator It = GameMode->GetWorld()->GetPlayerControllerIterator(); It; ++It)
+		{
+			AVehiclePlayerController* VehiclePC = Cast<AVehiclePlayerController>(*It);
+			if (VehiclePC && !VehiclePC->IsLocalController())
+			{
+				UpdateRaceConvergence(VehiclePC, CurrentTime);
+			}
+		}
+	}
+
+	if (!IsNetBenchmarkOver(GameMode, CurrentTime))
+	{
+		return;
+	}
+
+	const bool bTimedOut = CurrentTime - NetBenchmarkStartTime >= NetBenchmarkDuration;
+	bNetBenchmarkRunning = false;
+	GameMode->FinishRace();
+
+	if (FVehicleNetStats::IsEnabled())
+	{
+		FVehicleNetStats::Stop();
+
+		const FString Filename = FPaths::GameSavedDir() / TEXT("Benchmarks") / FString::Printf(TEXT("NetBenchmark-%s-%s.csv"), *NetBenchmarkName, *FDateTime::Now().ToString());
+		if (FVehicleNetStats::WriteCsv(Filename, NetBenchmarkName, CurrentTime - NetBenchmarkStartTime, NetDriver->ClientConnections.Num(), NetBenchmarkEstimatedBytesSent))
+		{
+			UE_LOG(LogVehicle, Display, TEXT("Net benchmark results written to %s"), *Filename);
+		}
+		else
+		{
+			UE_LOG(LogVehicle, Error, TEXT("Failed to write net benchmark results to %s"), *Filename);
+		}
+	}
+
+	if (bNetTest)
+	{
+		// fixed name, VehicleNetTest commandlet looks for it
+		const FString TestFilename = FPaths::GameSavedDir() / TEXT("NetTests") / FString::Printf(TEXT("NetTest-%s.csv"), *NetBenchmarkName);
+		const bool bPassed = WriteNetTestResults(GameMode, TestFilename, bTimedOut);
+		UE_LOG(LogVehicle, Display, TEXT("Net test '%s' %s, results written to %s"), *NetBenchmarkName, bPassed ? TEXT("passed") : TEXT("FAILED"), *TestFilename);
+	}
+
+	FPlatformMisc::RequestExit(false);
+}
+
+bool FVehicleServerTestHarness::IsNetBenchmarkOver(AVehicleGameMode* GameMode, float CurrentTime)
+{
+	if (CurrentTime - NetBenchmarkStartTime >= NetBenchmarkDuration)
+	{
+		return true;
+	}
+
+	// benchmark drives for fixed time, network test plays the whole race
+	if (!bNetTest)
+	{
+		return false;
+	}
+
+	// game mode ends the race once everyone crossed finish line, clients get time to agree on final order
+	if (NetTestRaceOverTime == 0.0f && (GameMode->HaveAllRacersFinished() || !GameMode->IsRaceActive()))
+	{
+		NetTestRaceOverTime = CurrentTime;
+	}
+	return NetTestRaceOverTime > 0.0f && CurrentTime - NetTestRaceOverTime > NetTestConvergeTimeout;
+}
+
+void FVehicleServerTestHarness::OnRaceDigestReported(AVehiclePlayerController* VehiclePC, const FVehicleRaceDigest& Digest, int32 NumCorrections)
+{
+	FVehicleRaceConvergence& Convergence = RaceConvergences.FindOrAdd(VehiclePC);
+	Convergence.ClientDigest = Digest;
+	Convergence.NumCorrections = NumCorrections;
+}
+
+void FVehicleServerTestHarness::UpdateRaceConvergence(AVehiclePlayerController* VehiclePC, float CurrentTime)
+{
+	FVehicleRaceConvergence& Convergence = RaceConvergences.FindOrAdd(VehiclePC);
+	const FVehicleRaceDigest ServerDigest = VehiclePC->GetRaceDigest();
+	if (ServerDigest != Convergence.ServerDigest)
+	{
+		Convergence.ServerDigest = ServerDigest;
+		Convergence.ChangeTime = CurrentTime;
+		Convergence.bConverged = false;
+		Convergence.bFailed = false;
+	}
+
+	if (Convergence.bConverged || Convergence.bFailed)
+	{
+		return;
+	}
+
+	const float ElapsedTime = CurrentTime - Convergence.ChangeTime;
+	if (Convergence.ClientDigest == ServerDigest)
+	{
+		Convergence.bConverged = true;
+		Convergence.NumConverges++;
+		Convergence.TotalConvergeTime += ElapsedTime;
+		Convergence.MaxConvergeTime = FMath::Max(Convergence.MaxConvergeTime, ElapsedTime);
+	}
+	else if (ElapsedTime > NetTestConvergeTimeout)
+	{
+		Convergence.bFailed = true;
+		Convergence.NumFailures++;
+		UE_LOG(LogVehicle, Warning, TEXT("%s didn't converge in %.1f s: server %s, client %s"),
+			*VehiclePC->GetName(), NetTestConvergeTimeout, *ServerDigest.ToString(), *Convergence.ClientDigest.ToString());
+	}
+}
+
+bool FVehicleServerTestHarness::WriteNetTestResults(AVehicleGameMode* GameMode, const FString& Filename, bool bTimedOut) const
+{
+	FString Csv = TEXT("Run,Player,Converges,AvgConvergeSeconds,MaxConvergeSeconds,Failures,Corrections,Passed,Finishers\n");
+
+	int32 TotalConverges = 0;
+	int32 TotalFailures = 0;
+	int32 TotalCorrections = 0;
+	float TotalConvergeTime = 0.0f;
+	float MaxConvergeTime = 0.0f;
+	for (FConstPlayerControllerIterator It = GameMode->GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		AVehiclePlayerController* VehiclePC = Cast<AVehiclePlayerController>(*It);
+		if (VehiclePC == NULL || VehiclePC->IsLocalController())
+		{
+			continue;
+		}
+
+		const FVehicleRaceConvergence* FoundConvergence = RaceConvergences.Find(VehiclePC);
+		const FVehicleRaceConvergence Convergence = FoundConvergence ? *FoundConvergence : FVehicleRaceConvergence();
+		const AVehiclePlayerState* VehiclePlayerState = Cast<AVehiclePlayerState>(VehiclePC->PlayerState);
+		const bool bFinished = VehiclePlayerState && VehiclePlayerState->GetRaceProgress().FinishTimeMs > 0;
+		Csv += FString::Printf(TEXT("%s,%s,%d,%.3f,%.3f,%d,%d,%d,%d\n"), *NetBenchmarkName, *VehiclePC->GetName(),
+			Convergence.NumConverges, Convergence.NumConverges ? Convergence.TotalConvergeTime / Convergence.NumConverges : 0.0f,
+			Convergence.MaxConvergeTime, Convergence.NumFailures, Convergence.NumCorrections,
+			(Convergence.NumFailures == 0 && Convergence.NumConverges > 0) ? 1 : 0, bFinished ? 1 : 0);
+
+		TotalConverges += Convergence.NumConverges;
+		TotalFailures += Convergence.NumFailures;
+		TotalCorrections += Convergence.NumCorrections;
+		TotalConvergeTime += Convergence.TotalConvergeTime;
+		MaxConvergeTime = FMath::Max(MaxConvergeTime, Convergence.MaxConvergeTime);
+	}
+
+	// finish order is only tested if someone finished, and the race has to be played to the end
+	int32 NumFinishers = 0;
+	AGameState* GameState = GameMode->GameState;
+	for (int32 i = 0; GameState && i < GameState->PlayerArray.Num(); i++)
+	{
+		const AVehiclePlayerState* VehiclePlayerState = Cast<AVehiclePlayerState>(GameState->PlayerArray[i]);
+		if (VehiclePlayerState && VehiclePlayerState->GetRaceProgress().FinishTimeMs > 0)
+		{
+			NumFinishers++;
+		}
+	}
+	if (NumFinishers == 0)
+	{
+		UE_LOG(LogVehicle, Warning, TEXT("Net test '%s': nobody finished the race"), *NetBenchmarkName);
+	}
+	if (bTimedOut)
+	{
+		UE_LOG(LogVehicle, Warning, TEXT("Net test '%s': race wasn't over in %.0f s"), *NetBenchmarkName, NetBenchmarkDuration);
+	}
+
+	// client that never converged doesn't count as passed
+	const bool bPassed = TotalFailures == 0 && TotalConverges > 0 && NumFinishers > 0 && !bTimedOut;
+	Csv += FString::Printf(TEXT("%s,Summary,%d,%.3f,%.3f,%d,%d,%d,%d\n"), *NetBenchmarkName,
+		TotalConverges, TotalConverges ? TotalConvergeTime / TotalConverges : 0.0f, MaxConvergeTime, TotalFailures, TotalCorrections, bPassed ? 1 : 0, NumFinishers);
+
+	FFileHelper::SaveStringToFile(Csv, *Filename);
+	return bPassed;
+}
+
+void FVehicleServerTestHarness::ReportServerStats(AVehicleGameMode* GameMode)
+{
+	const FPlatformMemoryStats MemoryStats = FPlatformMemory::GetStats();
+
+	// parsed by VehicleServerHost commandlet, keep format in sync
+	UE_LOG(LogVehicle, Display, TEXT("VehicleServerStats Players=%d TickMs=%.2f MaxTickMs=%.2f RssMB=%d"),
+		GameMode->NumPlayers,
+		NumServerTickSamples ? ServerTickTimeTotal / NumServerTickSamples : 0.0f,
+		ServerTickTimeMax,
+		(int32)(MemoryStats.UsedPhysical / (1024 * 1024)));
+
+	ServerTickTimeTotal = 0.0f;
+	ServerTickTimeMax = 0.0f;
+	NumServerTickSamples = 0;
+}
+
+FVehicleClientTestHarness::FVehicleClientTestHarness()
+{
+	bBotMode = FParse::Param(FCommandLine::Get(), TEXT("VehicleBot"));
+	BotStuckTime = 0.0f;
+	LastBotStatsTime = 0.0f;
+
+	bNetTest = FParse::Param(FCommandLine::Get(), TEXT("VehicleNetTest"));
+	LastRaceDigestTime = 0.0f;
+}
+
+TSharedPtr<FVehicleClientTestHarness> FVehicleClientTestHarness::CreateFromCommandLine()
+{
+	TSharedPtr<FVehicleClientTestHarness> Harness = MakeShareable(new FVehicleClientTestHarness());
+	if (!Harness->bBotMode && !Harness->bNetTest)
+	{
+		Harness.Reset();
+	}
+	return Harness;
+}
+
+void FVehicleClientTestHarness::Tick(AVehiclePlayerController* VehiclePC, float DeltaTime)
+{
+	UWorld* World = VehiclePC->GetWorld();
+
+	// report right after change, and now and then in case it got lost
+	if (bNetTest)
+	{
+		const FVehicleRaceDigest Digest = VehiclePC->GetRaceDigest();
+		if (Digest != LastSentRaceDigest || World->GetTimeSeconds() - LastRaceDigestTime >= 1.0f)
+		{
+			AWheeledVehicle* Vehicle = Cast<AWheeledVehicle>(VehiclePC->GetPawn());
+			UVehicleMovementComponentBoosted4w* BoostedMovement = Vehicle ? Cast<UVehicleMovementComponentBoosted4w>(Vehicle->GetVehicleMovement()) : NULL;
+
+			LastSentRaceDigest = Digest;
+			LastRaceDigestTime = World->GetTimeSeconds();
+			VehiclePC->ServerReportRaceDigest(Digest, BoostedMovement ? BoostedMovement->GetNumCorrections() : 0);
+		}
+	}
+
+	if (bBotMode)
+	{
+		UpdateBotInput(VehiclePC, DeltaTime);
+
+		if (World->GetTimeSeconds() - LastBotStatsTime >= 5.0f)
+		{
+			LastBotStatsTime = World->GetTimeSeconds();
+			ReportBotStats(VehiclePC);
+		}
+	}
+}
+
+void FVehicleClientTestHarness::UpdateBotInput(AVehiclePlayerController* VehiclePC, float DeltaTime)
+{
+	AWheeledVehicle* Vehicle = Cast<AWheeledVehicle>(VehiclePC->GetPawn());
+	UVehicleMovementComponentBoosted4w* BoostedMovement = Vehicle ? Cast<UVehicleMovementComponentBoosted4w>(Vehicle->GetVehicleMovement()) : NULL;
+	AVehicleGameState* GameState = VehiclePC->GetWorld()->GetGameState<AVehicleGameState>();
+	if (BoostedMovement == NULL)
+	{
+		return;
+	}
+
+	const float LookAheadDistance = 2000.0f;
+	float Throttle = 1.0f;
+	float Steering = 0.0f;
+	float TrackDistance = 0.0f;
+	if (GameState && BoostedMovement->GetTrackDistance(TrackDistance))
+	{
+		const FVector Target = GameState->GetTrackLayout().GetLocationAtDistance(TrackDistance + LookAheadDistance);
+		const FVector LocalTarget = Vehicle->GetActorTransform().InverseTransformPosition(Target);
+		const float TargetAngle = FMath::RadiansToDegrees(FMath::Atan2(LocalTarget.Y, LocalTarget.X));
+		Steering = FMath::Clamp(TargetAngle / 45.0f, -1.0f, 1.0f);
+		Throttle = 1.0f - 0.5f * FMath::Abs(Steering);
+	}
+	else
+	{
+		// no track in level, weave around so server still has something to simulate
+		Steering = FMath::Sin(VehiclePC->GetWorld()->GetTimeSeconds() * 0.5f);
+	}
+
+	// get back to last checkpoint if stuck against something
+	const bool bRaceActive = GameState && GameState->IsRaceActive();
+	BotStuckTime = (bRaceActive && FMath::Abs(BoostedMovement->GetForwardSpeed()) < 100.0f) ? BotStuckTime + DeltaTime : 0.0f;
+	if (BotStuckTime > 5.0f)
+	{
+		BotStuckTime = 0.0f;
+		VehiclePC->Suicide();
+		return;
+	}
+
+	ABuggyPawn* Buggy = Cast<ABuggyPawn>(Vehicle);
+	AVehiclePawn* VehiclePawn = Cast<AVehiclePawn>(Vehicle);
+	if (Buggy)
+	{
+		Buggy->MoveForward(Throttle);
+		Buggy->MoveRight(Steering);
+	}
+	else if (VehiclePawn)
+	{
+		VehiclePawn->MoveForward(Throttle);
+		VehiclePawn->MoveRight(Steering);
+	}
+}
+
+void FVehicleClientTestHarness::ReportBotStats(AVehiclePlayerController* VehiclePC)
+{
+	AWheeledVehicle* Vehicle = Cast<AWheeledVehicle>(VehiclePC->GetPawn());
+	UVehicleMovementComponentBoosted4w* BoostedMovement = Vehicle ? Cast<UVehicleMovementComponentBoosted4w>(Vehicle->GetVehicleMovement()) : NULL;
+	UNetConnection* Connection = VehiclePC->GetNetConnection();
+
+	// parsed by VehicleBotLauncher commandlet, keep format in sync
+	UE_LOG(LogVehicle, Display, TEXT("VehicleBotStats Ping=%d Corrections=%d InBytesPerSecond=%d"),
+		VehiclePC->PlayerState ? VehiclePC->PlayerState->Ping * 4 : 0,
+		BoostedMovement ? BoostedMovement->GetNumCorrections() : 0,
+		Connection ? Connection->InBytesPerSecond : 0);
+}
@@ -0,0 +1,133 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+/**
+ * [server] Net benchmark, network test and hosted server stats.
+ * Created by game mode only when one of them is requested on command line, normal games don't have it.
+ */
+class FVehicleServerTestHarness
+{
+public:
+
+	/** returns NULL unless -VehicleNetBenchmark, -VehicleNetTest or -VehicleHosted is set */
+	static TSharedPtr<FVehicleServerTestHarness> CreateFromCommandLine();
+
+	/** map is loaded and server is listening */
+	void OnStartPlay(AVehicleGameMode* GameMode);
+
+	/** called every game mode tick */
+	void Tick(AVehicleGameMode* GameMode);
+
+	/** client reported race state it sees */
+	void OnRaceDigestReported(AVehiclePlayerController* VehiclePC, const FVehicleRaceDigest& Digest, int32 NumCorrections);
+
+private:
+
+	FVehicleServerTestHarness();
+
+	/** is server running net benchmark? (-VehicleNetBenchmark) */
+	bool bNetBenchmark;
+
+	/** is server running network correctness test? (-VehicleNetTest), it runs the same race as benchmark without collecting net stats */
+	bool bNetTest;
+
+	/** is benchmark race running? */
+	bool bNetBenchmarkRunning;
+
+	/** number of players benchmark race waits for (-BenchmarkRacers=) */
+	int32 NetBenchmarkRacers;
+
+	/** length of benchmark race in seconds, network test ends when race is over and uses it as timeout (-BenchmarkDuration=) */
+	float NetBenchmarkDuration;
+
+	/** name of benchmark run in results (-BenchmarkName=) */
+	FString NetBenchmarkName;
+
+	/** time when benchmark race started */
+	float NetBenchmarkStartTime;
+
+	/** time when bytes sent to clients were added up last time */
+	float NetBenchmarkSampleTime;
+
+	/** bytes sent to all clients during benchmark, estimated from connections' send rate */
+	int64 NetBenchmarkEstimatedBytesSent;
+
+	/** how long clients may disagree with server about race state in network test (-ConvergeTimeout=) */
+	float NetTestConvergeTimeout;
+
+	/** time when race of network test was over, 0 while it's running */
+	float NetTestRaceOverTime;
+
+	/** convergence of race digest reported by each client */
+	TMap<TWeakObjectPtr<AVehiclePlayerController>, FVehicleRaceConvergence> RaceConvergences;
+
+	/** is server run by VehicleServerHost commandlet? (-VehicleHosted) */
+	bool bHostedServer;
+
+	/** time when hosted server reported its stats last time */
+	float LastServerStatsTime;
+
+	/** game thread time of frames since last report, in ms */
+	float ServerTickTimeTotal;
+	float ServerTickTimeMax;
+	int32 NumServerTickSamples;
+
+	/** start benchmark race when enough players joined, write results when it's over */
+	void UpdateNetBenchmark(AVehicleGameMode* GameMode);
+
+	/** is benchmark or network test over? */
+	bool IsNetBenchmarkOver(AVehicleGameMode* GameMode, float CurrentTime);
+
+	/** compare race digest reported by client with server's one */
+	void UpdateRaceConvergence(AVehiclePlayerController* VehiclePC, float CurrentTime);
+
+	/** write convergence of race digests reported by clients, returns false if any client failed or nobody finished the race */
+	bool WriteNetTestResults(AVehicleGameMode* GameMode, const FString& Filename, bool bTimedOut) const;
+
+	/** log player count, tick time and memory for VehicleServerHost commandlet */
+	void ReportServerStats(AVehicleGameMode* GameMode);
+};
+
+/**
+ * [client] Bot driving and race digest reports of headless test clients.
+ * Created by player controller only when -VehicleBot or -VehicleNetTest is set.
+ */
+class FVehicleClientTestHarness
+{
+public:
+
+	/** returns NULL unless -VehicleBot or -VehicleNetTest is set */
+	static TSharedPtr<FVehicleClientTestHarness> CreateFromCommandLine();
+
+	/** called every player tick, after input was processed */
+	void Tick(AVehiclePlayerController* VehiclePC, float DeltaTime);
+
+private:
+
+	FVehicleClientTestHarness();
+
+	/** if set, vehicle is driven along track instead of player input (-VehicleBot) */
+	bool bBotMode;
+
+	/** how long bot's vehicle has been stuck */
+	float BotStuckTime;
+
+	/** time when bot reported its stats last time */
+	float LastBotStatsTime;
+
+	/** if set, client reports its race digest to server (-VehicleNetTest) */
+	bool bNetTest;
+
+	/** last digest sent to server */
+	FVehicleRaceDigest LastSentRaceDigest;
+
+	/** time when digest was sent last time */
+	float LastRaceDigestTime;
+
+	/** drive vehicle toward point ahead on track */
+	void UpdateBotInput(AVehiclePlayerController* VehiclePC, float DeltaTime);
+
+	/** log ping, corrections and received bandwidth for bot launcher */
+	void ReportBotStats(AVehiclePlayerController* VehiclePC);
+};
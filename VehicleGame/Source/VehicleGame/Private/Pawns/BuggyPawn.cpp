@@ -1,10 +1,11 @@
 // Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
 
 #include "VehicleGame.h"
+#include "VehicleNetStats.h"
 #include "Particles/ParticleSystemComponent.h"
 
 ABuggyPawn::ABuggyPawn(const FObjectInitializer& ObjectInitializer) : 
-	Super(ObjectInitializer)
+	Super(ObjectInitializer.SetDefaultSubobjectClass<UVehicleMovementComponentBoosted4w>(AWheeledVehicle::VehicleMovementComponentName))
 {
 	/** Camera strategy:
 	 *  We want to keep a constant distance between car's location and camera.
@@ -45,12 +46,22 @@ ABuggyPawn::ABuggyPawn(const FObjectInitializer& ObjectInitializer) :
 	bTiresTouchingGround = false;
 
 	ImpactEffectNormalForceThreshold = 100000.f;
+
+	// body state is replicated by movement component, see UVehicleMovementComponentBoosted4w::VehicleState
+	bReplicateMovement = false;
 }
 
 void ABuggyPawn::PostInitializeComponents()
 {
 	Super::PostInitializeComponents();
 
+	if (GetNetMode() == NM_DedicatedServer)
+	{
+		// nobody will ever look through or listen to this vehicle
+		ReleaseClientOnlyComponents();
+		return;
+	}
+
 	if (EngineAC)
 	{
 		EngineAC->SetSound(EngineSound);
@@ -122,7 +133,10 @@ void ABuggyPawn::Tick(float DeltaSeconds)
 {
 	Super::Tick(DeltaSeconds);
 
-	UpdateWheelEffects(DeltaSeconds);
+	if (GetNetMode() != NM_DedicatedServer)
+	{
+		UpdateWheelEffects(DeltaSeconds);
+	}
 }
 
 
@@ -210,15 +224,6 @@ void ABuggyPawn::UpdateWheelEffects(float DeltaTime)
 	}
 }
 
-void ABuggyPawn::OnTrackPointReached(class AVehicleTrackPoint* NewCheckpoint)
-{
-	AVehiclePlayerController* MyPC = Cast<AVehiclePlayerController>(GetController());
-	if (MyPC)
-	{
-		MyPC->OnTrackPointReached(NewCheckpoint);
-	}
-}
-
 bool ABuggyPawn::IsHandbrakeActive() const
 {
 	return bHandbrakeActive;
@@ -243,12 +248,32 @@ void ABuggyPawn::ReceiveHit(class UPrimitiveComponent* MyComp, class AActor* Oth
 {
 	Super::ReceiveHit(MyComp, Other, OtherComp, bSelfMoved, HitLocation, HitNormal, NormalForce, Hit);
 
-	if (ImpactTemplate && NormalForce.Size() > ImpactEffectNormalForceThreshold)
+	const float DotBetweenHitAndUpRotation = FVector::DotProduct(HitNormal, GetMesh()->GetUpVector());
+	if (NormalForce.Size() > ImpactEffectNormalForceThreshold)
+	{
+		// server tells other clients, their copies of this vehicle don't collide
+		AVehicleGameMode* GameMode = GetWorld()->GetAuthGameMode<AVehicleGameMode>();
+		if (GameMode)
+		{
+			FVehicleGameEvent Event;
+			Event.Type = EVehicleGameEvent::Impact;
+			Event.Actor = this;
+			Event.Location = HitLocation;
+			Event.Normal = HitNormal;
+			Event.SetForce(NormalForce.Size());
+			Event.SurfaceType = UPhysicalMaterial::DetermineSurfaceType(Hit.PhysMaterial.Get());
+			Event.Value = DotBetweenHitAndUpRotation > 0.8f ? 1 : 0;
+			GameMode->AddGameEvent(Event);
+		}
+	}
+
+	// simulated proxies get their impacts from server, so everyone sees the same crash
+	const bool bSpawnLocalEffect = (Role == ROLE_Authority || IsLocallyControlled());
+	if (ImpactTemplate && bSpawnLocalEffect && GetNetMode() != NM_DedicatedServer && NormalForce.Size() > ImpactEffectNormalForceThreshold)
 	{
 		AVehicleImpactEffect* EffectActor = GetWorld()->SpawnActorDeferred<AVehicleImpactEffect>(ImpactTemplate, HitLocation, HitNormal.Rotation());
 		if (EffectActor)
 		{
-			float DotBetweenHitAndUpRotation = FVector::DotProduct(HitNormal, GetMesh()->GetUpVector());
 			EffectActor->HitSurface = Hit;
 			EffectActor->HitForce = NormalForce;
 			EffectActor->bWheelLand = DotBetweenHitAndUpRotation > 0.8;
@@ -266,6 +291,24 @@ void ABuggyPawn::ReceiveHit(class UPrimitiveComponent* MyComp, class AActor* Oth
 	}
 }
 
+void ABuggyPawn::SpawnImpactEffect(const FVehicleGameEvent& Event)
+{
+	if (ImpactTemplate && GetNetMode() != NM_DedicatedServer)
+	{
+		const FRotator Rotation = Event.Normal.Rotation();
+		AVehicleImpactEffect* EffectActor = GetWorld()->SpawnActorDeferred<AVehicleImpactEffect>(ImpactTemplate, Event.Location, Rotation);
+		if (EffectActor)
+		{
+			EffectActor->HitSurface.ImpactPoint = Event.Location;
+			EffectActor->HitSurface.ImpactNormal = Event.Normal;
+			EffectActor->SurfaceType = (EPhysicalSurface)Event.SurfaceType;
+			EffectActor->HitForce = Event.Normal * Event.GetForce();
+			EffectActor->bWheelLand = Event.Value != 0;
+			UGameplayStatics::FinishSpawningActor(EffectActor, FTransform(Rotation, Event.Location));
+		}
+	}
+}
+
 float ABuggyPawn::TakeDamage(float Damage, struct FDamageEvent const& DamageEvent, class AController* EventInstigator, class AActor* DamageCauser)
 {
 	if (Cast<APainCausingVolume>(DamageCauser) != NULL)
@@ -282,6 +325,45 @@ void ABuggyPawn::FellOutOfWorld(const class UDamageType& dmgType)
 	Die();
 }
 
+void ABuggyPawn::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	FVehicleNetStats::FScopedReplicationTimer ReplicationTimer(GetClass());
+
+	Super::PreReplication(ChangedPropertyTracker);
+
+	// movement is replicated as quantized vehicle state instead of ReplicatedMovement
+	UVehicleMovementComponentBoosted4w* BoostedMovement = Cast<UVehicleMovementComponentBoosted4w>(GetVehicleMovement());
+	if (BoostedMovement && !bTearOff)
+	{
+		BoostedMovement->UpdateReplicatedVehicleState();
+	}
+}
+
+bool ABuggyPawn::IsNetRelevantFor(const APlayerController* RealViewer, const AActor* Viewer, const FVector& SrcLocation) const
+{
+	// racers care about cars near them on the racing line, not in straight distance
+	UVehicleMovementComponentBoosted4w* BoostedMovement = Cast<UVehicleMovementComponentBoosted4w>(GetVehicleMovement());
+	bool bRelevant = false;
+	if (!bAlwaysRelevant && !IsOwnedBy(Viewer) && BoostedMovement && BoostedMovement->GetTrackNetRelevancy(RealViewer, SrcLocation, bRelevant))
+	{
+		return bRelevant;
+	}
+
+	return Super::IsNetRelevantFor(RealViewer, Viewer, SrcLocation);
+}
+
+float ABuggyPawn::GetNetPriority(const FVector& ViewPos, const FVector& ViewDir, APlayerController* Viewer, UActorChannel* InChannel, float Time, bool bLowBandwidth)
+{
+	UVehicleMovementComponentBoosted4w* BoostedMovement = Cast<UVehicleMovementComponentBoosted4w>(GetVehicleMovement());
+	float PriorityScale = 1.0f;
+	if (!IsOwnedBy(Viewer) && BoostedMovement && BoostedMovement->GetTrackNetPriorityScale(Viewer, PriorityScale))
+	{
+		return Time * NetPriority * PriorityScale;
+	}
+
+	return Super::GetNetPriority(ViewPos, ViewDir, Viewer, InChannel, Time, bLowBandwidth);
+}
+
 bool ABuggyPawn::CanDie() const
 {
 	if ( bIsDying										// already dying
@@ -322,6 +404,11 @@ void ABuggyPawn::TornOff()
 void ABuggyPawn::OnDeath()
 {
 	AVehiclePlayerController* MyPC = Cast<AVehiclePlayerController>(GetController());
+	if (MyPC)
+	{
+		MyPC->OnVehicleDied();
+	}
+
 	bReplicateMovement = false;
 	bTearOff = true;
 	bIsDying = true;
@@ -349,6 +436,11 @@ void ABuggyPawn::OnDeath()
 
 void ABuggyPawn::PlayDestructionFX()
 {
+	if (GetNetMode() == NM_DedicatedServer)
+	{
+		return;
+	}
+
 	if (DeathFX)
 	{
 		UGameplayStatics::SpawnEmitterAtLocation(this, DeathFX, GetActorLocation(), GetActorRotation());
@@ -360,6 +452,24 @@ void ABuggyPawn::PlayDestructionFX()
 	}
 }
 
+void ABuggyPawn::ReleaseClientOnlyComponents()
+{
+	// camera goes first, so it won't get reattached when its spring arm is destroyed
+	UActorComponent* ClientOnlyComponents[] = { Camera, SpringArm, EngineAC, SkidAC };
+	for (int32 i = 0; i < ARRAY_COUNT(ClientOnlyComponents); i++)
+	{
+		if (ClientOnlyComponents[i] != NULL)
+		{
+			ClientOnlyComponents[i]->DestroyComponent();
+		}
+	}
+
+	Camera = NULL;
+	SpringArm = NULL;
+	EngineAC = NULL;
+	SkidAC = NULL;
+}
+
 void ABuggyPawn::GetLifetimeReplicatedProps(TArray< FLifetimeProperty > & OutLifetimeProps) const
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
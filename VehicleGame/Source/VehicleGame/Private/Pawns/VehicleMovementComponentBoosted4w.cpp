@@ -1,8 +1,834 @@
 // Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
 
 #include "VehicleGame.h"
+#include "VehicleNetStats.h"
 
 UVehicleMovementComponentBoosted4w::UVehicleMovementComponentBoosted4w(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
+	bEnablePrediction = true;
+	MaxPositionError = 50.0f;
+	MaxRotationError = 5.0f;
+	SnapPositionError = 500.0f;
+	CorrectionBlendAlpha = 0.3f;
+	ServerAckInterval = 0.05f;
+	InputBatchInterval = 1.0f / 30.0f;
+	MaxInputFramesPerBatch = 8;
+	MaxQueuedInputFrames = 30;
+	NetRelevantTrackDistance = 50000.0f;
+	NetRelevantMinDistance = 3000.0f;
+	NetPriorityTrackDistance = 5000.0f;
+	MinNetUpdateFrequency = 2.0f;
+	MaxNetUpdateFrequency = 60.0f;
+	HighActivityAcceleration = 2000.0f;
+	HighActivityAngularSpeed = 180.0f;
+	HighActivitySpeed = 4000.0f;
+	HighActivitySlipThreshold = 0.3f;
+	NetUpdateFrequencyCooldown = 1.0f;
+	NetUpdateFrequencyDecayRate = 30.0f;
+	MaxLagCompensation = 0.25f;
+	bKinematicSimulatedProxies = true;
+	MinInterpolationDelay = 0.1f;
+	MaxInterpolationDelay = 0.5f;
+	MaxExtrapolationTime = 0.25f;
+	MaxSavedMoves = 96;
+
+	InputSequence = 0;
+	LastInputBatchTime = 0.0f;
+	NumUnsentInputFrames = 0;
+	LastReceivedInputSequence = 0;
+	bReceivedInput = false;
+	CurrentInputTimeLeft = 0.0f;
+
+	LastClientMoveTimeStamp = 0.0f;
+	LastClientMoveReceiveTime = 0.0f;
+	LastServerAckTime = 0.0f;
+	NumCorrections = 0;
+	InterpolationDelay = MinInterpolationDelay;
+	bKinematicProxyActive = false;
+
+	DesiredNetUpdateFrequency = MaxNetUpdateFrequency;
+	LastActivityVelocity = FVector::ZeroVector;
+	CalmActivityTime = 0.0f;
+	CachedTrackPositionTime = -1.0f;
+	TrackOrigin = FVector::ZeroVector;
+	bTrackOriginValid = false;
+}
+
+void UVehicleMovementComponentBoosted4w::GetLifetimeReplicatedProps(TArray< FLifetimeProperty > & OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	// predicting owner is corrected by state acks, others need the state. Registered once per class, so class default decides
+	if (bEnablePrediction)
+	{
+		DOREPLIFETIME_CONDITION(UVehicleMovementComponentBoosted4w, VehicleState, COND_SkipOwner);
+	}
+	else
+	{
+		DOREPLIFETIME(UVehicleMovementComponentBoosted4w, VehicleState);
+	}
+}
+
+void UVehicleMovementComponentBoosted4w::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction *ThisTickFunction)
+{
+	// kinematic proxy is placed from snapshots, input and state update of wheeled vehicle would only fight them
+	if (IsKinematicProxy())
+	{
+		UPawnMovementComponent::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	}
+	else
+	{
+		Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	}
+
+	if (PawnOwner && PawnOwner->Role == ROLE_Authority)
+	{
+		FVector Location, LinearVelocity, AngularVelocity;
+		FQuat Rotation;
+		GetBodyState(Location, Rotation, LinearVelocity, AngularVelocity);
+		AVehicleGameMode* GameMode = GetWorld()->GetAuthGameMode<AVehicleGameMode>();
+		StateHistory.AddSample(GameMode ? GameMode->GetServerClock() : GetWorld()->GetTimeSeconds(), Location, Rotation, LinearVelocity);
+
+		if (GetNetMode() != NM_Standalone)
+		{
+			UpdateDesiredNetUpdateFrequency(DeltaTime);
+		}
+	}
+
+	if (bEnablePrediction && PawnOwner && PawnOwner->Role == ROLE_Authority && !PawnOwner->IsLocallyControlled() &&
+		LastClientMoveReceiveTime > 0.0f && GetWorld()->GetTimeSeconds() - LastServerAckTime >= ServerAckInterval)
+	{
+		SendStateAck();
+	}
+
+	if (IsKinematicProxy())
+	{
+		UpdateKinematicProxy(DeltaTime);
+	}
+	else if (bKinematicProxyActive)
+	{
+		StopKinematicProxy();
+	}
+}
+
+bool UVehicleMovementComponentBoosted4w::IsPredictingLocally() const
+{
+	return bEnablePrediction && PawnOwner && PawnOwner->Role < ROLE_Authority && PawnOwner->IsLocallyControlled();
+}
+
+bool UVehicleMovementComponentBoosted4w::IsKinematicProxy() const
+{
+	return bKinematicSimulatedProxies && PawnOwner && PawnOwner->Role == ROLE_SimulatedProxy;
+}
+
+void UVehicleMovementComponentBoosted4w::UpdateKinematicProxy(float DeltaTime)
+{
+	UPrimitiveComponent* UpdatedPrimitive = Cast<UPrimitiveComponent>(UpdatedComponent);
+	AVehicleGameState* GameState = GetWorld()->GetGameState<AVehicleGameState>();
+	if (UpdatedPrimitive == NULL || GameState == NULL)
+	{
+		return;
+	}
+
+	if (!bKinematicProxyActive)
+	{
+		UpdatedPrimitive->SetSimulatePhysics(false);
+		bKinematicProxyActive = true;
+	}
+
+	// two snapshot intervals behind server cover one late or lost state
+	const float TargetDelay = FMath::Clamp(SnapshotBuffer.GetAverageInterval() * 2.0f, MinInterpolationDelay, MaxInterpolationDelay);
+
+	// and it changes slowly, jumps of render time would show as stutter
+	InterpolationDelay = FMath::FInterpTo(InterpolationDelay, TargetDelay, DeltaTime, 2.0f);
+
+	FVector Location, LinearVelocity;
+	FQuat Rotation;
+	if (SnapshotBuffer.Sample(GameState->GetServerWorldTime() - InterpolationDelay, MaxExtrapolationTime, Location, Rotation, LinearVelocity))
+	{
+		UpdatedPrimitive->SetWorldLocationAndRotation(Location, Rotation);
+		UpdatedPrimitive->ComponentVelocity = LinearVelocity;
+	}
+
+	// wheels are still posed by vehicle simulation, steer them as far as server's wheels are
+	for (int32 i = 0; i < FMath::Min(Wheels.Num(), VEHICLE_REPLICATED_WHEELS); i++)
+	{
+		if (Wheels[i] && Wheels[i]->SteerAngle > 0.0f)
+		{
+			SteeringInput = FMath::Clamp(VehicleState.State.GetWheelSteerAngle(i) / Wheels[i]->SteerAngle, -1.0f, 1.0f);
+			break;
+		}
+	}
+}
+
+void UVehicleMovementComponentBoosted4w::StopKinematicProxy()
+{
+	UPrimitiveComponent* UpdatedPrimitive = Cast<UPrimitiveComponent>(UpdatedComponent);
+	if (UpdatedPrimitive)
+	{
+		UpdatedPrimitive->SetSimulatePhysics(true);
+		UpdatedPrimitive->SetPhysicsLinearVelocity(UpdatedPrimitive->ComponentVelocity);
+	}
+
+	SnapshotBuffer.Reset();
+	bKinematicProxyActive = false;
+}
+
+int32 UVehicleMovementComponentBoosted4w::GetNumCorrections() const
+{
+	return NumCorrections;
+}
+
+const FVehicleStateHistory& UVehicleMovementComponentBoosted4w::GetStateHistory() const
+{
+	return StateHistory;
+}
+
+float UVehicleMovementComponentBoosted4w::GetLagCompensationTime() const
+{
+	// predicting client is half a round trip ahead: its inputs need that long to reach server
+	APlayerState* OwnerPlayerState = PawnOwner ? PawnOwner->PlayerState : NULL;
+	if (OwnerPlayerState == NULL || PawnOwner->IsLocallyControlled())
+	{
+		return 0.0f;
+	}
+
+	const float RoundTrip = OwnerPlayerState->Ping * 4.0f * 0.001f;
+	return FMath::Clamp(RoundTrip * 0.5f, 0.0f, MaxLagCompensation);
+}
+
+float UVehicleMovementComponentBoosted4w::GetDesiredNetUpdateFrequency() const
+{
+	return DesiredNetUpdateFrequency;
+}
+
+void UVehicleMovementComponentBoosted4w::UpdateDesiredNetUpdateFrequency(float DeltaTime)
+{
+	FVector Location, LinearVelocity, AngularVelocity;
+	FQuat Rotation;
+	GetBodyState(Location, Rotation, LinearVelocity, AngularVelocity);
+
+	const float Acceleration = (DeltaTime > 0.0f) ? (LinearVelocity - LastActivityVelocity).Size() / DeltaTime : 0.0f;
+	LastActivityVelocity = LinearVelocity;
+
+	// steady driving is easy to extrapolate, sudden changes are not
+	float Activity = 0.5f * FMath::Min(LinearVelocity.Size() / HighActivitySpeed, 1.0f);
+	Activity = FMath::Max(Activity, Acceleration / HighActivityAcceleration);
+	Activity = FMath::Max(Activity, AngularVelocity.Size() / HighActivityAngularSpeed);
+	if (CheckSlipThreshold(HighActivitySlipThreshold, HighActivitySlipThreshold))
+	{
+		Activity = 1.0f;
+	}
+
+	const float TargetFrequency = FMath::Lerp(MinNetUpdateFrequency, MaxNetUpdateFrequency, FMath::Min(Activity, 1.0f));
+	if (TargetFrequency >= DesiredNetUpdateFrequency)
+	{
+		// react to crashes at once
+		if (TargetFrequency > DesiredNetUpdateFrequency * 2.0f && PawnOwner)
+		{
+			PawnOwner->ForceNetUpdate();
+		}
+
+		DesiredNetUpdateFrequency = TargetFrequency;
+		CalmActivityTime = 0.0f;
+	}
+	else
+	{
+		// but wait a moment before dropping, so bumpy driving doesn't flip between rates
+		CalmActivityTime += DeltaTime;
+		if (CalmActivityTime >= NetUpdateFrequencyCooldown)
+		{
+			DesiredNetUpdateFrequency = FMath::Max(TargetFrequency, DesiredNetUpdateFrequency - NetUpdateFrequencyDecayRate * DeltaTime);
+		}
+	}
 }
 
+const FVehicleInputStats& UVehicleMovementComponentBoosted4w::GetInputStats() const
+{
+	return InputStats;
+}
+
+void UVehicleMovementComponentBoosted4w::UpdateReplicatedVehicleState()
+{
+	UPrimitiveComponent* UpdatedPrimitive = Cast<UPrimitiveComponent>(UpdatedComponent);
+	FRigidBodyState RBState;
+	if (UpdatedPrimitive == NULL || !UpdatedPrimitive->GetRigidBodyState(RBState))
+	{
+		return;
+	}
+
+	float WheelSteering[VEHICLE_REPLICATED_WHEELS] = { 0.0f };
+	for (int32 i = 0; i < FMath::Min(Wheels.Num(), VEHICLE_REPLICATED_WHEELS); i++)
+	{
+		if (Wheels[i])
+		{
+			WheelSteering[i] = Wheels[i]->GetSteerAngle();
+		}
+	}
+
+	// NetDeltaSerialize skips connections whose last sent state is the same
+	VehicleState.StatsClass = PawnOwner ? PawnOwner->GetClass() : NULL;
+	VehicleState.State.FromRigidBodyState(RBState, GetTrackOrigin(), WheelSteering);
+	VehicleState.ServerTime = GetWorld()->GetTimeSeconds();
+}
+
+const FVehicleQuantizedState& UVehicleMovementComponentBoosted4w::GetReplicatedVehicleState() const
+{
+	return VehicleState.State;
+}
+
+void UVehicleMovementComponentBoosted4w::ApplyRaceSnapshot(const FVehicleQuantizedState& State, float ServerTime)
+{
+	// gives snapshot buffer something to interpolate from before second replicated state arrives
+	if (IsKinematicProxy())
+	{
+		FRigidBodyState SnapshotState;
+		State.ToRigidBodyState(GetTrackOrigin(), SnapshotState);
+		SnapshotBuffer.AddSnapshot(ServerTime, SnapshotState.Position, SnapshotState.Quaternion, SnapshotState.LinVel);
+	}
+}
+
+bool UVehicleMovementComponentBoosted4w::GetTrackPosition(FVehicleTrackPosition& OutPosition) const
+{
+	UWorld* World = GetWorld();
+	AVehicleGameState* GameState = World ? World->GetGameState<AVehicleGameState>() : NULL;
+	if (GameState == NULL || UpdatedComponent == NULL || !GameState->GetTrackLayout().IsValid())
+	{
+		return false;
+	}
+
+	// asked for every connection, but vehicle moves only once per frame
+	if (CachedTrackPositionTime != World->GetTimeSeconds())
+	{
+		CachedTrackPosition = GameState->GetTrackLayout().GetTrackPosition(UpdatedComponent->GetComponentLocation());
+		CachedTrackPositionTime = World->GetTimeSeconds();
+	}
+
+	OutPosition = CachedTrackPosition;
+	return true;
+}
+
+bool UVehicleMovementComponentBoosted4w::GetTrackDistance(float& OutDistance) const
+{
+	FVehicleTrackPosition TrackPosition;
+	if (!GetTrackPosition(TrackPosition))
+	{
+		return false;
+	}
+
+	OutDistance = TrackPosition.Distance;
+	return true;
+}
+
+bool UVehicleMovementComponentBoosted4w::GetTrackGapFrom(const APlayerController* Viewer, float& OutGap) const
+{
+	AWheeledVehicle* ViewerVehicle = Viewer ? Cast<AWheeledVehicle>(Viewer->GetPawn()) : NULL;
+	UVehicleMovementComponentBoosted4w* ViewerMovement = ViewerVehicle ? Cast<UVehicleMovementComponentBoosted4w>(ViewerVehicle->GetVehicleMovement()) : NULL;
+
+	float ViewerDistance = 0.0f;
+	float MyDistance = 0.0f;
+	if (ViewerMovement == NULL || !ViewerMovement->GetTrackDistance(ViewerDistance) || !GetTrackDistance(MyDistance))
+	{
+		return false;
+	}
+
+	AVehicleGameState* GameState = GetWorld()->GetGameState<AVehicleGameState>();
+	OutGap = GameState->GetTrackLayout().GetTrackGap(ViewerDistance, MyDistance);
+	return true;
+}
+
+bool UVehicleMovementComponentBoosted4w::GetTrackNetRelevancy(const APlayerController* RealViewer, const FVector& SrcLocation, bool& bOutRelevant) const
+{
+	float TrackGap = 0.0f;
+	if (!GetTrackGapFrom(RealViewer, TrackGap))
+	{
+		return false;
+	}
+
+	bOutRelevant = FMath::Abs(TrackGap) <= NetRelevantTrackDistance ||
+		FVector::DistSquared(SrcLocation, UpdatedComponent->GetComponentLocation()) <= FMath::Square(NetRelevantMinDistance);
+	return true;
+}
+
+bool UVehicleMovementComponentBoosted4w::GetTrackNetPriorityScale(const APlayerController* Viewer, float& OutScale) const
+{
+	float TrackGap = 0.0f;
+	if (!GetTrackGapFrom(Viewer, TrackGap))
+	{
+		return false;
+	}
+
+	// 2 when side by side, 1 at NetPriorityTrackDistance, falling off slowly behind that
+	OutScale = 2.0f * NetPriorityTrackDistance / (NetPriorityTrackDistance + FMath::Abs(TrackGap));
+	return true;
+}
+
+void UVehicleMovementComponentBoosted4w::OnRep_VehicleState()
+{
+	// owning client reconciles its predicted movement with acks from server instead
+	UPrimitiveComponent* UpdatedPrimitive = Cast<UPrimitiveComponent>(UpdatedComponent);
+	if (IsPredictingLocally() || UpdatedPrimitive == NULL)
+	{
+		return;
+	}
+
+	FRigidBodyState NewState;
+	VehicleState.State.ToRigidBodyState(GetTrackOrigin(), NewState);
+
+	if (IsKinematicProxy())
+	{
+		SnapshotBuffer.AddSnapshot(VehicleState.ServerTime, NewState.Position, NewState.Quaternion, NewState.LinVel);
+		return;
+	}
+
+	FVector DeltaPos(FVector::ZeroVector);
+	UpdatedPrimitive->ConditionalApplyRigidBodyState(NewState, GEngine->PhysicErrorCorrection, DeltaPos);
+}
+
+const FVector& UVehicleMovementComponentBoosted4w::GetTrackOrigin()
+{
+	if (!bTrackOriginValid && GetWorld())
+	{
+		// track points are placed in level, so server and clients find the same origin
+		FVector Sum = FVector::ZeroVector;
+		int32 NumPoints = 0;
+		for (TActorIterator<AVehicleTrackPoint> It(GetWorld()); It; ++It)
+		{
+			Sum += It->GetActorLocation();
+			NumPoints++;
+		}
+
+		if (NumPoints > 0)
+		{
+			TrackOrigin = (Sum / NumPoints).GridSnap(100.0f);
+		}
+		bTrackOriginValid = true;
+	}
+
+	return TrackOrigin;
+}
+
+void UVehicleMovementComponentBoosted4w::UpdateState(float DeltaTime)
+{
+	if (!IsPredictingLocally())
+	{
+		if (bEnablePrediction && bReceivedInput && PawnOwner && PawnOwner->Role == ROLE_Authority && !PawnOwner->IsLocallyControlled())
+		{
+			ConsumeQueuedInput(DeltaTime);
+		}
+
+		Super::UpdateState(DeltaTime);
+		return;
+	}
+
+	// same input smoothing as base class, but inputs are sent with time stamp, so server can acknowledge them
+	SteeringInput = SteeringInputRate.InterpInputValue(DeltaTime, SteeringInput, CalcSteeringInput());
+	ThrottleInput = ThrottleInputRate.InterpInputValue(DeltaTime, ThrottleInput, CalcThrottleInput());
+	BrakeInput = BrakeInputRate.InterpInputValue(DeltaTime, BrakeInput, CalcBrakeInput());
+	HandbrakeInput = HandbrakeInputRate.InterpInputValue(DeltaTime, HandbrakeInput, CalcHandbrakeInput());
+
+	// simulate quantized inputs, server will get exactly the same ones
+	FVehicleInputFrame Frame;
+	Frame.SetInputs(SteeringInput, ThrottleInput, BrakeInput, HandbrakeInput, DeltaTime);
+	SteeringInput = Frame.GetSteeringInput();
+	ThrottleInput = Frame.GetThrottleInput();
+	BrakeInput = Frame.GetBrakeInput();
+	HandbrakeInput = Frame.GetHandbrakeInput();
+
+	const int32 MaxFrames = FMath::Clamp(MaxInputFramesPerBatch, 1, FVehicleInputBatch::MaxFrames);
+	if (RecentInputFrames.Num() >= MaxFrames)
+	{
+		RecentInputFrames.RemoveAt(0, RecentInputFrames.Num() - MaxFrames + 1, false);
+	}
+	RecentInputFrames.Add(Frame);
+	InputSequence++;
+	NumUnsentInputFrames++;
+
+	const float TimeStamp = GetWorld()->GetTimeSeconds();
+	SaveMove(TimeStamp);
+
+	// don't wait for next batch if oldest unsent frame would be dropped
+	if (TimeStamp - LastInputBatchTime >= InputBatchInterval || NumUnsentInputFrames >= MaxFrames)
+	{
+		SendInputBatch(TimeStamp);
+	}
+}
+
+void UVehicleMovementComponentBoosted4w::SendInputBatch(float TimeStamp)
+{
+	FVehicleInputBatch Batch;
+	Batch.TimeStamp = TimeStamp;
+	Batch.Sequence = InputSequence;
+	Batch.CurrentGear = (int8)FMath::Clamp(GetCurrentGear(), -128, 127);
+	Batch.Frames.Append(RecentInputFrames);
+
+	ServerMoveInputBatch(Batch);
+
+	LastInputBatchTime = TimeStamp;
+	NumUnsentInputFrames = 0;
+}
+
+void UVehicleMovementComponentBoosted4w::SaveMove(float TimeStamp)
+{
+	if (SavedMoves.Num() >= MaxSavedMoves)
+	{
+		// server stopped answering, oldest moves are useless anyway
+		SavedMoves.RemoveAt(0, SavedMoves.Num() - MaxSavedMoves + 1, false);
+	}
+
+	FVehicleSavedMove& Move = SavedMoves[SavedMoves.AddUninitialized()];
+	Move.TimeStamp = TimeStamp;
+	Move.SteeringInput = SteeringInput;
+	Move.ThrottleInput = ThrottleInput;
+	Move.BrakeInput = BrakeInput;
+	Move.HandbrakeInput = HandbrakeInput;
+	GetBodyState(Move.Location, Move.Rotation, Move.LinearVelocity, Move.AngularVelocity);
+}
+
+bool UVehicleMovementComponentBoosted4w::ServerMoveInputBatch_Validate(const FVehicleInputBatch& Batch)
+{
+	if (Batch.Frames.Num() == 0 || Batch.Frames.Num() > FVehicleInputBatch::MaxFrames)
+	{
+		return false;
+	}
+
+	for (int32 i = 0; i < Batch.Frames.Num(); i++)
+	{
+		if (Batch.Frames[i].Steering < -127 || Batch.Frames[i].Throttle < -127)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void UVehicleMovementComponentBoosted4w::ServerMoveInputBatch_Implementation(const FVehicleInputBatch& Batch)
+{
+	FVehicleNetStats::AddRpcReceived(PawnOwner ? PawnOwner->GetClass() : NULL, Batch.NumReceivedBits);
+
+	// unreliable, so older batches can arrive after newer ones
+	const int32 NumNewFrames = (int16)(Batch.Sequence - LastReceivedInputSequence);
+	if (bReceivedInput && NumNewFrames <= 0)
+	{
+		InputStats.NumLateBatches++;
+		return;
+	}
+
+	int32 FirstNewFrame = 0;
+	if (bReceivedInput)
+	{
+		if (NumNewFrames > Batch.Frames.Num())
+		{
+			InputStats.NumLostFrames += NumNewFrames - Batch.Frames.Num();
+		}
+		FirstNewFrame = FMath::Max(0, Batch.Frames.Num() - NumNewFrames);
+	}
+
+	bReceivedInput = true;
+	LastReceivedInputSequence = Batch.Sequence;
+	InputStats.NumReceivedFrames += Batch.Frames.Num() - FirstNewFrame;
+
+	// only newest frame has time stamp, older ones are found from frame lengths
+	float FrameTimeStamp = Batch.TimeStamp;
+	for (int32 i = Batch.Frames.Num() - 1; i > FirstNewFrame; i--)
+	{
+		FrameTimeStamp -= Batch.Frames[i].GetDeltaTime();
+	}
+
+	for (int32 i = FirstNewFrame; i < Batch.Frames.Num(); i++)
+	{
+		FVehicleQueuedInput& QueuedInput = QueuedInputs[QueuedInputs.AddUninitialized()];
+		QueuedInput.Frame = Batch.Frames[i];
+		QueuedInput.TimeStamp = FrameTimeStamp;
+
+		if (i + 1 < Batch.Frames.Num())
+		{
+			FrameTimeStamp += Batch.Frames[i + 1].GetDeltaTime();
+		}
+	}
+
+	if (QueuedInputs.Num() > MaxQueuedInputFrames)
+	{
+		const int32 NumSkipped = QueuedInputs.Num() - MaxQueuedInputFrames;
+		QueuedInputs.RemoveAt(0, NumSkipped, false);
+		InputStats.NumSkippedFrames += NumSkipped;
+	}
+
+	ReplicatedState.CurrentGear = Batch.CurrentGear;
+}
+
+void UVehicleMovementComponentBoosted4w::ConsumeQueuedInput(float DeltaTime)
+{
+	// frames are simulated for as long as client simulated them
+	while (CurrentInputTimeLeft <= 0.0f && QueuedInputs.Num() > 0)
+	{
+		const FVehicleQueuedInput& QueuedInput = QueuedInputs[0];
+
+		// UpdateState reads inputs of remotely controlled vehicles from replicated state
+		ReplicatedState.SteeringInput = QueuedInput.Frame.GetSteeringInput();
+		ReplicatedState.ThrottleInput = QueuedInput.Frame.GetThrottleInput();
+		ReplicatedState.BrakeInput = QueuedInput.Frame.GetBrakeInput();
+		ReplicatedState.HandbrakeInput = QueuedInput.Frame.GetHandbrakeInput();
+
+		CurrentInputTimeLeft += QueuedInput.Frame.GetDeltaTime();
+		LastClientMoveTimeStamp = QueuedInput.TimeStamp;
+		LastClientMoveReceiveTime = GetWorld()->GetTimeSeconds();
+
+		QueuedInputs.RemoveAt(0, 1, false);
+	}
+
+	if (CurrentInputTimeLeft <= 0.0f)
+	{
+		// nothing new arrived in time, keep using last inputs
+		InputStats.NumStarvedUpdates++;
+		CurrentInputTimeLeft = 0.0f;
+	}
+
+	CurrentInputTimeLeft -= DeltaTime;
+}
+
+void UVehicleMovementComponentBoosted4w::SendStateAck()
+{
+	const float CurrentTime = GetWorld()->GetTimeSeconds();
+	LastServerAckTime = CurrentTime;
+
+	FVector Location, LinearVelocity, AngularVelocity;
+	FQuat Rotation;
+	GetBodyState(Location, Rotation, LinearVelocity, AngularVelocity);
+
+	// state is reported in client's time: last move's time stamp plus time spent simulating it on server
+	const float ClientTimeStamp = LastClientMoveTimeStamp + (CurrentTime - LastClientMoveReceiveTime);
+	ClientAckVehicleState(ClientTimeStamp, Location, Rotation.Rotator(), LinearVelocity, AngularVelocity);
+
+	// parameters are serialized by engine, their bytes are part of estimated engine overhead
+	FVehicleNetStats::AddRpcSent(PawnOwner ? PawnOwner->GetClass() : NULL, 0);
+}
+
+void UVehicleMovementComponentBoosted4w::ClientAckVehicleState_Implementation(float TimeStamp, FVector_NetQuantize100 InLocation, FRotator InRotation, FVector_NetQuantize10 InLinearVelocity, FVector_NetQuantize10 InAngularVelocity)
+{
+	FVehicleSavedMove Predicted;
+	if (!IsPredictingLocally() || !GetPredictedState(TimeStamp, Predicted))
+	{
+		return;
+	}
+
+	// keep one move older than ack, so next ack can still be interpolated
+	int32 NumAckedMoves = 0;
+	while (NumAckedMoves + 1 < SavedMoves.Num() && SavedMoves[NumAckedMoves + 1].TimeStamp <= TimeStamp)
+	{
+		NumAckedMoves++;
+	}
+	SavedMoves.RemoveAt(0, NumAckedMoves, false);
+
+	const FQuat ServerRotation = InRotation.Quaternion();
+	const FVector LocationError = InLocation - Predicted.Location;
+	const float RotationError = FMath::RadiansToDegrees(2.0f * FMath::Acos(FMath::Min(FMath::Abs(ServerRotation | Predicted.Rotation), 1.0f)));
+	if (LocationError.SizeSquared() <= FMath::Square(MaxPositionError) && RotationError <= MaxRotationError)
+	{
+		return;
+	}
+
+	NumCorrections++;
+
+	const float Alpha = (LocationError.SizeSquared() > FMath::Square(SnapPositionError)) ? 1.0f : CorrectionBlendAlpha;
+	const FQuat FullRotationError = ServerRotation * Predicted.Rotation.Inverse();
+	ApplyCorrection(LocationError * Alpha,
+		FQuat::Slerp(FQuat::Identity, FullRotationError, Alpha),
+		(InLinearVelocity - Predicted.LinearVelocity) * Alpha,
+		(InAngularVelocity - Predicted.AngularVelocity) * Alpha);
+}
+
+bool UVehicleMovementComponentBoosted4w::GetPredictedState(float TimeStamp, FVehicleSavedMove& OutMove) const
+{
+	if (SavedMoves.Num() == 0 || TimeStamp < SavedMoves[0].TimeStamp)
+	{
+		return false;
+	}
+
+	for (int32 i = 1; i < SavedMoves.Num(); i++)
+	{
+		const FVehicleSavedMove& PrevMove = SavedMoves[i - 1];
+		const FVehicleSavedMove& NextMove = SavedMoves[i];
+		if (NextMove.TimeStamp >= TimeStamp)
+		{
+			const float Alpha = (NextMove.TimeStamp > PrevMove.TimeStamp) ? (TimeStamp - PrevMove.TimeStamp) / (NextMove.TimeStamp - PrevMove.TimeStamp) : 1.0f;
+			OutMove = PrevMove;
+			OutMove.TimeStamp = TimeStamp;
+			OutMove.Location = FMath::Lerp(PrevMove.Location, NextMove.Location, Alpha);
+			OutMove.Rotation = FQuat::Slerp(PrevMove.Rotation, NextMove.Rotation, Alpha);
+			OutMove.LinearVelocity = FMath::Lerp(PrevMove.LinearVelocity, NextMove.LinearVelocity, Alpha);
+			OutMove.AngularVelocity = FMath::Lerp(PrevMove.AngularVelocity, NextMove.AngularVelocity, Alpha);
+			return true;
+		}
+	}
+
+	// ack is newer than last move, compare with current state
+	OutMove = SavedMoves.Last();
+	OutMove.TimeStamp = TimeStamp;
+	GetBodyState(OutMove.Location, OutMove.Rotation, OutMove.LinearVelocity, OutMove.AngularVelocity);
+	return true;
+}
+
+void UVehicleMovementComponentBoosted4w::ApplyCorrection(const FVector& LocationError, const FQuat& RotationError, const FVector& LinearVelocityError, const FVector& AngularVelocityError)
+{
+	UPrimitiveComponent* UpdatedPrimitive = Cast<UPrimitiveComponent>(UpdatedComponent);
+	FBodyInstance* BodyInstance = UpdatedPrimitive ? UpdatedPrimitive->GetBodyInstance() : NULL;
+	if (BodyInstance == NULL)
+	{
+		return;
+	}
+
+	// PhysX vehicles can't be stepped individually, so instead of rewinding and replaying saved moves
+	// the error found at acked move is carried over to current state. Moves made since then keep their relative effect.
+	FVector Location, LinearVelocity, AngularVelocity;
+	FQuat Rotation;
+	GetBodyState(Location, Rotation, LinearVelocity, AngularVelocity);
+
+	BodyInstance->SetBodyTransform(FTransform(RotationError * Rotation, Location + LocationError), true);
+	UpdatedPrimitive->SetPhysicsLinearVelocity(LinearVelocity + LinearVelocityError);
+	UpdatedPrimitive->SetPhysicsAngularVelocity(AngularVelocity + AngularVelocityError);
+
+	// remaining moves are predicted from corrected state now
+	for (int32 i = 0; i < SavedMoves.Num(); i++)
+	{
+		FVehicleSavedMove& Move = SavedMoves[i];
+		Move.Location += LocationError;
+		Move.Rotation = RotationError * Move.Rotation;
+		Move.LinearVelocity += LinearVelocityError;
+		Move.AngularVelocity += AngularVelocityError;
+	}
+}
+
+void UVehicleMovementComponentBoosted4w::GetBodyState(FVector& OutLocation, FQuat& OutRotation, FVector& OutLinearVelocity, FVector& OutAngularVelocity) const
+{
+	UPrimitiveComponent* UpdatedPrimitive = Cast<UPrimitiveComponent>(UpdatedComponent);
+	if (UpdatedPrimitive)
+	{
+		OutLocation = UpdatedPrimitive->GetComponentLocation();
+		OutRotation = UpdatedPrimitive->GetComponentQuat();
+		OutLinearVelocity = UpdatedPrimitive->GetPhysicsLinearVelocity();
+		OutAngularVelocity = UpdatedPrimitive->GetPhysicsAngularVelocity();
+	}
+	else
+	{
+		OutLocation = FVector::ZeroVector;
+		OutRotation = FQuat::Identity;
+		OutLinearVelocity = FVector::ZeroVector;
+		OutAngularVelocity = FVector::ZeroVector;
+	}
+}
+
+void FVehicleStateHistory::AddSample(double Time, const FVector& Location, const FQuat& Rotation, const FVector& LinearVelocity)
+{
+	if (NumSamples > 0 && Time <= GetSample(0).Time)
+	{
+		return;
+	}
+
+	NewestIndex = (NewestIndex + 1) % MaxSamples;
+	NumSamples = FMath::Min(NumSamples + 1, MaxSamples);
+
+	FSample& Sample = Samples[NewestIndex];
+	Sample.Time = Time;
+	Sample.Location = Location;
+	Sample.Rotation = Rotation;
+	Sample.LinearVelocity = LinearVelocity;
+}
+
+void FVehicleStateHistory::Reset()
+{
+	NewestIndex = -1;
+	NumSamples = 0;
+}
+
+void FVehicleSnapshotBuffer::AddSnapshot(float ServerTime, const FVector& Location, const FQuat& Rotation, const FVector& LinearVelocity)
+{
+	if (NumSnapshots > 0)
+	{
+		const FSnapshot Previous = GetSnapshot(0);
+		const float Interval = ServerTime - Previous.ServerTime;
+		if (Interval <= 0.0f)
+		{
+			return;
+		}
+
+		// nothing is sent while vehicle is parked, it stayed where it was until just before this state
+		static const float MaxInterval = 1.0f;
+		if (Interval > MaxInterval)
+		{
+			PushSnapshot(ServerTime - MaxInterval * 0.5f, Previous.Location, Previous.Rotation, FVector::ZeroVector);
+		}
+		else
+		{
+			AverageInterval = (AverageInterval > 0.0f) ? FMath::Lerp(AverageInterval, Interval, 0.1f) : Interval;
+		}
+	}
+
+	PushSnapshot(ServerTime, Location, Rotation, LinearVelocity);
+}
+
+void FVehicleSnapshotBuffer::PushSnapshot(float ServerTime, const FVector& Location, const FQuat& Rotation, const FVector& LinearVelocity)
+{
+	NewestIndex = (NewestIndex + 1) % MaxSnapshots;
+	NumSnapshots = FMath::Min(NumSnapshots + 1, MaxSnapshots);
+
+	FSnapshot& Snapshot = Snapshots[NewestIndex];
+	Snapshot.ServerTime = ServerTime;
+	Snapshot.Location = Location;
+	Snapshot.Rotation = Rotation;
+	Snapshot.LinearVelocity = LinearVelocity;
+}
+
+bool FVehicleSnapshotBuffer::Sample(float ServerTime, float MaxExtrapolation, FVector& OutLocation, FQuat& OutRotation, FVector& OutLinearVelocity) const
+{
+	if (NumSnapshots == 0)
+	{
+		return false;
+	}
+
+	const FSnapshot& Newest = GetSnapshot(0);
+	if (ServerTime >= Newest.ServerTime)
+	{
+		// states are late, keep going for a moment rather than freeze
+		const float ExtrapolationTime = FMath::Min(ServerTime - Newest.ServerTime, MaxExtrapolation);
+		OutLocation = Newest.Location + Newest.LinearVelocity * ExtrapolationTime;
+		OutRotation = Newest.Rotation;
+		OutLinearVelocity = Newest.LinearVelocity;
+		return true;
+	}
+
+	const FSnapshot& Oldest = GetSnapshot(NumSnapshots - 1);
+	if (ServerTime <= Oldest.ServerTime)
+	{
+		OutLocation = Oldest.Location;
+		OutRotation = Oldest.Rotation;
+		OutLinearVelocity = Oldest.LinearVelocity;
+		return true;
+	}
+
+	// render time is usually just behind newest snapshots
+	int32 Age = 1;
+	while (Age < NumSnapshots - 1 && GetSnapshot(Age).ServerTime > ServerTime)
+	{
+		Age++;
+	}
+
+	const FSnapshot& Before = GetSnapshot(Age);
+	const FSnapshot& After = GetSnapshot(Age - 1);
+	const float Duration = After.ServerTime - Before.ServerTime;
+	const float Alpha = (ServerTime - Before.ServerTime) / Duration;
+
+	// velocities as tangents keep path smooth through snapshots
+	OutLocation = FMath::CubicInterp(Before.Location, Before.LinearVelocity * Duration, After.Location, After.LinearVelocity * Duration, Alpha);
+	OutRotation = FQuat::Slerp(Before.Rotation, After.Rotation, Alpha);
+	OutLinearVelocity = FMath::Lerp(Before.LinearVelocity, After.LinearVelocity, Alpha);
+	return true;
+}
+
+void FVehicleSnapshotBuffer::Reset()
+{
+	NewestIndex = -1;
+	NumSnapshots = 0;
+	AverageInterval = 0.0f;
+}
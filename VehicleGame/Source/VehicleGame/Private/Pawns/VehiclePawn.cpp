@@ -1,6 +1,7 @@
 // Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
 
 #include "VehicleGame.h"
+#include "VehicleNetStats.h"
 #include "Particles/ParticleSystemComponent.h"
 
 AVehiclePawn::AVehiclePawn(const FObjectInitializer& ObjectInitializer) : 
@@ -43,12 +44,22 @@ AVehiclePawn::AVehiclePawn(const FObjectInitializer& ObjectInitializer) :
 	bTiresTouchingGround = false;
 
 	ImpactEffectNormalForceThreshold = 100000.f;
+
+	// body state is replicated by movement component, see UVehicleMovementComponentBoosted4w::VehicleState
+	bReplicateMovement = false;
 }
 
 void AVehiclePawn::PostInitializeComponents()
 {
 	Super::PostInitializeComponents();
 
+	if (GetNetMode() == NM_DedicatedServer)
+	{
+		// nobody will ever look through or listen to this vehicle
+		ReleaseClientOnlyComponents();
+		return;
+	}
+
 	if (EngineAC)
 	{
 		EngineAC->SetSound(EngineSound);
@@ -145,7 +156,10 @@ void AVehiclePawn::Tick(float DeltaSeconds)
 {
 	Super::Tick(DeltaSeconds);
 
-	UpdateWheelEffects(DeltaSeconds);
+	if (GetNetMode() != NM_DedicatedServer)
+	{
+		UpdateWheelEffects(DeltaSeconds);
+	}
 }
 
 
@@ -233,15 +247,6 @@ void AVehiclePawn::UpdateWheelEffects(float DeltaTime)
 	}
 }
 
-void AVehiclePawn::OnTrackPointReached(class AVehicleTrackPoint* NewCheckpoint)
-{
-	AVehiclePlayerController* MyPC = Cast<AVehiclePlayerController>(GetController());
-	if (MyPC)
-	{
-		MyPC->OnTrackPointReached(NewCheckpoint);
-	}
-}
-
 bool AVehiclePawn::IsHandbrakeActive() const
 {
 	return bHandbrakeActive;
@@ -266,12 +271,32 @@ void AVehiclePawn::ReceiveHit(class UPrimitiveComponent* MyComp, class AActor* O
 {
 	Super::ReceiveHit(MyComp, Other, OtherComp, bSelfMoved, HitLocation, HitNormal, NormalForce, Hit);
 
-	if (ImpactTemplate && NormalForce.Size() > ImpactEffectNormalForceThreshold)
+	const float DotBetweenHitAndUpRotation = FVector::DotProduct(HitNormal, GetMesh()->GetUpVector());
+	if (NormalForce.Size() > ImpactEffectNormalForceThreshold)
+	{
+		// server tells other clients, their copies of this vehicle don't collide
+		AVehicleGameMode* GameMode = GetWorld()->GetAuthGameMode<AVehicleGameMode>();
+		if (GameMode)
+		{
+			FVehicleGameEvent Event;
+			Event.Type = EVehicleGameEvent::Impact;
+			Event.Actor = this;
+			Event.Location = HitLocation;
+			Event.Normal = HitNormal;
+			Event.SetForce(NormalForce.Size());
+			Event.SurfaceType = UPhysicalMaterial::DetermineSurfaceType(Hit.PhysMaterial.Get());
+			Event.Value = DotBetweenHitAndUpRotation > 0.8f ? 1 : 0;
+			GameMode->AddGameEvent(Event);
+		}
+	}
+
+	// simulated proxies get their impacts from server, so everyone sees the same crash
+	const bool bSpawnLocalEffect = (Role == ROLE_Authority || IsLocallyControlled());
+	if (ImpactTemplate && bSpawnLocalEffect && GetNetMode() != NM_DedicatedServer && NormalForce.Size() > ImpactEffectNormalForceThreshold)
 	{
 		AVehicleImpactEffect* EffectActor = GetWorld()->SpawnActorDeferred<AVehicleImpactEffect>(ImpactTemplate, HitLocation, HitNormal.Rotation());
 		if (EffectActor)
 		{
-			float DotBetweenHitAndUpRotation = FVector::DotProduct(HitNormal, GetMesh()->GetUpVector());
 			EffectActor->HitSurface = Hit;
 			EffectActor->HitForce = NormalForce;
 			EffectActor->bWheelLand = DotBetweenHitAndUpRotation > 0.8;
@@ -289,6 +314,24 @@ void AVehiclePawn::ReceiveHit(class UPrimitiveComponent* MyComp, class AActor* O
 	}
 }
 
+void AVehiclePawn::SpawnImpactEffect(const FVehicleGameEvent& Event)
+{
+	if (ImpactTemplate && GetNetMode() != NM_DedicatedServer)
+	{
+		const FRotator Rotation = Event.Normal.Rotation();
+		AVehicleImpactEffect* EffectActor = GetWorld()->SpawnActorDeferred<AVehicleImpactEffect>(ImpactTemplate, Event.Location, Rotation);
+		if (EffectActor)
+		{
+			EffectActor->HitSurface.ImpactPoint = Event.Location;
+			EffectActor->HitSurface.ImpactNormal = Event.Normal;
+			EffectActor->SurfaceType = (EPhysicalSurface)Event.SurfaceType;
+			EffectActor->HitForce = Event.Normal * Event.GetForce();
+			EffectActor->bWheelLand = Event.Value != 0;
+			UGameplayStatics::FinishSpawningActor(EffectActor, FTransform(Rotation, Event.Location));
+		}
+	}
+}
+
 float AVehiclePawn::TakeDamage(float Damage, struct FDamageEvent const& DamageEvent, class AController* EventInstigator, class AActor* DamageCauser)
 {
 	if (Cast<APainCausingVolume>(DamageCauser) != NULL)
@@ -305,6 +348,45 @@ void AVehiclePawn::FellOutOfWorld(const class UDamageType& dmgType)
 	Die();
 }
 
+void AVehiclePawn::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	FVehicleNetStats::FScopedReplicationTimer ReplicationTimer(GetClass());
+
+	Super::PreReplication(ChangedPropertyTracker);
+
+	// movement is replicated as quantized vehicle state instead of ReplicatedMovement
+	UVehicleMovementComponentBoosted4w* BoostedMovement = Cast<UVehicleMovementComponentBoosted4w>(GetVehicleMovement());
+	if (BoostedMovement && !bTearOff)
+	{
+		BoostedMovement->UpdateReplicatedVehicleState();
+	}
+}
+
+bool AVehiclePawn::IsNetRelevantFor(const APlayerController* RealViewer, const AActor* Viewer, const FVector& SrcLocation) const
+{
+	// racers care about cars near them on the racing line, not in straight distance
+	UVehicleMovementComponentBoosted4w* BoostedMovement = Cast<UVehicleMovementComponentBoosted4w>(GetVehicleMovement());
+	bool bRelevant = false;
+	if (!bAlwaysRelevant && !IsOwnedBy(Viewer) && BoostedMovement && BoostedMovement->GetTrackNetRelevancy(RealViewer, SrcLocation, bRelevant))
+	{
+		return bRelevant;
+	}
+
+	return Super::IsNetRelevantFor(RealViewer, Viewer, SrcLocation);
+}
+
+float AVehiclePawn::GetNetPriority(const FVector& ViewPos, const FVector& ViewDir, APlayerController* Viewer, UActorChannel* InChannel, float Time, bool bLowBandwidth)
+{
+	UVehicleMovementComponentBoosted4w* BoostedMovement = Cast<UVehicleMovementComponentBoosted4w>(GetVehicleMovement());
+	float PriorityScale = 1.0f;
+	if (!IsOwnedBy(Viewer) && BoostedMovement && BoostedMovement->GetTrackNetPriorityScale(Viewer, PriorityScale))
+	{
+		return Time * NetPriority * PriorityScale;
+	}
+
+	return Super::GetNetPriority(ViewPos, ViewDir, Viewer, InChannel, Time, bLowBandwidth);
+}
+
 bool AVehiclePawn::CanDie() const
 {
 	if ( bIsDying										// already dying
@@ -335,6 +417,11 @@ void AVehiclePawn::OnRep_Dying()
 void AVehiclePawn::OnDeath()
 {
 	AVehiclePlayerController* MyPC = Cast<AVehiclePlayerController>(GetController());
+	if (MyPC)
+	{
+		MyPC->OnVehicleDied();
+	}
+
 	bReplicateMovement = false;
 	bIsDying = true;
 
@@ -361,6 +448,11 @@ void AVehiclePawn::OnDeath()
 
 void AVehiclePawn::PlayDestructionFX()
 {
+	if (GetNetMode() == NM_DedicatedServer)
+	{
+		return;
+	}
+
 	if (DeathFX)
 	{
 		UGameplayStatics::SpawnEmitterAtLocation(this, DeathFX, GetActorLocation(), GetActorRotation());
@@ -372,6 +464,24 @@ void AVehiclePawn::PlayDestructionFX()
 	}
 }
 
+void AVehiclePawn::ReleaseClientOnlyComponents()
+{
+	// camera goes first, so it won't get reattached when its spring arm is destroyed
+	UActorComponent* ClientOnlyComponents[] = { Camera, SpringArm, EngineAC, SkidAC };
+	for (int32 i = 0; i < ARRAY_COUNT(ClientOnlyComponents); i++)
+	{
+		if (ClientOnlyComponents[i] != NULL)
+		{
+			ClientOnlyComponents[i]->DestroyComponent();
+		}
+	}
+
+	Camera = NULL;
+	SpringArm = NULL;
+	EngineAC = NULL;
+	SkidAC = NULL;
+}
+
 void AVehiclePawn::GetLifetimeReplicatedProps( TArray< FLifetimeProperty > & OutLifetimeProps ) const
 {
 	Super::GetLifetimeReplicatedProps( OutLifetimeProps );
@@ -0,0 +1,428 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleGame.h"
+#include "VehicleNetStats.h"
+
+namespace VehicleQuantization
+{
+	const float PositionScale = 1.0f;
+	const float LinearVelocityScale = 1.0f;
+	const float AngularVelocityScale = 10.0f;
+	const float WheelSteeringScale = 127.0f / 90.0f;
+	const int32 RotationComponentMax = 1023;
+
+	/** max value of quantized component */
+	const int32 MaxPosition = (1 << 23) - 1;
+	const int32 MaxVelocity = (1 << 15) - 1;
+	const int32 MaxWheelValue = 127;
+
+	FORCEINLINE int32 Quantize(float Value, float Scale, int32 MaxValue)
+	{
+		return FMath::Clamp(FMath::RoundToInt(Value * Scale), -MaxValue, MaxValue);
+	}
+
+	FORCEINLINE uint32 ZigZag(int32 Value)
+	{
+		return (uint32)((Value << 1) ^ (Value >> 31));
+	}
+
+	FORCEINLINE int32 UnZigZag(uint32 Value)
+	{
+		return (int32)(Value >> 1) ^ -(int32)(Value & 1);
+	}
+
+	/** write or read group of values as differences from base, all using same bit width */
+	void SerializeGroup(FArchive& Ar, int32* Values, const int32* BaseValues, int32 Num)
+	{
+		uint32 NumBits = 0;
+		if (Ar.IsSaving())
+		{
+			uint32 MaxEncoded = 0;
+			for (int32 i = 0; i < Num; i++)
+			{
+				MaxEncoded = FMath::Max(MaxEncoded, ZigZag(Values[i] - BaseValues[i]));
+			}
+			NumBits = MaxEncoded ? (FMath::FloorLog2(MaxEncoded) + 1) : 0;
+		}
+
+		Ar.SerializeInt(NumBits, 32);
+
+		for (int32 i = 0; i < Num; i++)
+		{
+			uint32 Encoded = Ar.IsSaving() ? ZigZag(Values[i] - BaseValues[i]) : 0;
+			if (NumBits > 0)
+			{
+				Ar.SerializeInt(Encoded, 1u << NumBits);
+			}
+
+			if (Ar.IsLoading())
+			{
+				Values[i] = BaseValues[i] + UnZigZag(Encoded);
+			}
+		}
+	}
+}
+
+void FVehicleQuantizedState::FromRigidBodyState(const FRigidBodyState& InState, const FVector& TrackOrigin, const float* InWheelSteering)
+{
+	using namespace VehicleQuantization;
+
+	const FVector LocalPosition = InState.Position - TrackOrigin;
+	const FVector LinVel = InState.LinVel;
+	const FVector AngVel = InState.AngVel;
+	for (int32 i = 0; i < 3; i++)
+	{
+		Position[i] = Quantize(LocalPosition[i], PositionScale, MaxPosition);
+		LinearVelocity[i] = Quantize(LinVel[i], LinearVelocityScale, MaxVelocity);
+		AngularVelocity[i] = Quantize(AngVel[i], AngularVelocityScale, MaxVelocity);
+	}
+
+	// smallest three: drop largest component, it can be restored from unit length.
+	// Its sign is forced positive, q and -q are the same rotation.
+	FQuat Rotation = InState.Quaternion;
+	Rotation.Normalize();
+	const float Components[4] = { Rotation.X, Rotation.Y, Rotation.Z, Rotation.W };
+	RotationIndex = 0;
+	for (int32 i = 1; i < 4; i++)
+	{
+		if (FMath::Abs(Components[i]) > FMath::Abs(Components[RotationIndex]))
+		{
+			RotationIndex = i;
+		}
+	}
+
+	const float Sign = (Components[RotationIndex] < 0.0f) ? -1.0f : 1.0f;
+	for (int32 i = 0, Out = 0; i < 4; i++)
+	{
+		if (i != RotationIndex)
+		{
+			// remaining components are in [-1/sqrt(2), 1/sqrt(2)] range
+			const float Normalized = (Sign * Components[i] * UE_SQRT_2 + 1.0f) * 0.5f;
+			RotationComponents[Out++] = FMath::Clamp(FMath::RoundToInt(Normalized * RotationComponentMax), 0, RotationComponentMax);
+		}
+	}
+
+	for (int32 i = 0; i < VEHICLE_REPLICATED_WHEELS; i++)
+	{
+		WheelSteering[i] = InWheelSteering ? Quantize(InWheelSteering[i], WheelSteeringScale, MaxWheelValue) : 0;
+	}
+
+	Flags = InState.Flags & ERigidBodyFlags::Sleeping;
+}
+
+void FVehicleQuantizedState::ToRigidBodyState(const FVector& TrackOrigin, FRigidBodyState& OutState) const
+{
+	using namespace VehicleQuantization;
+
+	FVector LocalPosition, LinVel, AngVel;
+	for (int32 i = 0; i < 3; i++)
+	{
+		LocalPosition[i] = Position[i] / PositionScale;
+		LinVel[i] = LinearVelocity[i] / LinearVelocityScale;
+		AngVel[i] = AngularVelocity[i] / AngularVelocityScale;
+	}
+
+	float Components[4];
+	float SumSquared = 0.0f;
+	for (int32 i = 0, In = 0; i < 4; i++)
+	{
+		if (i != RotationIndex)
+		{
+			Components[i] = ((float)RotationComponents[In++] / RotationComponentMax * 2.0f - 1.0f) / UE_SQRT_2;
+			SumSquared += FMath::Square(Components[i]);
+		}
+	}
+	Components[RotationIndex] = FMath::Sqrt(FMath::Max(0.0f, 1.0f - SumSquared));
+
+	FQuat Rotation(Components[0], Components[1], Components[2], Components[3]);
+	Rotation.Normalize();
+
+	OutState.Position = TrackOrigin + LocalPosition;
+	OutState.Quaternion = Rotation;
+	OutState.LinVel = LinVel;
+	OutState.AngVel = AngVel;
+	OutState.Flags = Flags | ERigidBodyFlags::NeedsUpdate;
+}
+
+float FVehicleQuantizedState::GetWheelSteerAngle(int32 WheelIndex) const
+{
+	return WheelSteering[WheelIndex] / VehicleQuantization::WheelSteeringScale;
+}
+
+void FVehicleQuantizedState::SerializeDelta(FArchive& Ar, const FVehicleQuantizedState& Base)
+{
+	using namespace VehicleQuantization;
+
+	SerializeGroup(Ar, Position, Base.Position, 3);
+
+	// rotation components are only comparable when same component was dropped
+	uint32 Index = RotationIndex;
+	Ar.SerializeInt(Index, 4);
+	RotationIndex = Index;
+
+	static const int32 ZeroComponents[3] = { 0, 0, 0 };
+	SerializeGroup(Ar, RotationComponents, (Base.RotationIndex == RotationIndex) ? Base.RotationComponents : ZeroComponents, 3);
+
+	SerializeGroup(Ar, LinearVelocity, Base.LinearVelocity, 3);
+	SerializeGroup(Ar, AngularVelocity, Base.AngularVelocity, 3);
+	SerializeGroup(Ar, WheelSteering, Base.WheelSteering, VEHICLE_REPLICATED_WHEELS);
+
+	uint8 bSleeping = (Flags & ERigidBodyFlags::Sleeping) ? 1 : 0;
+	Ar.SerializeBits(&bSleeping, 1);
+	Flags = bSleeping ? ERigidBodyFlags::Sleeping : ERigidBodyFlags::None;
+}
+
+/** Last state sent to a connection, kept by net driver per connection */
+class FVehicleStateDeltaBase : public INetDeltaBaseState
+{
+public:
+
+	FVehicleQuantizedState State;
+	uint8 Sequence;
+	int32 UpdatesSinceKeyframe;
+
+	virtual bool IsStateEqual(INetDeltaBaseState* OtherState) override
+	{
+		FVehicleStateDeltaBase* Other = static_cast<FVehicleStateDeltaBase*>(OtherState);
+		return Other && State == Other->State;
+	}
+};
+
+bool FVehicleReplicatedState::NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+{
+	static const FVehicleQuantizedState ZeroState;
+
+	if (DeltaParms.Writer)
+	{
+		FBitWriter& Writer = *DeltaParms.Writer;
+		const int64 StartBits = Writer.GetNumBits();
+		FVehicleStateDeltaBase* OldBase = static_cast<FVehicleStateDeltaBase*>(DeltaParms.OldState);
+		if (OldBase && OldBase->State == State)
+		{
+			// nothing changed since last update sent to this connection
+			return false;
+		}
+
+		const bool bSendDelta = OldBase && OldBase->UpdatesSinceKeyframe < KeyframeInterval;
+
+		FVehicleStateDeltaBase* NewBase = new FVehicleStateDeltaBase();
+		NewBase->State = State;
+		NewBase->Sequence = OldBase ? OldBase->Sequence + 1 : 0;
+		NewBase->UpdatesSinceKeyframe = bSendDelta ? OldBase->UpdatesSinceKeyframe + 1 : 0;
+		*DeltaParms.NewState = MakeShareable(NewBase);
+
+		uint8 bIsDelta = bSendDelta ? 1 : 0;
+		Writer.SerializeBits(&bIsDelta, 1);
+		Writer << NewBase->Sequence;
+		if (bSendDelta)
+		{
+			Writer << OldBase->Sequence;
+		}
+
+		float SentServerTime = ServerTime;
+		Writer << SentServerTime;
+
+		FVehicleQuantizedState SentState = State;
+		SentState.SerializeDelta(Writer, bSendDelta ? OldBase->State : ZeroState);
+
+		FVehicleNetStats::AddPropertyUpdate(StatsClass, Writer.GetNumBits() - StartBits);
+		return true;
+	}
+	else if (DeltaParms.Reader)
+	{
+		FBitReader& Reader = *DeltaParms.Reader;
+
+		uint8 bIsDelta = 0;
+		uint8 Sequence = 0;
+		uint8 BaseSequence = 0;
+		Reader.SerializeBits(&bIsDelta, 1);
+		Reader << Sequence;
+		if (bIsDelta)
+		{
+			Reader << BaseSequence;
+		}
+
+		float ReceivedServerTime = 0.0f;
+		Reader << ReceivedServerTime;
+
+		const int32 BaseSlot = BaseSequence % NumReceivedBaselines;
+		const bool bHasBase = !bIsDelta || (bReceivedBaselineValid[BaseSlot] && ReceivedSequences[BaseSlot] == BaseSequence);
+
+		// delta must be read even without its baseline, to keep reader in sync
+		FVehicleQuantizedState NewState;
+		NewState.SerializeDelta(Reader, (bIsDelta && bHasBase) ? ReceivedBaselines[BaseSlot] : ZeroState);
+		if (Reader.IsError() || !bHasBase)
+		{
+			// next full state will fix it
+			return true;
+		}
+
+		const int32 Slot = Sequence % NumReceivedBaselines;
+		ReceivedBaselines[Slot] = NewState;
+		ReceivedSequences[Slot] = Sequence;
+		bReceivedBaselineValid[Slot] = true;
+		State = NewState;
+		ServerTime = ReceivedServerTime;
+		return true;
+	}
+
+	return false;
+}
+
+void FVehicleInputFrame::SetInputs(float InSteering, float InThrottle, float InBrake, float InHandbrake, float DeltaTime)
+{
+	Steering = (int8)FMath::Clamp(FMath::RoundToInt(InSteering * 127.0f), -127, 127);
+	Throttle = (int8)FMath::Clamp(FMath::RoundToInt(InThrottle * 127.0f), -127, 127);
+	Brake = (uint8)FMath::Clamp(FMath::RoundToInt(InBrake * 255.0f), 0, 255);
+	bHandbrake = (InHandbrake > 0.5f) ? 1 : 0;
+	DeltaMs = (uint8)FMath::Clamp(FMath::RoundToInt(DeltaTime * 1000.0f), 1, 255);
+}
+
+bool FVehicleInputBatch::NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess)
+{
+	const int64 StartBits = FVehicleNetStats::GetArchiveBits(Ar);
+
+	Ar << TimeStamp;
+	Ar << Sequence;
+	Ar << CurrentGear;
+
+	uint32 NumFrames = Frames.Num();
+	Ar.SerializeInt(NumFrames, MaxFrames + 1);
+	if (Ar.IsLoading())
+	{
+		Frames.Reset();
+		Frames.AddZeroed(NumFrames);
+	}
+
+	for (int32 i = 0; i < Frames.Num(); i++)
+	{
+		FVehicleInputFrame& Frame = Frames[i];
+		Ar << Frame.Steering;
+		Ar << Frame.Throttle;
+		Ar << Frame.Brake;
+		Ar.SerializeBits(&Frame.bHandbrake, 1);
+		Ar << Frame.DeltaMs;
+	}
+
+	if (Ar.IsLoading())
+	{
+		NumReceivedBits = (int32)(FVehicleNetStats::GetArchiveBits(Ar) - StartBits);
+	}
+
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
+
+void FVehicleGameEvent::SetForce(float Force)
+{
+	Magnitude = (Force > 1.0f) ? (uint8)FMath::Clamp(FMath::RoundToInt(FMath::Log2(Force) * 8.0f), 0, 255) : 0;
+}
+
+float FVehicleGameEvent::GetForce() const
+{
+	return FMath::Pow(2.0f, Magnitude / 8.0f);
+}
+
+bool FVehicleGameEventBatch::NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess)
+{
+	const int64 StartBits = FVehicleNetStats::GetArchiveBits(Ar);
+
+	uint32 NumEvents = FMath::Min(Events.Num(), MaxEvents);
+	Ar.SerializeInt(NumEvents, MaxEvents + 1);
+	if (Ar.IsLoading())
+	{
+		Events.Reset();
+		Events.AddDefaulted(NumEvents);
+	}
+
+	bOutSuccess = true;
+	for (uint32 i = 0; i < NumEvents && !Ar.IsError(); i++)
+	{
+		FVehicleGameEvent& Event = Events[i];
+		uint32 Type = Event.Type;
+		Ar.SerializeInt(Type, EVehicleGameEvent::MAX);
+		Event.Type = (uint8)Type;
+
+		if (Event.HasActor())
+		{
+			// actor without channel on receiving side comes out as NULL, event is still shown where possible
+			UObject* Actor = Event.Actor.Get();
+			bOutSuccess &= Map->SerializeObject(Ar, AActor::StaticClass(), Actor);
+			Event.Actor = Cast<AActor>(Actor);
+		}
+
+		if (Event.Type == EVehicleGameEvent::Impact)
+		{
+			bOutSuccess &= SerializePackedVector<10, 24>(Event.Location, Ar);
+			bOutSuccess &= SerializeFixedVector<1, 8>(Event.Normal, Ar);
+			Ar << Event.Magnitude;
+
+			uint32 SurfaceType = Event.SurfaceType;
+			Ar.SerializeInt(SurfaceType, SurfaceType_Max);
+			Event.SurfaceType = (uint8)SurfaceType;
+		}
+
+		Ar.SerializeIntPacked((uint32&)Event.Value);
+	}
+
+	if (Ar.IsSaving())
+	{
+		FVehicleNetStats::AddRpcSent(StatsClass, FVehicleNetStats::GetArchiveBits(Ar) - StartBits);
+	}
+
+	bOutSuccess &= !Ar.IsError();
+	return true;
+}
+
+bool FVehicleRaceSnapshot::NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess)
+{
+	const int64 StartBits = FVehicleNetStats::GetArchiveBits(Ar);
+
+	Ar << ServerTime;
+	Ar << RaceStartServerTime;
+	Ar << RaceFinishServerTime;
+
+	uint8 bRaceActive = bIsRaceActive ? 1 : 0;
+	Ar.SerializeBits(&bRaceActive, 1);
+	bIsRaceActive = (bRaceActive != 0);
+
+	uint32 NumRacers = Racers.Num();
+	Ar.SerializeIntPacked(NumRacers);
+	if (Ar.IsLoading())
+	{
+		// reliable call is never split, anything this big is broken
+		if (NumRacers > 255)
+		{
+			Ar.SetError();
+			bOutSuccess = false;
+			return true;
+		}
+		Racers.Reset();
+		Racers.AddDefaulted(NumRacers);
+	}
+
+	bOutSuccess = true;
+	const FVehicleQuantizedState ZeroState;
+	for (int32 i = 0; i < Racers.Num() && !Ar.IsError(); i++)
+	{
+		FVehicleRaceSnapshotRacer& Racer = Racers[i];
+		Ar.SerializeIntPacked((uint32&)Racer.PlayerId);
+		Racer.Progress.SerializePacked(Ar);
+
+		uint8 bHasVehicle = Racer.bHasVehicle ? 1 : 0;
+		Ar.SerializeBits(&bHasVehicle, 1);
+		Racer.bHasVehicle = (bHasVehicle != 0);
+		if (Racer.bHasVehicle)
+		{
+			Racer.VehicleState.SerializeDelta(Ar, ZeroState);
+		}
+	}
+
+	if (Ar.IsSaving())
+	{
+		FVehicleNetStats::AddRpcSent(StatsClass, FVehicleNetStats::GetArchiveBits(Ar) - StartBits);
+	}
+
+	bOutSuccess &= !Ar.IsError();
+	return true;
+}
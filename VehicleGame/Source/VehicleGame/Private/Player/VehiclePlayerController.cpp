@@ -1,12 +1,30 @@
 // Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
 
 #include "VehicleGame.h"
+#include "VehicleNetStats.h"
+#include "VehicleTestHarness.h"
 
 AVehiclePlayerController::AVehiclePlayerController(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
 	PlayerCameraManagerClass = AVehiclePlayerCameraManager::StaticClass();
 	bEnableClickEvents = true;
 	bEnableTouchEvents = true;
+
+	for (int32 i = 0; i < NumTimeSyncSamples; i++)
+	{
+		TimeSyncRoundTrips[i] = MAX_FLT;
+		TimeSyncOffsets[i] = 0.0f;
+	}
+	NumTimeSyncReplies = 0;
+	LastTimeSyncRequestTime = -MAX_FLT;
+	ServerTimeOffset = 0.0f;
+	LastTrackPointTime = 0.0;
+
+	RaceSnapshotServerTime = 0.0f;
+	RaceSnapshotReceiveTime = 0.0f;
+	NumRaceSnapshotRacers = 0;
+	bJoinReported = false;
+	LoginStartTime = 0.0;
 }
 
 void AVehiclePlayerController::SetupInputComponent()
@@ -27,10 +45,101 @@ void AVehiclePlayerController::UnFreeze()
 	ServerRestartPlayer();
 }
 
-void AVehiclePlayerController::OnTrackPointReached(class AVehicleTrackPoint* TrackPoint)
+void AVehiclePlayerController::PlayerTick(float DeltaTime)
+{
+	Super::PlayerTick(DeltaTime);
+
+	if (Role < ROLE_Authority)
+	{
+		// a few quick samples after joining, then just enough to follow drift
+		const float TimeSyncInterval = (NumTimeSyncReplies < NumTimeSyncSamples) ? 0.25f : 5.0f;
+		const float CurrentTime = GetWorld()->GetTimeSeconds();
+		if (CurrentTime - LastTimeSyncRequestTime >= TimeSyncInterval)
+		{
+			LastTimeSyncRequestTime = CurrentTime;
+			ServerRequestTime(CurrentTime);
+		}
+
+		if (PendingSnapshotRacers.Num() > 0)
+		{
+			ApplyRaceSnapshot();
+		}
+
+		if (!bJoinReported)
+		{
+			UpdateJoinReport();
+		}
+	}
+
+	// after input was processed, so bot's values win over idle axis bindings
+	if (TestHarness.IsValid())
+	{
+		TestHarness->Tick(this, DeltaTime);
+	}
+}
+
+void AVehiclePlayerController::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	FVehicleNetStats::FScopedReplicationTimer ReplicationTimer(GetClass());
+
+	Super::PreReplication(ChangedPropertyTracker);
+}
+
+void AVehiclePlayerController::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (GetNetMode() == NM_Client)
+	{
+		TestHarness = FVehicleClientTestHarness::CreateFromCommandLine();
+	}
+}
+
+void AVehiclePlayerController::OnTrackPointReached(class AVehicleTrackPoint* TrackPoint, double CrossingTime)
 {
 	LastTrackPoint = TrackPoint;
 	StartSpot = TrackPoint;
+
+	// judge crossing at time player saw it, not when server simulated it
+	AWheeledVehicle* Vehicle = Cast<AWheeledVehicle>(GetPawn());
+	UVehicleMovementComponentBoosted4w* BoostedMovement = Vehicle ? Cast<UVehicleMovementComponentBoosted4w>(Vehicle->GetVehicleMovement()) : NULL;
+	LastTrackPointTime = CrossingTime - (BoostedMovement ? BoostedMovement->GetLagCompensationTime() : 0.0f);
+
+	AVehicleGameMode* GameMode = GetWorld()->GetAuthGameMode<AVehicleGameMode>();
+	AVehicleGameState* GameState = GetWorld()->GetGameState<AVehicleGameState>();
+	if (GameMode && GameState)
+	{
+		const FVehicleTrackLayout& TrackLayout = GameState->GetTrackLayout();
+		const int32 TrackPointIndex = TrackLayout.TrackPoints.Find(TrackPoint);
+		FVehicleGameEvent Event;
+		Event.Type = EVehicleGameEvent::TrackPointReached;
+		Event.Actor = PlayerState;
+		Event.Value = TrackPointIndex;
+		GameMode->AddGameEvent(Event);
+
+		AVehiclePlayerState* VehiclePlayerState = Cast<AVehiclePlayerState>(PlayerState);
+		if (VehiclePlayerState)
+		{
+			VehiclePlayerState->OnTrackPointReached(TrackPointIndex, TrackLayout, LastTrackPointTime - GameMode->GetRaceStartClock(), GameState->IsRaceActive());
+		}
+	}
+}
+
+void AVehiclePlayerController::OnFinishLineReached()
+{
+	AVehiclePlayerState* VehiclePlayerState = Cast<AVehiclePlayerState>(PlayerState);
+	AVehicleGameMode* GameMode = GetWorld()->GetAuthGameMode<AVehicleGameMode>();
+	if (VehiclePlayerState && GameMode)
+	{
+		VehiclePlayerState->OnRaceFinished(LastTrackPointTime - GameMode->GetRaceStartClock());
+	}
+}
+
+float AVehiclePlayerController::GetLastTrackPointTime() const
+{
+	// clock and world time advance by the same frame times
+	AVehicleGameMode* GameMode = GetWorld()->GetAuthGameMode<AVehicleGameMode>();
+	return GameMode ? GetWorld()->GetTimeSeconds() - (float)(GameMode->GetServerClock() - LastTrackPointTime) : 0.0f;
 }
 
 void AVehiclePlayerController::OnToggleInGameMenu()
@@ -47,6 +156,7 @@ void AVehiclePlayerController::GetLifetimeReplicatedProps( TArray< FLifetimeProp
 	Super::GetLifetimeReplicatedProps( OutLifetimeProps );
 	
 	DOREPLIFETIME( AVehiclePlayerController, bHandbrakeOverride );
+	DOREPLIFETIME_CONDITION( AVehiclePlayerController, LastTrackPoint, COND_OwnerOnly );
 }
 
 bool AVehiclePlayerController::IsHandbrakeForced() const
@@ -74,6 +184,8 @@ bool AVehiclePlayerController::ServerSuicide_Validate()
 
 void AVehiclePlayerController::ServerSuicide_Implementation()
 {
+	FVehicleNetStats::AddRpcReceived(GetClass(), 0);
+
 	AVehicleGameState* GameState = GetWorld()->GetGameState<AVehicleGameState>();
 	if (((GameState != nullptr) && (GameState->IsRaceActive())) || (GetNetMode() == NM_Standalone))
 	{
@@ -85,3 +197,315 @@ void AVehiclePlayerController::ServerSuicide_Implementation()
 	}
 }
 
+bool AVehiclePlayerController::ServerRequestTime_Validate(float ClientSendTime)
+{
+	return true;
+}
+
+void AVehiclePlayerController::ServerRequestTime_Implementation(float ClientSendTime)
+{
+	// parameters are serialized by engine, their bytes are part of estimated engine overhead
+	FVehicleNetStats::AddRpcReceived(GetClass(), 0);
+	FVehicleNetStats::AddRpcSent(GetClass(), 0);
+	ClientReportServerTime(ClientSendTime, GetWorld()->GetTimeSeconds());
+}
+
+void AVehiclePlayerController::ClientReportServerTime_Implementation(float ClientSendTime, float ServerTime)
+{
+	const float CurrentTime = GetWorld()->GetTimeSeconds();
+	const float RoundTrip = CurrentTime - ClientSendTime;
+	if (RoundTrip < 0.0f)
+	{
+		return;
+	}
+
+	const int32 SampleIndex = NumTimeSyncReplies % NumTimeSyncSamples;
+	TimeSyncRoundTrips[SampleIndex] = RoundTrip;
+	TimeSyncOffsets[SampleIndex] = ServerTime + RoundTrip * 0.5f - CurrentTime;
+	NumTimeSyncReplies++;
+
+	// shortest round trip had least queuing delay, so its midpoint is most accurate
+	int32 BestIndex = 0;
+	for (int32 i = 1; i < NumTimeSyncSamples; i++)
+	{
+		if (TimeSyncRoundTrips[i] < TimeSyncRoundTrips[BestIndex])
+		{
+			BestIndex = i;
+		}
+	}
+	ServerTimeOffset = TimeSyncOffsets[BestIndex];
+}
+
+void AVehiclePlayerController::ClientReceiveRaceSnapshot_Implementation(const FVehicleRaceSnapshot& Snapshot)
+{
+	// rough offset until time sync replies, one way latency off at most
+	if (NumTimeSyncReplies == 0)
+	{
+		ServerTimeOffset = Snapshot.ServerTime - GetWorld()->GetTimeSeconds();
+	}
+
+	AVehicleGameState* GameState = GetWorld()->GetGameState<AVehicleGameState>();
+	if (GameState && GameState->RaceStartServerTime == 0.0f)
+	{
+		GameState->RaceStartServerTime = Snapshot.RaceStartServerTime;
+		GameState->RaceFinishServerTime = Snapshot.RaceFinishServerTime;
+		GameState->bIsRaceActive = Snapshot.bIsRaceActive;
+	}
+
+	PendingSnapshotRacers = Snapshot.Racers;
+	RaceSnapshotServerTime = Snapshot.ServerTime;
+	RaceSnapshotReceiveTime = GetWorld()->GetRealTimeSeconds();
+	NumRaceSnapshotRacers = Snapshot.Racers.Num();
+	ApplyRaceSnapshot();
+}
+
+void AVehiclePlayerController::ApplyRaceSnapshot()
+{
+	// racer is done when his player state and vehicle (if he had one) arrived
+	for (int32 i = PendingSnapshotRacers.Num() - 1; i >= 0; i--)
+	{
+		const FVehicleRaceSnapshotRacer& Racer = PendingSnapshotRacers[i];
+
+		AVehiclePlayerState* RacerPlayerState = NULL;
+		AGameState* GameState = GetWorld()->GameState;
+		for (int32 PlayerIndex = 0; GameState && PlayerIndex < GameState->PlayerArray.Num(); PlayerIndex++)
+		{
+			if (GameState->PlayerArray[PlayerIndex] && GameState->PlayerArray[PlayerIndex]->PlayerId == Racer.PlayerId)
+			{
+				RacerPlayerState = Cast<AVehiclePlayerState>(GameState->PlayerArray[PlayerIndex]);
+				break;
+			}
+		}
+		if (RacerPlayerState == NULL)
+		{
+			continue;
+		}
+
+		AWheeledVehicle* RacerVehicle = NULL;
+		for (FConstPawnIterator It = GetWorld()->GetPawnIterator(); It; ++It)
+		{
+			if (*It && (*It)->PlayerState == RacerPlayerState)
+			{
+				RacerVehicle = Cast<AWheeledVehicle>(*It);
+				break;
+			}
+		}
+		if (Racer.bHasVehicle && RacerVehicle == NULL)
+		{
+			continue;
+		}
+
+		RacerPlayerState->ApplyRaceSnapshot(Racer.Progress);
+
+		UVehicleMovementComponentBoosted4w* BoostedMovement = RacerVehicle ? Cast<UVehicleMovementComponentBoosted4w>(RacerVehicle->GetVehicleMovement()) : NULL;
+		if (BoostedMovement && Racer.bHasVehicle)
+		{
+			BoostedMovement->ApplyRaceSnapshot(Racer.VehicleState, RaceSnapshotServerTime);
+		}
+
+		PendingSnapshotRacers.RemoveAtSwap(i);
+	}
+}
+
+void AVehiclePlayerController::UpdateJoinReport()
+{
+	const float CurrentTime = GetWorld()->GetRealTimeSeconds();
+	const bool bClockKnown = NumTimeSyncReplies > 0 || RaceSnapshotReceiveTime > 0.0f;
+
+	// don't wait forever for racers that left meanwhile
+	const float MaxSnapshotWait = 5.0f;
+	const bool bSnapshotDone = PendingSnapshotRacers.Num() == 0 || CurrentTime - RaceSnapshotReceiveTime > MaxSnapshotWait;
+	if (GetPawn() == NULL || !bClockKnown || !bSnapshotDone)
+	{
+		return;
+	}
+
+	// server knows when login started, it measures the whole join
+	bJoinReported = true;
+	const float SnapshotWaitTime = (RaceSnapshotReceiveTime > 0.0f) ? CurrentTime - RaceSnapshotReceiveTime : -1.0f;
+	ServerReportJoined(SnapshotWaitTime, NumRaceSnapshotRacers, NumRaceSnapshotRacers - PendingSnapshotRacers.Num());
+	PendingSnapshotRacers.Reset();
+}
+
+void AVehiclePlayerController::SetLoginStartTime(double Time)
+{
+	LoginStartTime = Time;
+}
+
+bool AVehiclePlayerController::ServerReportJoined_Validate(float SnapshotWaitTime, uint8 NumSnapshotRacers, uint8 NumSyncedRacers)
+{
+	return true;
+}
+
+void AVehiclePlayerController::ServerReportJoined_Implementation(float SnapshotWaitTime, uint8 NumSnapshotRacers, uint8 NumSyncedRacers)
+{
+	if (LoginStartTime <= 0.0)
+	{
+		return;
+	}
+
+	// includes one way trip of the report
+	const double JoinTime = FPlatformTime::Seconds() - LoginStartTime;
+	const FString PlayerName = PlayerState ? PlayerState->PlayerName : GetName();
+	if (SnapshotWaitTime >= 0.0f)
+	{
+		UE_LOG(LogVehicle, Log, TEXT("%s joined running race: playable %.2f s after login started, %.2f s after snapshot arrived, %d of %d racers synchronized from it"),
+			*PlayerName, JoinTime, SnapshotWaitTime, NumSyncedRacers, NumSnapshotRacers);
+	}
+	else
+	{
+		UE_LOG(LogVehicle, Log, TEXT("%s joined race: playable %.2f s after login started"), *PlayerName, JoinTime);
+	}
+	LoginStartTime = 0.0;
+}
+
+float AVehiclePlayerController::GetServerTimeOffset() const
+{
+	return (Role < ROLE_Authority) ? ServerTimeOffset : 0.0f;
+}
+
+float AVehiclePlayerController::GetServerWorldTime() const
+{
+	return GetWorld()->GetTimeSeconds() + GetServerTimeOffset();
+}
+
+void AVehiclePlayerController::OnVehicleDied()
+{
+	AVehicleGameMode* GameMode = GetWorld()->GetAuthGameMode<AVehicleGameMode>();
+	AVehiclePlayerState* VehiclePlayerState = Cast<AVehiclePlayerState>(PlayerState);
+	if (GameMode && VehiclePlayerState)
+	{
+		VehiclePlayerState->OnVehicleDied();
+
+		FVehicleGameEvent Event;
+		Event.Type = EVehicleGameEvent::VehicleDied;
+		Event.Actor = PlayerState;
+		Event.Value = VehiclePlayerState->GetNumDeaths();
+		GameMode->AddGameEvent(Event);
+	}
+}
+
+void AVehiclePlayerController::ClientReceiveGameEvents_Implementation(const FVehicleGameEventBatch& Batch)
+{
+	AVehicleHUD* VehicleHUD = Cast<AVehicleHUD>(GetHUD());
+	for (int32 i = 0; i < Batch.Events.Num(); i++)
+	{
+		const FVehicleGameEvent& Event = Batch.Events[i];
+		if (Event.Type == EVehicleGameEvent::Impact)
+		{
+			// simulated proxies don't collide on client, so this is the only impact effect they get
+			AVehiclePawn* VehiclePawn = Cast<AVehiclePawn>(Event.Actor.Get());
+			ABuggyPawn* BuggyPawn = Cast<ABuggyPawn>(Event.Actor.Get());
+			if (VehiclePawn)
+			{
+				VehiclePawn->SpawnImpactEffect(Event);
+			}
+			else if (BuggyPawn)
+			{
+				BuggyPawn->SpawnImpactEffect(Event);
+			}
+		}
+		else if (VehicleHUD)
+		{
+			VehicleHUD->OnGameEvent(Event);
+		}
+	}
+}
+
+void AVehiclePlayerController::ReplaySpeed(float Speed)
+{
+	for (TActorIterator<AVehicleReplayPlayer> It(GetWorld()); It; ++It)
+	{
+		It->SetPlaybackSpeed(Speed);
+	}
+}
+
+void AVehiclePlayerController::ReplaySeek(float Time)
+{
+	for (TActorIterator<AVehicleReplayPlayer> It(GetWorld()); It; ++It)
+	{
+		It->SeekTo(Time);
+	}
+}
+
+void AVehiclePlayerController::ReplayViewNext()
+{
+	for (TActorIterator<AVehicleReplayPlayer> It(GetWorld()); It; ++It)
+	{
+		AActor* Vehicle = It->GetNextVehicle(GetViewTarget(), 1);
+		if (Vehicle)
+		{
+			SetViewTarget(Vehicle);
+		}
+	}
+}
+
+FVehicleRaceDigest AVehiclePlayerController::GetRaceDigest() const
+{
+	FVehicleRaceDigest Digest;
+
+	// client's pawn dies without controller, replicated count is the one both sides see
+	const AVehiclePlayerState* VehiclePlayerState = Cast<AVehiclePlayerState>(PlayerState);
+	Digest.NumDeaths = VehiclePlayerState ? VehiclePlayerState->GetNumDeaths() : 0;
+
+	AVehicleGameState* GameState = GetWorld()->GetGameState<AVehicleGameState>();
+	if (GameState)
+	{
+		Digest.bRaceActive = GameState->IsRaceActive();
+		Digest.NumRacers = GameState->NumRacers;
+		Digest.TrackPointIndex = GameState->GetTrackLayout().TrackPoints.Find(LastTrackPoint);
+		Digest.Standings = GameState->GetStandings().PlayerIds;
+		for (int32 i = 0; i < Digest.Standings.Num(); i++)
+		{
+			const AVehiclePlayerState* RacerState = NULL;
+			for (int32 j = 0; j < GameState->PlayerArray.Num() && RacerState == NULL; j++)
+			{
+				if (GameState->PlayerArray[j] && GameState->PlayerArray[j]->PlayerId == Digest.Standings[i])
+				{
+					RacerState = Cast<AVehiclePlayerState>(GameState->PlayerArray[j]);
+				}
+			}
+
+			// player state not replicated yet shows up as mismatch until it arrives
+			const FVehicleRaceProgress RacerRaceProgress = RacerState ? RacerState->GetRaceProgress() : FVehicleRaceProgress();
+			Digest.RacerProgress.Add(RacerState ? RacerRaceProgress.Lap * 256 + RacerRaceProgress.TrackPointIndex : INDEX_NONE);
+		}
+
+		// finish times are replicated in player states, equal ones are ordered by id on every peer
+		TArray<const AVehiclePlayerState*, TInlineAllocator<64> > Finishers;
+		for (int32 i = 0; i < GameState->PlayerArray.Num(); i++)
+		{
+			const AVehiclePlayerState* VehiclePlayerState = Cast<AVehiclePlayerState>(GameState->PlayerArray[i]);
+			if (VehiclePlayerState && VehiclePlayerState->GetRaceProgress().FinishTimeMs > 0)
+			{
+				Finishers.Add(VehiclePlayerState);
+			}
+		}
+		Finishers.Sort([](const AVehiclePlayerState& A, const AVehiclePlayerState& B)
+		{
+			const int32 FinishA = A.GetRaceProgress().FinishTimeMs;
+			const int32 FinishB = B.GetRaceProgress().FinishTimeMs;
+			return (FinishA != FinishB) ? (FinishA < FinishB) : (A.PlayerId < B.PlayerId);
+		});
+		for (int32 i = 0; i < Finishers.Num(); i++)
+		{
+			Digest.FinishOrder.Add(Finishers[i]->PlayerId);
+		}
+	}
+
+	return Digest;
+}
+
+bool AVehiclePlayerController::ServerReportRaceDigest_Validate(const FVehicleRaceDigest& Digest, int32 NumCorrections)
+{
+	return true;
+}
+
+void AVehiclePlayerController::ServerReportRaceDigest_Implementation(const FVehicleRaceDigest& Digest, int32 NumCorrections)
+{
+	AVehicleGameMode* GameMode = GetWorld()->GetAuthGameMode<AVehicleGameMode>();
+	if (GameMode)
+	{
+		GameMode->OnRaceDigestReported(this, Digest, NumCorrections);
+	}
+}
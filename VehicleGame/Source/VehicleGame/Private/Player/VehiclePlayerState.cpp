@@ -0,0 +1,234 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleGame.h"
+#include "VehicleNetStats.h"
+
+bool FVehicleRaceProgress::NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess)
+{
+	const int64 StartBits = FVehicleNetStats::GetArchiveBits(Ar);
+
+	SerializePacked(Ar);
+
+	if (Ar.IsSaving())
+	{
+		FVehicleNetStats::AddPropertyUpdate(AVehiclePlayerState::StaticClass(), FVehicleNetStats::GetArchiveBits(Ar) - StartBits);
+	}
+
+	bOutSuccess = true;
+	return true;
+}
+
+void FVehicleRaceProgress::SerializePacked(FArchive& Ar)
+{
+	Ar << TrackPointIndex;
+	Ar << Lap;
+
+	// race times in ms, packed integers take 3 bytes for most of them
+	uint32 Times[5] = { (uint32)TrackPointTimeMs, (uint32)LastLapTimeMs, (uint32)BestLapTimeMs, (uint32)LapStartTimeMs, (uint32)FinishTimeMs };
+	for (int32 i = 0; i < ARRAY_COUNT(Times); i++)
+	{
+		Ar.SerializeIntPacked(Times[i]);
+	}
+
+	TrackPointTimeMs = Times[0];
+	LastLapTimeMs = Times[1];
+	BestLapTimeMs = Times[2];
+	LapStartTimeMs = Times[3];
+	FinishTimeMs = Times[4];
+
+	for (int32 i = 0; i < NumSectors; i++)
+	{
+		Ar.SerializeIntPacked((uint32&)LastSectorTimesMs[i]);
+		Ar.SerializeIntPacked((uint32&)BestSectorTimesMs[i]);
+	}
+}
+
+double FVehicleLapTimer::FinishSector(double RaceTime)
+{
+	const double SectorTime = RaceTime - SectorStartTime;
+	LastSectorTimes[Sector] = SectorTime;
+	BestSectorTimes[Sector] = (BestSectorTimes[Sector] > 0.0) ? FMath::Min(BestSectorTimes[Sector], SectorTime) : SectorTime;
+
+	SectorStartTime = RaceTime;
+	Sector = (Sector + 1) % FVehicleRaceProgress::NumSectors;
+	return SectorTime;
+}
+
+double FVehicleLapTimer::FinishLap(double RaceTime)
+{
+	const double LapTime = RaceTime - LapStartTime;
+	LastLapTime = LapTime;
+	BestLapTime = (BestLapTime > 0.0) ? FMath::Min(BestLapTime, LapTime) : LapTime;
+
+	LapStartTime = RaceTime;
+	return LapTime;
+}
+
+namespace VehiclePlayerState
+{
+	/** race time in ms for replication, never 0 for time that is known */
+	int32 ToMs(double Time)
+	{
+		return FMath::Max(FMath::RoundToInt(Time * 1000.0), 1);
+	}
+}
+
+AVehiclePlayerState::AVehiclePlayerState(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
+{
+	NumDeaths = 0;
+}
+
+void AVehiclePlayerState::GetLifetimeReplicatedProps(TArray< FLifetimeProperty > & OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(AVehiclePlayerState, RaceProgress);
+	DOREPLIFETIME(AVehiclePlayerState, NumDeaths);
+}
+
+void AVehiclePlayerState::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	FVehicleNetStats::FScopedReplicationTimer ReplicationTimer(GetClass());
+
+	Super::PreReplication(ChangedPropertyTracker);
+}
+
+FVehicleRaceProgress AVehiclePlayerState::GetRaceProgress() const
+{
+	return RaceProgress;
+}
+
+void AVehiclePlayerState::ApplyRaceSnapshot(const FVehicleRaceProgress& Progress)
+{
+	if (RaceProgress == FVehicleRaceProgress())
+	{
+		RaceProgress = Progress;
+	}
+}
+
+void AVehiclePlayerState::ResetRaceProgress()
+{
+	LapTimer.Reset();
+	SetRaceProgress(FVehicleRaceProgress());
+}
+
+void AVehiclePlayerState::OnTrackPointReached(int32 TrackPointIndex, const FVehicleTrackLayout& TrackLayout, double RaceTime, bool bTimed)
+{
+	if (TrackPointIndex < 0 || TrackPointIndex >= FVehicleRaceProgress::NoTrackPoint)
+	{
+		return;
+	}
+
+	// checkpoint follows player before start and after finish too, only the race itself is timed
+	FVehicleRaceProgress NewProgress = RaceProgress;
+	if (!bTimed || RaceProgress.FinishTimeMs > 0)
+	{
+		NewProgress.TrackPointIndex = (uint8)TrackPointIndex;
+		SetRaceProgress(NewProgress);
+		return;
+	}
+
+	const int32 RaceTimeMs = FMath::Max(FMath::RoundToInt(RaceTime * 1000.0), 0);
+
+	// sectors are timed in order, so crossing start line before the first lap doesn't end last sector
+	if (TrackPointIndex == TrackLayout.GetSectorEndPoint(LapTimer.Sector, FVehicleRaceProgress::NumSectors) && TrackPointIndex != RaceProgress.TrackPointIndex)
+	{
+		const int32 Sector = LapTimer.Sector;
+		LapTimer.FinishSector(RaceTime);
+		NewProgress.LastSectorTimesMs[Sector] = VehiclePlayerState::ToMs(LapTimer.LastSectorTimes[Sector]);
+		NewProgress.BestSectorTimesMs[Sector] = VehiclePlayerState::ToMs(LapTimer.BestSectorTimes[Sector]);
+	}
+
+	// lap ends when first point is reached coming from the last one
+	if (TrackLayout.bClosedLoop && TrackPointIndex == 0 && RaceProgress.TrackPointIndex == TrackLayout.TrackPoints.Num() - 1)
+	{
+		LapTimer.FinishLap(RaceTime);
+		NewProgress.LastLapTimeMs = VehiclePlayerState::ToMs(LapTimer.LastLapTime);
+		NewProgress.BestLapTimeMs = VehiclePlayerState::ToMs(LapTimer.BestLapTime);
+		NewProgress.LapStartTimeMs = RaceTimeMs;
+		NewProgress.Lap = FMath::Min(RaceProgress.Lap + 1, 255);
+
+		// sectors restart with the lap, even if some gate in between was never reached
+		LapTimer.SectorStartTime = RaceTime;
+		LapTimer.Sector = 0;
+	}
+
+	if (TrackPointIndex != RaceProgress.TrackPointIndex)
+	{
+		NewProgress.TrackPointIndex = (uint8)TrackPointIndex;
+		NewProgress.TrackPointTimeMs = RaceTimeMs;
+	}
+
+	SetRaceProgress(NewProgress);
+}
+
+void AVehiclePlayerState::OnRaceFinished(double RaceTime)
+{
+	if (RaceProgress.FinishTimeMs == 0)
+	{
+		FVehicleRaceProgress NewProgress = RaceProgress;
+		NewProgress.FinishTimeMs = VehiclePlayerState::ToMs(RaceTime);
+		SetRaceProgress(NewProgress);
+	}
+}
+
+void AVehiclePlayerState::OnVehicleDied()
+{
+	NumDeaths++;
+	ForceNetUpdate();
+}
+
+int32 AVehiclePlayerState::GetNumDeaths() const
+{
+	return NumDeaths;
+}
+
+int32 AVehiclePlayerState::GetTrackPointIndex() const
+{
+	return (RaceProgress.TrackPointIndex == FVehicleRaceProgress::NoTrackPoint) ? INDEX_NONE : RaceProgress.TrackPointIndex;
+}
+
+int32 AVehiclePlayerState::GetLap() const
+{
+	return RaceProgress.Lap;
+}
+
+float AVehiclePlayerState::GetLastLapTime() const
+{
+	return RaceProgress.LastLapTimeMs * 0.001f;
+}
+
+float AVehiclePlayerState::GetBestLapTime() const
+{
+	return RaceProgress.BestLapTimeMs * 0.001f;
+}
+
+float AVehiclePlayerState::GetFinishTime() const
+{
+	return RaceProgress.FinishTimeMs * 0.001f;
+}
+
+float AVehiclePlayerState::GetLapStartTime() const
+{
+	return RaceProgress.LapStartTimeMs * 0.001f;
+}
+
+float AVehiclePlayerState::GetLastSectorTime(int32 Sector) const
+{
+	return (Sector >= 0 && Sector < FVehicleRaceProgress::NumSectors) ? RaceProgress.LastSectorTimesMs[Sector] * 0.001f : 0.0f;
+}
+
+float AVehiclePlayerState::GetBestSectorTime(int32 Sector) const
+{
+	return (Sector >= 0 && Sector < FVehicleRaceProgress::NumSectors) ? RaceProgress.BestSectorTimesMs[Sector] * 0.001f : 0.0f;
+}
+
+void AVehiclePlayerState::SetRaceProgress(const FVehicleRaceProgress& NewProgress)
+{
+	// player state updates rarely, don't let checkpoint wait for next one
+	if (NewProgress != RaceProgress)
+	{
+		RaceProgress = NewProgress;
+		ForceNetUpdate();
+	}
+}
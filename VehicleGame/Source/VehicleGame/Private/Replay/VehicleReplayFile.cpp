@@ -0,0 +1,336 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleGame.h"
+#include "VehicleReplayFile.h"
+
+const FVehicleReplayVehicleState* FVehicleReplayFrame::FindVehicle(int32 Id) const
+{
+	for (int32 i = 0; i < Vehicles.Num(); i++)
+	{
+		if (Vehicles[i].Id == Id)
+		{
+			return &Vehicles[i];
+		}
+	}
+
+	return NULL;
+}
+
+void FVehicleReplayFrame::Serialize(FArchive& Ar, const FVehicleReplayFrame* Base)
+{
+	static const FVehicleQuantizedState ZeroState;
+
+	uint8 bActive = bRaceActive ? 1 : 0;
+	Ar.SerializeBits(&bActive, 1);
+	bRaceActive = (bActive != 0);
+	Ar << RaceTime;
+
+	uint32 PackedRacers = NumRacers;
+	Ar.SerializeIntPacked(PackedRacers);
+	NumRacers = PackedRacers;
+
+	uint32 NumVehicles = Vehicles.Num();
+	Ar.SerializeIntPacked(NumVehicles);
+	if (Ar.IsLoading())
+	{
+		Vehicles.Reset();
+		Vehicles.AddZeroed(NumVehicles);
+	}
+
+	for (uint32 i = 0; i < NumVehicles && !Ar.IsError(); i++)
+	{
+		FVehicleReplayVehicleState& Vehicle = Vehicles[i];
+		uint32 Id = Vehicle.Id;
+		Ar.SerializeIntPacked(Id);
+		Vehicle.Id = Id;
+
+		// reader has the same base, no need to tell if delta is used
+		const FVehicleReplayVehicleState* BaseVehicle = Base ? Base->FindVehicle(Vehicle.Id) : NULL;
+		Vehicle.State.SerializeDelta(Ar, BaseVehicle ? BaseVehicle->State : ZeroState);
+	}
+
+	uint32 NumEvents = Events.Num();
+	Ar.SerializeIntPacked(NumEvents);
+	if (Ar.IsLoading())
+	{
+		Events.Reset();
+		Events.AddZeroed(NumEvents);
+	}
+
+	for (uint32 i = 0; i < NumEvents && !Ar.IsError(); i++)
+	{
+		FVehicleReplayEvent& Event = Events[i];
+		uint32 Type = Event.Type;
+		Ar.SerializeInt(Type, 16);
+		Event.Type = Type;
+
+		// both can be INDEX_NONE
+		uint32 VehicleId = Event.VehicleId + 1;
+		uint32 Value = Event.Value + 1;
+		Ar.SerializeIntPacked(VehicleId);
+		Ar.SerializeIntPacked(Value);
+		Event.VehicleId = (int32)VehicleId - 1;
+		Event.Value = (int32)Value - 1;
+	}
+}
+
+FVehicleReplayWriter::FVehicleReplayWriter(IFileHandle* InFile)
+	: File(InFile)
+	, WorkEvent(NULL)
+	, Thread(NULL)
+{
+	if (FPlatformProcess::SupportsMultithreading())
+	{
+		WorkEvent = FPlatformProcess::CreateSynchEvent();
+		Thread = FRunnableThread::Create(this, TEXT("VehicleReplayWriter"), 0, TPri_BelowNormal);
+	}
+}
+
+FVehicleReplayWriter::~FVehicleReplayWriter()
+{
+	if (Thread)
+	{
+		Stop();
+		Thread->WaitForCompletion();
+		delete Thread;
+		Thread = NULL;
+	}
+
+	Flush();
+	delete WorkEvent;
+	delete File;
+}
+
+void FVehicleReplayWriter::Write(TArray<uint8>& Data)
+{
+	TArray<uint8>* QueuedData = new TArray<uint8>();
+	Exchange(*QueuedData, Data);
+	Pending.Enqueue(QueuedData);
+
+	if (WorkEvent)
+	{
+		WorkEvent->Trigger();
+	}
+	else
+	{
+		Flush();
+	}
+}
+
+uint32 FVehicleReplayWriter::Run()
+{
+	while (StopRequested.GetValue() == 0)
+	{
+		WorkEvent->Wait(100);
+		Flush();
+	}
+
+	// close file here, so game thread doesn't wait for the last write
+	Flush();
+	delete File;
+	File = NULL;
+	Closed.Increment();
+	return 0;
+}
+
+void FVehicleReplayWriter::Stop()
+{
+	StopRequested.Increment();
+	if (WorkEvent)
+	{
+		WorkEvent->Trigger();
+	}
+}
+
+bool FVehicleReplayWriter::IsClosed() const
+{
+	return Thread == NULL || Closed.GetValue() != 0;
+}
+
+void FVehicleReplayWriter::Flush()
+{
+	TArray<uint8>* QueuedData = NULL;
+	while (Pending.Dequeue(QueuedData))
+	{
+		if (File && !File->Write(QueuedData->GetData(), QueuedData->Num()))
+		{
+			UE_LOG(LogVehicle, Warning, TEXT("Failed to write replay data, recording stopped"));
+			delete File;
+			File = NULL;
+		}
+		delete QueuedData;
+	}
+}
+
+FVehicleReplayReader::FVehicleReplayReader()
+	: CurrentFrameIndex(INDEX_NONE)
+	, PreviousFrameIndex(INDEX_NONE)
+{
+}
+
+bool FVehicleReplayReader::Open(const FString& Filename)
+{
+	Frames.Reset();
+	VehicleInfos.Reset();
+	CurrentFrameIndex = INDEX_NONE;
+	PreviousFrameIndex = INDEX_NONE;
+
+	if (!FFileHelper::LoadFileToArray(Data, *Filename))
+	{
+		UE_LOG(LogVehicle, Warning, TEXT("Failed to load replay %s"), *Filename);
+		return false;
+	}
+
+	FMemoryReader Ar(Data);
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	Ar << Magic << Version;
+	if (Magic != VehicleReplay::Magic || Version != VehicleReplay::Version)
+	{
+		UE_LOG(LogVehicle, Warning, TEXT("%s is not a replay of this version"), *Filename);
+		return false;
+	}
+	Ar << MapName;
+
+	// index chunks, frames are decoded only when needed
+	int32 KeyframeIndex = INDEX_NONE;
+	while (!Ar.AtEnd() && !Ar.IsError())
+	{
+		uint8 Type = 0;
+		float Time = 0.0f;
+		int32 Size = 0;
+		Ar << Type << Time << Size;
+		const int32 Offset = (int32)Ar.Tell();
+		if (Ar.IsError() || Size < 0 || Offset + Size > Data.Num())
+		{
+			// recording was interrupted, keep what is complete
+			break;
+		}
+
+		if (Type == VehicleReplay::Chunk_Vehicle)
+		{
+			int32 Id = 0;
+			FVehicleReplayVehicleInfo Info;
+			Ar << Id << Info.ClassPath << Info.PlayerName;
+			VehicleInfos.Add(Id, Info);
+		}
+		else if (Type == VehicleReplay::Chunk_Keyframe || (Type == VehicleReplay::Chunk_Delta && KeyframeIndex != INDEX_NONE))
+		{
+			if (Type == VehicleReplay::Chunk_Keyframe)
+			{
+				KeyframeIndex = Frames.Num();
+			}
+
+			FFrameInfo& Frame = Frames[Frames.AddUninitialized()];
+			Frame.Time = Time;
+			Frame.Offset = Offset;
+			Frame.Size = Size;
+			Frame.KeyframeIndex = KeyframeIndex;
+		}
+
+		Ar.Seek(Offset + Size);
+	}
+
+	UE_LOG(LogVehicle, Log, TEXT("Loaded replay %s: %d frames, %d vehicles, %.1f s"), *Filename, Frames.Num(), VehicleInfos.Num(), GetEndTime() - GetStartTime());
+	return Frames.Num() > 0;
+}
+
+float FVehicleReplayReader::GetStartTime() const
+{
+	return Frames.Num() ? Frames[0].Time : 0.0f;
+}
+
+float FVehicleReplayReader::GetEndTime() const
+{
+	return Frames.Num() ? Frames.Last().Time : 0.0f;
+}
+
+int32 FVehicleReplayReader::FindFrame(float Time) const
+{
+	int32 Min = 0;
+	int32 Max = Frames.Num() - 1;
+	while (Min < Max)
+	{
+		const int32 Mid = (Min + Max + 1) / 2;
+		if (Frames[Mid].Time <= Time)
+		{
+			Min = Mid;
+		}
+		else
+		{
+			Max = Mid - 1;
+		}
+	}
+
+	return FMath::Max(Min, 0);
+}
+
+const FVehicleReplayFrame* FVehicleReplayReader::GetFrame(int32 FrameIndex)
+{
+	if (!Frames.IsValidIndex(FrameIndex))
+	{
+		return NULL;
+	}
+
+	if (FrameIndex == PreviousFrameIndex)
+	{
+		return &PreviousFrame;
+	}
+
+	// continue from last decoded frame when it's on the way, otherwise start at keyframe
+	const int32 KeyframeIndex = Frames[FrameIndex].KeyframeIndex;
+	const int32 FirstIndex = (CurrentFrameIndex >= KeyframeIndex && CurrentFrameIndex <= FrameIndex) ? CurrentFrameIndex + 1 : KeyframeIndex;
+	for (int32 i = FirstIndex; i <= FrameIndex; i++)
+	{
+		if (!DecodeFrame(i))
+		{
+			CurrentFrameIndex = INDEX_NONE;
+			PreviousFrameIndex = INDEX_NONE;
+			return NULL;
+		}
+	}
+
+	return &CurrentFrame;
+}
+
+const FVehicleReplayFrame* FVehicleReplayReader::GetFramePair(int32 FrameIndex, const FVehicleReplayFrame*& OutNextFrame)
+{
+	// decoding next frame right after this one moves this one to PreviousFrame, even when next one is a keyframe
+	OutNextFrame = NULL;
+	if (GetFrame(FrameIndex) == NULL)
+	{
+		return NULL;
+	}
+
+	OutNextFrame = GetFrame(FrameIndex + 1);
+	const FVehicleReplayFrame* Frame = GetFrame(FrameIndex);
+	check(OutNextFrame == NULL || Frame != OutNextFrame);
+	return Frame;
+}
+
+const FVehicleReplayVehicleInfo* FVehicleReplayReader::GetVehicleInfo(int32 Id) const
+{
+	return VehicleInfos.Find(Id);
+}
+
+bool FVehicleReplayReader::DecodeFrame(int32 FrameIndex)
+{
+	const FFrameInfo& Info = Frames[FrameIndex];
+	const bool bKeyframe = (Info.KeyframeIndex == FrameIndex);
+
+	FVehicleReplayFrame NewFrame;
+	NewFrame.Time = Info.Time;
+	FBitReader Reader(Data.GetData() + Info.Offset, (int64)Info.Size * 8);
+	NewFrame.Serialize(Reader, bKeyframe ? NULL : &CurrentFrame);
+	if (Reader.IsError())
+	{
+		UE_LOG(LogVehicle, Warning, TEXT("Replay frame %d is corrupted"), FrameIndex);
+		return false;
+	}
+
+	Exchange(PreviousFrame, CurrentFrame);
+	Exchange(CurrentFrame, NewFrame);
+	PreviousFrameIndex = CurrentFrameIndex;
+	CurrentFrameIndex = FrameIndex;
+	return true;
+}
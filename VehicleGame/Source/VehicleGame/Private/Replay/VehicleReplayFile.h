@@ -0,0 +1,214 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+//
+// Race replay file: header followed by chunks of frames and vehicle descriptions.
+// Frames are keyframes with full vehicle states or deltas from previous frame,
+// so seeking needs to decode at most one keyframe and KeyframeInterval deltas.
+//
+
+namespace VehicleReplay
+{
+	/** file identification, "VRPL" */
+	static const uint32 Magic = 0x4C505256;
+
+	/** increase when format changes */
+	static const uint32 Version = 2;
+
+	/** number of delta frames between keyframes */
+	static const int32 KeyframeInterval = 20;
+
+	/** chunk types */
+	enum EChunkType
+	{
+		Chunk_Keyframe,
+		Chunk_Delta,
+		Chunk_Vehicle,
+	};
+}
+
+/** Vehicle state in single frame */
+struct FVehicleReplayVehicleState
+{
+	/** id of vehicle, assigned by recorder */
+	int32 Id;
+
+	/** state in world space */
+	FVehicleQuantizedState State;
+};
+
+/** Race event in single frame */
+struct FVehicleReplayEvent
+{
+	/** EVehicleGameEvent */
+	uint8 Type;
+
+	/** vehicle involved, INDEX_NONE if none */
+	int32 VehicleId;
+
+	/** event data, e.g. index of track point */
+	int32 Value;
+};
+
+/** Vehicle seen in replay */
+struct FVehicleReplayVehicleInfo
+{
+	/** path of vehicle class */
+	FString ClassPath;
+
+	/** name of driver */
+	FString PlayerName;
+};
+
+/** Recorded state of race at single time */
+struct FVehicleReplayFrame
+{
+	/** server world time */
+	float Time;
+
+	/** is race running? */
+	bool bRaceActive;
+
+	/** time elapsed from race start */
+	float RaceTime;
+
+	/** number of racers */
+	int32 NumRacers;
+
+	/** vehicles in world */
+	TArray<FVehicleReplayVehicleState> Vehicles;
+
+	/** events since previous frame */
+	TArray<FVehicleReplayEvent> Events;
+
+	FVehicleReplayFrame()
+		: Time(0.0f), bRaceActive(false), RaceTime(0.0f), NumRacers(0)
+	{
+	}
+
+	/** find state of vehicle, NULL if it's not in frame */
+	const FVehicleReplayVehicleState* FindVehicle(int32 Id) const;
+
+	/** write or read frame. Vehicles found in Base are sent as delta, NULL Base gives keyframe */
+	void Serialize(FArchive& Ar, const FVehicleReplayFrame* Base);
+};
+
+/** Writes replay data to file on its own thread, so game thread never waits for disk */
+class FVehicleReplayWriter : public FRunnable
+{
+public:
+
+	/** takes ownership of file */
+	FVehicleReplayWriter(IFileHandle* InFile);
+
+	/** writes all pending data and closes file */
+	virtual ~FVehicleReplayWriter();
+
+	/** queue data for writing, Data is emptied */
+	void Write(TArray<uint8>& Data);
+
+	/** has writer thread written everything and closed file after Stop? */
+	bool IsClosed() const;
+
+	// Begin FRunnable interface
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+	// End FRunnable interface
+
+private:
+
+	/** write everything queued so far */
+	void Flush();
+
+	IFileHandle* File;
+
+	/** data waiting for writer thread */
+	TQueue<TArray<uint8>*, EQueueMode::Spsc> Pending;
+
+	/** triggered when new data is queued */
+	FEvent* WorkEvent;
+
+	/** set when writer should exit */
+	FThreadSafeCounter StopRequested;
+
+	/** set when writer thread closed file */
+	FThreadSafeCounter Closed;
+
+	/** NULL if platform doesn't support threads, data is written right away then */
+	FRunnableThread* Thread;
+};
+
+/** Loads replay into memory and decodes frames on demand */
+class FVehicleReplayReader
+{
+public:
+
+	FVehicleReplayReader();
+
+	/** load file and build frame index */
+	bool Open(const FString& Filename);
+
+	/** map race was recorded on */
+	const FString& GetMapName() const
+	{
+		return MapName;
+	}
+
+	int32 GetNumFrames() const
+	{
+		return Frames.Num();
+	}
+
+	/** server time of first and last frame */
+	float GetStartTime() const;
+	float GetEndTime() const;
+
+	/** index of last frame at or before Time, 0 if Time is before start */
+	int32 FindFrame(float Time) const;
+
+	/**
+	 * Decode frame, cheapest when frames are requested in order. NULL if it can't be decoded.
+	 * Returned frame is valid only until next call, use GetFramePair for interpolation.
+	 */
+	const FVehicleReplayFrame* GetFrame(int32 FrameIndex);
+
+	/** decode frame and the one after it into separate buffers. OutNextFrame is NULL after last frame */
+	const FVehicleReplayFrame* GetFramePair(int32 FrameIndex, const FVehicleReplayFrame*& OutNextFrame);
+
+	/** get description of vehicle, NULL if it's unknown */
+	const FVehicleReplayVehicleInfo* GetVehicleInfo(int32 Id) const;
+
+private:
+
+	/** position of frame in file */
+	struct FFrameInfo
+	{
+		float Time;
+		int32 Offset;
+		int32 Size;
+
+		/** index of keyframe this frame is decoded from */
+		int32 KeyframeIndex;
+	};
+
+	/** decode frame at FrameIndex into CurrentFrame, using CurrentFrame as base for delta */
+	bool DecodeFrame(int32 FrameIndex);
+
+	/** whole replay file */
+	TArray<uint8> Data;
+
+	FString MapName;
+
+	TArray<FFrameInfo> Frames;
+
+	TMap<int32, FVehicleReplayVehicleInfo> VehicleInfos;
+
+	/** last decoded frame */
+	FVehicleReplayFrame CurrentFrame;
+	int32 CurrentFrameIndex;
+
+	/** frame decoded before CurrentFrame */
+	FVehicleReplayFrame PreviousFrame;
+	int32 PreviousFrameIndex;
+};
@@ -0,0 +1,212 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleGame.h"
+#include "VehicleReplayFile.h"
+
+AVehicleReplayPlayer::AVehicleReplayPlayer(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
+{
+	PrimaryActorTick.bCanEverTick = true;
+	PlaybackTime = 0.0f;
+	PlaybackSpeed = 1.0f;
+	LastEventFrame = INDEX_NONE;
+}
+
+bool AVehicleReplayPlayer::LoadReplay(const FString& Filename)
+{
+	TSharedPtr<FVehicleReplayReader> NewReader = MakeShareable(new FVehicleReplayReader());
+	if (!NewReader->Open(Filename))
+	{
+		return false;
+	}
+
+	for (TMap<int32, TWeakObjectPtr<AActor> >::TIterator It(Vehicles); It; ++It)
+	{
+		if (It.Value().IsValid())
+		{
+			It.Value()->Destroy();
+		}
+	}
+	Vehicles.Reset();
+
+	Reader = NewReader;
+	PlaybackTime = Reader->GetStartTime();
+	LastEventFrame = INDEX_NONE;
+	UpdateVehicles();
+	return true;
+}
+
+void AVehicleReplayPlayer::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	if (Reader.IsValid() && PlaybackSpeed > 0.0f && PlaybackTime < Reader->GetEndTime())
+	{
+		PlaybackTime = FMath::Min(PlaybackTime + DeltaSeconds * PlaybackSpeed, Reader->GetEndTime());
+		ReportEvents(Reader->FindFrame(PlaybackTime));
+		UpdateVehicles();
+	}
+}
+
+void AVehicleReplayPlayer::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Super::EndPlay(EndPlayReason);
+
+	Reader.Reset();
+}
+
+void AVehicleReplayPlayer::SeekTo(float Time)
+{
+	if (Reader.IsValid())
+	{
+		PlaybackTime = FMath::Clamp(Reader->GetStartTime() + Time, Reader->GetStartTime(), Reader->GetEndTime());
+
+		// events are only reported during playback, not for skipped part
+		LastEventFrame = Reader->FindFrame(PlaybackTime);
+		UpdateVehicles();
+	}
+}
+
+void AVehicleReplayPlayer::SetPlaybackSpeed(float NewSpeed)
+{
+	PlaybackSpeed = FMath::Max(NewSpeed, 0.0f);
+}
+
+float AVehicleReplayPlayer::GetPlaybackSpeed() const
+{
+	return PlaybackSpeed;
+}
+
+float AVehicleReplayPlayer::GetPlaybackTime() const
+{
+	return Reader.IsValid() ? PlaybackTime - Reader->GetStartTime() : 0.0f;
+}
+
+float AVehicleReplayPlayer::GetDuration() const
+{
+	return Reader.IsValid() ? Reader->GetEndTime() - Reader->GetStartTime() : 0.0f;
+}
+
+AActor* AVehicleReplayPlayer::GetNextVehicle(AActor* Current, int32 Offset) const
+{
+	TArray<AActor*> VisibleVehicles;
+	for (TMap<int32, TWeakObjectPtr<AActor> >::TConstIterator It(Vehicles); It; ++It)
+	{
+		if (It.Value().IsValid() && !It.Value()->bHidden)
+		{
+			VisibleVehicles.Add(It.Value().Get());
+		}
+	}
+
+	if (VisibleVehicles.Num() == 0)
+	{
+		return NULL;
+	}
+
+	const int32 CurrentIndex = VisibleVehicles.Find(Current);
+	const int32 NextIndex = (CurrentIndex == INDEX_NONE) ? 0 : CurrentIndex + Offset;
+	return VisibleVehicles[((NextIndex % VisibleVehicles.Num()) + VisibleVehicles.Num()) % VisibleVehicles.Num()];
+}
+
+void AVehicleReplayPlayer::UpdateVehicles()
+{
+	const int32 FrameIndex = Reader->FindFrame(PlaybackTime);
+	const FVehicleReplayFrame* NextFrame = NULL;
+	const FVehicleReplayFrame* CurrentFrame = Reader->GetFramePair(FrameIndex, NextFrame);
+	if (CurrentFrame == NULL)
+	{
+		return;
+	}
+
+	const FVehicleReplayFrame& Frame = *CurrentFrame;
+	const float Alpha = (NextFrame && NextFrame->Time > Frame.Time) ? FMath::Clamp((PlaybackTime - Frame.Time) / (NextFrame->Time - Frame.Time), 0.0f, 1.0f) : 0.0f;
+
+	for (TMap<int32, TWeakObjectPtr<AActor> >::TIterator It(Vehicles); It; ++It)
+	{
+		if (It.Value().IsValid() && Frame.FindVehicle(It.Key()) == NULL)
+		{
+			It.Value()->SetActorHiddenInGame(true);
+		}
+	}
+
+	for (int32 i = 0; i < Frame.Vehicles.Num(); i++)
+	{
+		const FVehicleReplayVehicleState& VehicleState = Frame.Vehicles[i];
+		AActor* Vehicle = GetVehicle(VehicleState.Id);
+		if (Vehicle == NULL)
+		{
+			continue;
+		}
+
+		FRigidBodyState State;
+		VehicleState.State.ToRigidBodyState(FVector::ZeroVector, State);
+		FVector Location = State.Position;
+		FQuat Rotation = State.Quaternion;
+
+		const FVehicleReplayVehicleState* NextVehicleState = NextFrame ? NextFrame->FindVehicle(VehicleState.Id) : NULL;
+		if (NextVehicleState && Alpha > 0.0f)
+		{
+			FRigidBodyState NextState;
+			NextVehicleState->State.ToRigidBodyState(FVector::ZeroVector, NextState);
+			Location = FMath::Lerp(Location, NextState.Position, Alpha);
+			Rotation = FQuat::Slerp(Rotation, NextState.Quaternion, Alpha);
+		}
+
+		Vehicle->SetActorHiddenInGame(false);
+		Vehicle->SetActorLocationAndRotation(Location, Rotation.Rotator());
+	}
+}
+
+void AVehicleReplayPlayer::ReportEvents(int32 FrameIndex)
+{
+	for (int32 i = LastEventFrame + 1; i <= FrameIndex; i++)
+	{
+		const FVehicleReplayFrame* Frame = Reader->GetFrame(i);
+		for (int32 EventIndex = 0; Frame && EventIndex < Frame->Events.Num(); EventIndex++)
+		{
+			const FVehicleReplayEvent& Event = Frame->Events[EventIndex];
+			AActor* Vehicle = (Event.VehicleId != INDEX_NONE) ? GetVehicle(Event.VehicleId) : NULL;
+			OnReplayEvent.Broadcast((EVehicleGameEvent::Type)Event.Type, Vehicle, Event.Value);
+		}
+	}
+
+	LastEventFrame = FMath::Max(LastEventFrame, FrameIndex);
+}
+
+AActor* AVehicleReplayPlayer::GetVehicle(int32 Id)
+{
+	TWeakObjectPtr<AActor>* ExistingVehicle = Vehicles.Find(Id);
+	if (ExistingVehicle)
+	{
+		return ExistingVehicle->Get();
+	}
+
+	const FVehicleReplayVehicleInfo* Info = Reader->GetVehicleInfo(Id);
+	UClass* VehicleClass = Info ? StaticLoadClass(AActor::StaticClass(), NULL, *Info->ClassPath) : NULL;
+	AActor* Vehicle = NULL;
+	if (VehicleClass)
+	{
+		FActorSpawnParameters SpawnInfo;
+		SpawnInfo.bNoCollisionFail = true;
+		Vehicle = GetWorld()->SpawnActor<AActor>(VehicleClass, FVector::ZeroVector, FRotator::ZeroRotator, SpawnInfo);
+	}
+
+	// recorded states drive vehicle, it must not simulate or touch track points
+	AWheeledVehicle* WheeledVehicle = Cast<AWheeledVehicle>(Vehicle);
+	if (WheeledVehicle)
+	{
+		WheeledVehicle->GetMesh()->SetSimulatePhysics(false);
+		WheeledVehicle->GetVehicleMovement()->SetComponentTickEnabled(false);
+	}
+	if (Vehicle)
+	{
+		Vehicle->SetActorEnableCollision(false);
+	}
+	else
+	{
+		UE_LOG(LogVehicle, Warning, TEXT("Can't spawn replay vehicle %d (%s)"), Id, Info ? *Info->ClassPath : TEXT("unknown"));
+	}
+
+	// failed ones are remembered too, so it's not tried every frame
+	Vehicles.Add(Id, Vehicle);
+	return Vehicle;
+}
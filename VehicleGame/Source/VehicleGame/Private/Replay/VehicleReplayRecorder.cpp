@@ -0,0 +1,175 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleGame.h"
+#include "VehicleReplayRecorder.h"
+
+FVehicleReplayRecorder::FVehicleReplayRecorder()
+	: NextVehicleId(0)
+	, FramesSinceKeyframe(INDEX_NONE)
+	, CurrentTime(0.0f)
+{
+}
+
+FVehicleReplayRecorder::~FVehicleReplayRecorder()
+{
+	// writers left closing wait for their threads now
+	Stop();
+	ClosingWriters.Empty();
+}
+
+bool FVehicleReplayRecorder::Start(const FString& Filename, const FString& MapName)
+{
+	Stop();
+
+	IFileManager::Get().MakeDirectory(*FPaths::GetPath(Filename), true);
+	IFileHandle* File = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*Filename);
+	if (File == NULL)
+	{
+		UE_LOG(LogVehicle, Warning, TEXT("Failed to create replay %s"), *Filename);
+		return false;
+	}
+
+	Writer = MakeShareable(new FVehicleReplayWriter(File));
+	VehicleIds.Reset();
+	NextVehicleId = 0;
+	FramesSinceKeyframe = INDEX_NONE;
+	PendingEvents.Reset();
+
+	TArray<uint8> Header;
+	FMemoryWriter Ar(Header);
+	uint32 Magic = VehicleReplay::Magic;
+	uint32 Version = VehicleReplay::Version;
+	FString Map = MapName;
+	Ar << Magic << Version << Map;
+	Writer->Write(Header);
+
+	UE_LOG(LogVehicle, Log, TEXT("Recording replay to %s"), *Filename);
+	return true;
+}
+
+void FVehicleReplayRecorder::Stop()
+{
+	if (Writer.IsValid())
+	{
+		Writer->Stop();
+		ClosingWriters.Add(Writer);
+		Writer.Reset();
+	}
+
+	ReleaseClosedWriters();
+}
+
+void FVehicleReplayRecorder::ReleaseClosedWriters()
+{
+	for (int32 i = ClosingWriters.Num() - 1; i >= 0; i--)
+	{
+		if (ClosingWriters[i]->IsClosed())
+		{
+			ClosingWriters.RemoveAtSwap(i);
+		}
+	}
+}
+
+void FVehicleReplayRecorder::RecordFrame(UWorld* World)
+{
+	ReleaseClosedWriters();
+	if (!IsRecording())
+	{
+		return;
+	}
+
+	CurrentTime = World->GetTimeSeconds();
+
+	FVehicleReplayFrame Frame;
+	Frame.Time = CurrentTime;
+	AVehicleGameState* GameState = World->GetGameState<AVehicleGameState>();
+	if (GameState)
+	{
+		Frame.bRaceActive = GameState->IsRaceActive();
+		Frame.RaceTime = GameState->GetTotalTime();
+		Frame.NumRacers = GameState->NumRacers;
+	}
+
+	for (FConstPawnIterator It = World->GetPawnIterator(); It; ++It)
+	{
+		AWheeledVehicle* Vehicle = Cast<AWheeledVehicle>(*It);
+		UPrimitiveComponent* VehicleMesh = Vehicle ? Vehicle->GetMesh() : NULL;
+		FRigidBodyState RBState;
+		if (VehicleMesh == NULL || Vehicle->bHidden || !VehicleMesh->GetRigidBodyState(RBState))
+		{
+			continue;
+		}
+
+		float WheelSteering[VEHICLE_REPLICATED_WHEELS] = { 0.0f };
+		UWheeledVehicleMovementComponent* VehicleMovement = Vehicle->GetVehicleMovement();
+		for (int32 i = 0; VehicleMovement && i < FMath::Min(VehicleMovement->Wheels.Num(), VEHICLE_REPLICATED_WHEELS); i++)
+		{
+			if (VehicleMovement->Wheels[i])
+			{
+				WheelSteering[i] = VehicleMovement->Wheels[i]->GetSteerAngle();
+			}
+		}
+
+		FVehicleReplayVehicleState& VehicleState = Frame.Vehicles[Frame.Vehicles.AddUninitialized()];
+		VehicleState.Id = GetVehicleId(Vehicle);
+		VehicleState.State.FromRigidBodyState(RBState, FVector::ZeroVector, WheelSteering);
+	}
+
+	Exchange(Frame.Events, PendingEvents);
+	PendingEvents.Reset();
+
+	const bool bKeyframe = (FramesSinceKeyframe == INDEX_NONE || FramesSinceKeyframe >= VehicleReplay::KeyframeInterval);
+	FBitWriter Payload(0, true);
+	Frame.Serialize(Payload, bKeyframe ? NULL : &LastFrame);
+	WriteChunk(bKeyframe ? VehicleReplay::Chunk_Keyframe : VehicleReplay::Chunk_Delta, CurrentTime, *Payload.GetBuffer());
+
+	FramesSinceKeyframe = bKeyframe ? 0 : FramesSinceKeyframe + 1;
+	Exchange(LastFrame, Frame);
+}
+
+void FVehicleReplayRecorder::AddEvent(EVehicleGameEvent::Type Type, AActor* Vehicle, int32 Value)
+{
+	if (!IsRecording())
+	{
+		return;
+	}
+
+	FVehicleReplayEvent& Event = PendingEvents[PendingEvents.AddUninitialized()];
+	Event.Type = (uint8)Type;
+	Event.VehicleId = Vehicle ? GetVehicleId(Vehicle) : INDEX_NONE;
+	Event.Value = Value;
+}
+
+int32 FVehicleReplayRecorder::GetVehicleId(AActor* Vehicle)
+{
+	const int32* ExistingId = VehicleIds.Find(Vehicle);
+	if (ExistingId)
+	{
+		return *ExistingId;
+	}
+
+	int32 Id = NextVehicleId++;
+	VehicleIds.Add(Vehicle, Id);
+
+	// vehicles are described before first frame using them, reader collects descriptions when indexing
+	APawn* Pawn = Cast<APawn>(Vehicle);
+	FString ClassPath = Vehicle->GetClass()->GetPathName();
+	FString PlayerName = (Pawn && Pawn->PlayerState) ? Pawn->PlayerState->PlayerName : FString();
+
+	TArray<uint8> Payload;
+	FMemoryWriter Ar(Payload);
+	Ar << Id << ClassPath << PlayerName;
+	WriteChunk(VehicleReplay::Chunk_Vehicle, CurrentTime, Payload);
+
+	return Id;
+}
+
+void FVehicleReplayRecorder::WriteChunk(uint8 Type, float Time, const TArray<uint8>& Payload)
+{
+	TArray<uint8> Chunk;
+	FMemoryWriter Ar(Chunk);
+	int32 Size = Payload.Num();
+	Ar << Type << Time << Size;
+	Chunk.Append(Payload);
+	Writer->Write(Chunk);
+}
@@ -0,0 +1,63 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "VehicleReplayFile.h"
+
+/** [server] Samples vehicles and race state into replay file */
+class FVehicleReplayRecorder
+{
+public:
+
+	FVehicleReplayRecorder();
+	~FVehicleReplayRecorder();
+
+	/** create replay file and start recording */
+	bool Start(const FString& Filename, const FString& MapName);
+
+	/** finish writing replay, file is closed by writer thread without waiting for it */
+	void Stop();
+
+	bool IsRecording() const
+	{
+		return Writer.IsValid();
+	}
+
+	/** add state of all vehicles and race at current time */
+	void RecordFrame(UWorld* World);
+
+	/** remember event, it's written with next frame */
+	void AddEvent(EVehicleGameEvent::Type Type, AActor* Vehicle, int32 Value);
+
+private:
+
+	/** get id of vehicle, describing it in replay when seen first time */
+	int32 GetVehicleId(AActor* Vehicle);
+
+	/** write chunk header and payload */
+	void WriteChunk(uint8 Type, float Time, const TArray<uint8>& Payload);
+
+	TSharedPtr<FVehicleReplayWriter> Writer;
+
+	/** stopped writers still closing their files */
+	TArray<TSharedPtr<FVehicleReplayWriter> > ClosingWriters;
+
+	/** delete writers that closed their files */
+	void ReleaseClosedWriters();
+
+	/** ids of recorded vehicles */
+	TMap<TWeakObjectPtr<AActor>, int32> VehicleIds;
+	int32 NextVehicleId;
+
+	/** base for delta of next frame */
+	FVehicleReplayFrame LastFrame;
+
+	/** number of deltas written since last keyframe, INDEX_NONE before first frame */
+	int32 FramesSinceKeyframe;
+
+	/** events waiting for next frame */
+	TArray<FVehicleReplayEvent> PendingEvents;
+
+	/** time of frame being recorded, for vehicle description chunks */
+	float CurrentTime;
+};
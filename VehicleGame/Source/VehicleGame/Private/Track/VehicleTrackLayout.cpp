@@ -0,0 +1,425 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "VehicleGame.h"
+
+namespace VehicleTrackLayout
+{
+	/** order points by name, numeric suffix compared as number so Point_2 goes before Point_10 */
+	bool IsNameBefore(const AVehicleTrackPoint& A, const AVehicleTrackPoint& B)
+	{
+		const FName NameA = A.GetFName();
+		const FName NameB = B.GetFName();
+		if (NameA.GetComparisonIndex() == NameB.GetComparisonIndex())
+		{
+			return NameA.GetNumber() < NameB.GetNumber();
+		}
+		return NameA.ToString() < NameB.ToString();
+	}
+
+	/** chain points from the one closest to player starts, always stepping to nearest unvisited one */
+	void ChainByDistance(UWorld* World, TArray<AVehicleTrackPoint*>& Points)
+	{
+		int32 StartIndex = 0;
+		float BestDistSq = MAX_FLT;
+		for (TActorIterator<APlayerStart> It(World); It; ++It)
+		{
+			for (int32 i = 0; i < Points.Num(); i++)
+			{
+				const float DistSq = FVector::DistSquared(It->GetActorLocation(), Points[i]->GetActorLocation());
+				if (DistSq < BestDistSq)
+				{
+					BestDistSq = DistSq;
+					StartIndex = i;
+				}
+			}
+		}
+
+		// few dozen points at most, quadratic search is fine
+		Points.Swap(0, StartIndex);
+		for (int32 i = 1; i < Points.Num(); i++)
+		{
+			const FVector Location = Points[i - 1]->GetActorLocation();
+			int32 NearestIndex = i;
+			for (int32 j = i + 1; j < Points.Num(); j++)
+			{
+				if (FVector::DistSquared(Location, Points[j]->GetActorLocation()) < FVector::DistSquared(Location, Points[NearestIndex]->GetActorLocation()))
+				{
+					NearestIndex = j;
+				}
+			}
+			Points.Swap(i, NearestIndex);
+		}
+
+		// drive in direction start point faces
+		if (Points.Num() > 2)
+		{
+			const FVector StartDirection = Points[0]->GetActorForwardVector();
+			if (((Points[1]->GetActorLocation() - Points[0]->GetActorLocation()) | StartDirection) < 0.0f)
+			{
+				for (int32 i = 1, j = Points.Num() - 1; i < j; i++, j--)
+				{
+					Points.Swap(i, j);
+				}
+			}
+		}
+	}
+}
+
+void FVehicleTrackLayout::Build(UWorld* World)
+{
+	TrackPoints.Reset();
+	PointDistances.Reset();
+	Gates.Reset();
+	Samples.Reset();
+	Nodes.Reset();
+	TrackLength = 0.0f;
+	bClosedLoop = false;
+
+	if (World == NULL)
+	{
+		return;
+	}
+
+	for (TActorIterator<AVehicleTrackPoint> It(World); It; ++It)
+	{
+		TrackPoints.Add(*It);
+	}
+
+	// names break ties, so every machine ends up with the same order
+	TrackPoints.Sort([](const AVehicleTrackPoint& A, const AVehicleTrackPoint& B)
+	{
+		return (A.TrackIndex != B.TrackIndex) ? (A.TrackIndex < B.TrackIndex) : VehicleTrackLayout::IsNameBefore(A, B);
+	});
+
+	// levels made before TrackIndex existed have all points at 0
+	int32 NumDuplicates = 0;
+	for (int32 i = 1; i < TrackPoints.Num(); i++)
+	{
+		if (TrackPoints[i]->TrackIndex == TrackPoints[i - 1]->TrackIndex)
+		{
+			NumDuplicates++;
+		}
+	}
+
+	if (NumDuplicates > 0)
+	{
+		UE_LOG(LogVehicle, Warning, TEXT("%d track points share TrackIndex with another one, ordering track by distance between points instead"), NumDuplicates);
+		VehicleTrackLayout::ChainByDistance(World, TrackPoints);
+	}
+
+	for (int32 i = 0; i < TrackPoints.Num(); i++)
+	{
+		const FTransform& Transform = TrackPoints[i]->GetTransform();
+		FVehicleTrackGate& Gate = Gates[Gates.AddUninitialized()];
+		Gate.Origin = Transform.GetLocation();
+		Gate.Normal = Transform.GetUnitAxis(EAxis::X);
+		Gate.Right = Transform.GetUnitAxis(EAxis::Y);
+		Gate.Up = Transform.GetUnitAxis(EAxis::Z);
+		Gate.HalfWidth = TrackPoints[i]->GateWidth * 0.5f;
+		Gate.Height = TrackPoints[i]->GateHeight;
+	}
+
+	float MaxSegmentLength = 0.0f;
+	for (int32 i = 1; i < TrackPoints.Num(); i++)
+	{
+		MaxSegmentLength = FMath::Max(MaxSegmentLength, FVector::Dist(TrackPoints[i - 1]->GetActorLocation(), TrackPoints[i]->GetActorLocation()));
+	}
+
+	// track is a loop if start is not further from finish than points are from each other
+	if (TrackPoints.Num() > 2)
+	{
+		const float ClosingLength = FVector::Dist(TrackPoints.Last()->GetActorLocation(), TrackPoints[0]->GetActorLocation());
+		bClosedLoop = (ClosingLength <= MaxSegmentLength);
+	}
+
+	if (TrackPoints.Num() > 1)
+	{
+		BuildCenterline();
+		BuildNodes(0, Samples.Num() - 1);
+	}
+}
+
+void FVehicleTrackLayout::BuildCenterline()
+{
+	const int32 NumPoints = TrackPoints.Num();
+	auto GetPoint = [&](int32 Index)
+	{
+		return TrackPoints[bClosedLoop ? (Index + NumPoints) % NumPoints : FMath::Clamp(Index, 0, NumPoints - 1)]->GetActorLocation();
+	};
+
+	// Catmull-Rom tangents, open ends just point at their neighbour
+	auto GetTangent = [&](int32 Index)
+	{
+		const bool bEndPoint = !bClosedLoop && (Index == 0 || Index == NumPoints - 1);
+		return (GetPoint(Index + 1) - GetPoint(Index - 1)) * (bEndPoint ? 1.0f : 0.5f);
+	};
+
+	// edges between samples are short enough for projection on them to stay within few cm of the curve
+	const float SampleSpacing = 200.0f;
+	const int32 NumSegments = GetNumSegments();
+	for (int32 Segment = 0; Segment < NumSegments; Segment++)
+	{
+		const FVector Start = GetPoint(Segment);
+		const FVector End = GetPoint(Segment + 1);
+		const FVector StartTangent = GetTangent(Segment);
+		const FVector EndTangent = GetTangent(Segment + 1);
+		const int32 NumSteps = FMath::Max(FMath::CeilToInt(FVector::Dist(Start, End) / SampleSpacing), 1);
+
+		for (int32 Step = 0; Step < NumSteps; Step++)
+		{
+			FVehicleTrackSample& Sample = Samples[Samples.AddUninitialized()];
+			Sample.Location = FMath::CubicInterp(Start, StartTangent, End, EndTangent, (float)Step / NumSteps);
+			if (Samples.Num() > 1)
+			{
+				TrackLength += FVector::Dist(Samples[Samples.Num() - 2].Location, Sample.Location);
+			}
+			Sample.Distance = TrackLength;
+			Sample.Segment = Segment;
+
+			if (Step == 0)
+			{
+				PointDistances.Add(TrackLength);
+			}
+		}
+	}
+
+	// last sample ends the last segment, either at first point or at last one
+	FVehicleTrackSample& LastSample = Samples[Samples.AddUninitialized()];
+	LastSample.Location = GetPoint(NumSegments);
+	TrackLength += FVector::Dist(Samples[Samples.Num() - 2].Location, LastSample.Location);
+	LastSample.Distance = TrackLength;
+	LastSample.Segment = NumSegments - 1;
+
+	if (!bClosedLoop)
+	{
+		PointDistances.Add(TrackLength);
+	}
+}
+
+int32 FVehicleTrackLayout::BuildNodes(int32 FirstEdge, int32 NumEdges)
+{
+	const int32 NodeIndex = Nodes.AddUninitialized();
+	FVehicleTrackNode& Node = Nodes[NodeIndex];
+	Node.Bounds = FBox(0);
+	Node.FirstEdge = FirstEdge;
+	Node.NumEdges = NumEdges;
+	Node.SecondChild = INDEX_NONE;
+	for (int32 i = FirstEdge; i <= FirstEdge + NumEdges; i++)
+	{
+		Node.Bounds += Samples[i].Location;
+	}
+
+	// consecutive edges are close to each other, so halving ranges gives tight boxes without sorting anything
+	const int32 MaxLeafEdges = 4;
+	if (NumEdges > MaxLeafEdges)
+	{
+		const int32 NumFirstEdges = NumEdges / 2;
+		BuildNodes(FirstEdge, NumFirstEdges);
+		const int32 SecondChild = BuildNodes(FirstEdge + NumFirstEdges, NumEdges - NumFirstEdges);
+		Nodes[NodeIndex].SecondChild = SecondChild;
+	}
+
+	return NodeIndex;
+}
+
+bool FVehicleTrackLayout::IsValid() const
+{
+	return TrackPoints.Num() > 1 && TrackLength > 0.0f;
+}
+
+int32 FVehicleTrackLayout::GetNumSegments() const
+{
+	return bClosedLoop ? TrackPoints.Num() : TrackPoints.Num() - 1;
+}
+
+FVehicleTrackPosition FVehicleTrackLayout::GetTrackPosition(const FVector& Location) const
+{
+	FVehicleTrackPosition Position;
+	if (Nodes.Num() == 0)
+	{
+		return Position;
+	}
+
+	float BestDistSq = MAX_FLT;
+	int32 BestEdge = 0;
+	FVector BestPoint = Samples[0].Location;
+
+	// depth first, closer child first, skipping boxes further than closest edge found so far
+	int32 Stack[64];
+	int32 StackSize = 0;
+	Stack[StackSize++] = 0;
+	while (StackSize > 0)
+	{
+		const int32 NodeIndex = Stack[--StackSize];
+		const FVehicleTrackNode& Node = Nodes[NodeIndex];
+		if (Node.Bounds.ComputeSquaredDistanceToPoint(Location) >= BestDistSq)
+		{
+			continue;
+		}
+
+		if (Node.SecondChild == INDEX_NONE)
+		{
+			for (int32 Edge = Node.FirstEdge; Edge < Node.FirstEdge + Node.NumEdges; Edge++)
+			{
+				const FVector ClosestPoint = FMath::ClosestPointOnSegment(Location, Samples[Edge].Location, Samples[Edge + 1].Location);
+				const float DistSq = FVector::DistSquared(Location, ClosestPoint);
+				if (DistSq < BestDistSq)
+				{
+					BestDistSq = DistSq;
+					BestEdge = Edge;
+					BestPoint = ClosestPoint;
+				}
+			}
+			continue;
+		}
+
+		const int32 FirstChild = NodeIndex + 1;
+		const bool bFirstCloser = Nodes[FirstChild].Bounds.ComputeSquaredDistanceToPoint(Location) <= Nodes[Node.SecondChild].Bounds.ComputeSquaredDistanceToPoint(Location);
+		Stack[StackSize++] = bFirstCloser ? Node.SecondChild : FirstChild;
+		Stack[StackSize++] = bFirstCloser ? FirstChild : Node.SecondChild;
+	}
+
+	const FVehicleTrackSample& EdgeStart = Samples[BestEdge];
+	const FVector Direction = (Samples[BestEdge + 1].Location - EdgeStart.Location).GetSafeNormal2D();
+	const FVector Right = FVector::CrossProduct(FVector::UpVector, Direction);
+
+	Position.Segment = EdgeStart.Segment;
+	Position.Distance = EdgeStart.Distance + FVector::Dist(EdgeStart.Location, BestPoint);
+	Position.LateralOffset = FVector::DotProduct(Location - BestPoint, Right);
+	if (bClosedLoop && Position.Distance >= TrackLength)
+	{
+		Position.Distance -= TrackLength;
+	}
+
+	return Position;
+}
+
+float FVehicleTrackLayout::GetDistanceAlongTrack(const FVector& Location) const
+{
+	return GetTrackPosition(Location).Distance;
+}
+
+float FVehicleTrackLayout::WrapDistance(float Distance) const
+{
+	Distance = bClosedLoop ? FMath::Fmod(Distance, TrackLength) : FMath::Clamp(Distance, 0.0f, TrackLength);
+	return (Distance < 0.0f) ? Distance + TrackLength : Distance;
+}
+
+int32 FVehicleTrackLayout::FindEdge(float Distance) const
+{
+	// last sample with distance not greater than requested one, but never the closing one
+	int32 Low = 0;
+	int32 High = Samples.Num() - 2;
+	while (Low < High)
+	{
+		const int32 Middle = (Low + High + 1) / 2;
+		if (Samples[Middle].Distance <= Distance)
+		{
+			Low = Middle;
+		}
+		else
+		{
+			High = Middle - 1;
+		}
+	}
+
+	return Low;
+}
+
+FVector FVehicleTrackLayout::GetLocationAtDistance(float Distance) const
+{
+	if (!IsValid())
+	{
+		return FVector::ZeroVector;
+	}
+
+	Distance = WrapDistance(Distance);
+	const int32 Edge = FindEdge(Distance);
+	const FVehicleTrackSample& EdgeStart = Samples[Edge];
+	const FVehicleTrackSample& EdgeEnd = Samples[Edge + 1];
+	const float EdgeLength = EdgeEnd.Distance - EdgeStart.Distance;
+	const float Alpha = (EdgeLength > 0.0f) ? FMath::Clamp((Distance - EdgeStart.Distance) / EdgeLength, 0.0f, 1.0f) : 0.0f;
+
+	return FMath::Lerp(EdgeStart.Location, EdgeEnd.Location, Alpha);
+}
+
+FVector FVehicleTrackLayout::GetDirectionAtDistance(float Distance) const
+{
+	if (!IsValid())
+	{
+		return FVector::ForwardVector;
+	}
+
+	Distance = WrapDistance(Distance);
+	const int32 Edge = FindEdge(Distance);
+	return (Samples[Edge + 1].Location - Samples[Edge].Location).GetSafeNormal2D();
+}
+
+void FVehicleTrackLayout::FindGateCrossings(const TArray<FVehicleGateSweep>& Sweeps, TArray<double>& OutAlphas) const
+{
+	// vehicle location is its center, while overlap triggers used to fire for any part of the body
+	const float BodyMargin = 200.0f;
+
+	OutAlphas.Reset();
+	OutAlphas.AddUninitialized(Sweeps.Num());
+	for (int32 i = 0; i < Sweeps.Num(); i++)
+	{
+		const FVehicleGateSweep& Sweep = Sweeps[i];
+		const FVehicleTrackGate& Gate = Gates[Sweep.Gate];
+
+		// only crossings from back side count, backing up through gate doesn't
+		const float StartDist = (Sweep.Start - Gate.Origin) | Gate.Normal;
+		const float EndDist = (Sweep.End - Gate.Origin) | Gate.Normal;
+		const bool bCrossed = (StartDist < 0.0f && EndDist >= 0.0f);
+		const double Alpha = bCrossed ? (double)StartDist / ((double)StartDist - EndDist) : 0.0;
+
+		const FVector Offset = FMath::Lerp(Sweep.Start, Sweep.End, (float)Alpha) - Gate.Origin;
+		const float Side = FMath::Abs(Offset | Gate.Right);
+		const float Up = Offset | Gate.Up;
+		const bool bInside = (Side <= Gate.HalfWidth + BodyMargin) && (Up >= -BodyMargin) && (Up <= Gate.Height + BodyMargin);
+
+		OutAlphas[i] = (bCrossed && bInside) ? Alpha : -1.0;
+	}
+}
+
+int32 FVehicleTrackLayout::GetNextGate(int32 TrackPointIndex) const
+{
+	if (TrackPointIndex == INDEX_NONE)
+	{
+		return Gates.Num() > 0 ? 0 : INDEX_NONE;
+	}
+
+	const int32 NextIndex = TrackPointIndex + 1;
+	return (NextIndex < Gates.Num()) ? NextIndex : (bClosedLoop ? 0 : INDEX_NONE);
+}
+
+int32 FVehicleTrackLayout::GetSectorEndPoint(int32 Sector, int32 NumSectors) const
+{
+	if (TrackPoints.Num() == 0 || NumSectors <= 0)
+	{
+		return INDEX_NONE;
+	}
+
+	// closed lap goes all the way round to the first point, open one ends at the last point
+	const int32 LapPoints = bClosedLoop ? TrackPoints.Num() : TrackPoints.Num() - 1;
+	return FMath::RoundToInt((float)((Sector + 1) * LapPoints) / NumSectors) % TrackPoints.Num();
+}
+
+float FVehicleTrackLayout::GetTrackGap(float FromDistance, float ToDistance) const
+{
+	float Gap = ToDistance - FromDistance;
+	if (bClosedLoop && TrackLength > 0.0f)
+	{
+		Gap = FMath::Fmod(Gap, TrackLength);
+		if (Gap > TrackLength * 0.5f)
+		{
+			Gap -= TrackLength;
+		}
+		else if (Gap < -TrackLength * 0.5f)
+		{
+			Gap += TrackLength;
+		}
+	}
+
+	return Gap;
+}
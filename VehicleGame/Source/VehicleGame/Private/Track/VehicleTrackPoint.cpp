@@ -8,14 +8,10 @@ AVehicleTrackPoint::AVehicleTrackPoint(const FObjectInitializer& ObjectInitializ
 	USceneComponent* SceneComponent = ObjectInitializer.CreateDefaultSubobject<USceneComponent>(this, TEXT("SceneComp"));
 	RootComponent = SceneComponent;
 
-	UBoxComponent* TriggerComponent = ObjectInitializer.CreateDefaultSubobject<UBoxComponent>(this, TEXT("TriggerComp"));
-	TriggerComponent->InitBoxExtent(FVector(50.0f, 1000.0f, 200.0f));
-	TriggerComponent->RelativeLocation.Z = 200.0f;
-	TriggerComponent->SetCollisionObjectType(COLLISION_PICKUP);
-	TriggerComponent->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
-	TriggerComponent->SetCollisionResponseToAllChannels(ECR_Ignore);
-	TriggerComponent->SetCollisionResponseToChannel(ECC_Vehicle, ECR_Overlap);
-	TriggerComponent->AttachParent = RootComponent;
+	// crossing is tested by game mode against gate, point doesn't need any collision
+	TrackIndex = 0;
+	GateWidth = 2000.0f;
+	GateHeight = 400.0f;
 
 #if WITH_EDITORONLY_DATA
 	SpriteComponent = ObjectInitializer.CreateEditorOnlyDefaultSubobject<UBillboardComponent>(this, TEXT("Sprite"));
@@ -44,32 +40,22 @@ AVehicleTrackPoint::AVehicleTrackPoint(const FObjectInitializer& ObjectInitializ
 			SpriteComponent->RelativeScale3D = FVector(3.0f, 3.0f, 3.0f);
 			SpriteComponent->SpriteInfo.Category = ConstructorStatics.ID_Track;
 			SpriteComponent->SpriteInfo.DisplayName = ConstructorStatics.NAME_Track;
-			SpriteComponent->AttachParent = TriggerComponent;
+			SpriteComponent->RelativeLocation = FVector(0, 0, 200.0f);
+			SpriteComponent->AttachParent = RootComponent;
 			SpriteComponent->bIsScreenSizeScaled = true;
 		}
 
 		if (ArrowComponent)
 		{
 			ArrowComponent->ArrowColor = FColor(150, 200, 255);
-			ArrowComponent->RelativeLocation = FVector(50.0f, 0, 0);
+			ArrowComponent->RelativeLocation = FVector(50.0f, 0, 200.0f);
 			ArrowComponent->ArrowSize = 5.0f;
 			ArrowComponent->bTreatAsASprite = true;
 			ArrowComponent->SpriteInfo.Category = ConstructorStatics.ID_Track;
 			ArrowComponent->SpriteInfo.DisplayName = ConstructorStatics.NAME_Track;
-			ArrowComponent->AttachParent = TriggerComponent;
+			ArrowComponent->AttachParent = RootComponent;
 			ArrowComponent->bIsScreenSizeScaled = true;
 		}
 	}
 #endif // WITH_EDITORONLY_DATA
 }
-
-void AVehicleTrackPoint::ReceiveActorBeginOverlap(class AActor* Other)
-{
-	Super::ReceiveActorBeginOverlap(Other);
-
-	ABuggyPawn* OtherVehicle = Cast<ABuggyPawn>(Other);
-	if (OtherVehicle)
-	{
-		OtherVehicle->OnTrackPointReached(this);
-	}
-}
@@ -7,31 +7,45 @@
 #include "Menu/VehicleMenuItem.h"
 #include "Widgets/SVehicleControlsSetup.h"
 #include "VehicleMenuSoundsWidgetStyle.h"
+#include "VehicleLeaderboard.h"
 
 #define LOCTEXT_NAMESPACE "VehicleGame.HUD.Menu"
 
 AVehicleHUD::AVehicleHUD(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
-	static ConstructorHelpers::FObjectFinder<UMaterialInstanceConstant> SpeedMeterObj(TEXT("/Game/UI/HUD/Materials/M_VH_HUD_SpeedMeter_UI"));
+	// dedicated server constructs the class default object too, but never draws - keep HUD assets out of its memory
+	if (!IsRunningDedicatedServer())
+	{
+		static ConstructorHelpers::FObjectFinder<UMaterialInstanceConstant> SpeedMeterObj(TEXT("/Game/UI/HUD/Materials/M_VH_HUD_SpeedMeter_UI"));
 
-	static ConstructorHelpers::FObjectFinder<UFont> HUDFontOb(TEXT("/Game/UI/HUD/UI_Vehicle_Font"));
+		static ConstructorHelpers::FObjectFinder<UFont> HUDFontOb(TEXT("/Game/UI/HUD/UI_Vehicle_Font"));
 
-	static ConstructorHelpers::FObjectFinder<UTexture2D> TimerBgObj(TEXT("/Game/UI/HUD/Background/T_VH_Hud_Timer_Background"));
-	static ConstructorHelpers::FObjectFinder<UTexture2D> PlaceBgObj(TEXT("/Game/UI/HUD/Background/T_VH_Hud_Place_Background"));
+		static ConstructorHelpers::FObjectFinder<UTexture2D> TimerBgObj(TEXT("/Game/UI/HUD/Background/T_VH_Hud_Timer_Background"));
+		static ConstructorHelpers::FObjectFinder<UTexture2D> PlaceBgObj(TEXT("/Game/UI/HUD/Background/T_VH_Hud_Place_Background"));
 
 
-	static ConstructorHelpers::FObjectFinder<UTexture2D> UpButtonTextureOb(TEXT("/Game/UI/HUD/UpButton"));
-	static ConstructorHelpers::FObjectFinder<UTexture2D> DownButtonTextureOb(TEXT("/Game/UI/HUD/DownButton"));
+		static ConstructorHelpers::FObjectFinder<UTexture2D> UpButtonTextureOb(TEXT("/Game/UI/HUD/UpButton"));
+		static ConstructorHelpers::FObjectFinder<UTexture2D> DownButtonTextureOb(TEXT("/Game/UI/HUD/DownButton"));
 
-	UpButtonTexture = UpButtonTextureOb.Object;
-	DownButtonTexture = DownButtonTextureOb.Object;
+		UpButtonTexture = UpButtonTextureOb.Object;
+		DownButtonTexture = DownButtonTextureOb.Object;
 
-	HUDFont = HUDFontOb.Object;
+		HUDFont = HUDFontOb.Object;
 
-	TimerBackground = TimerBgObj.Object;
-	PlaceBackground = PlaceBgObj.Object;
+		TimerBackground = TimerBgObj.Object;
+		PlaceBackground = PlaceBgObj.Object;
 	
-	SpeedMeterMaterialConst = SpeedMeterObj.Object;
+		SpeedMeterMaterialConst = SpeedMeterObj.Object;
+	}
+	else
+	{
+		UpButtonTexture = NULL;
+		DownButtonTexture = NULL;
+		HUDFont = NULL;
+		TimerBackground = NULL;
+		PlaceBackground = NULL;
+		SpeedMeterMaterialConst = NULL;
+	}
 
 
 	LowHighList.Add(LOCTEXT("LowQuality","LOW QUALITY"));
@@ -41,13 +55,32 @@ AVehicleHUD::AVehicleHUD(const FObjectInitializer& ObjectInitializer) : Super(Ob
 
 	CurrentLetter = 0;
 	bEnterNamePromptActive = false;
+	bHighscoreSubmitted = false;
 	bDrawHUD = true;
 }
 
 
 void AVehicleHUD::BeginPlay()
 {
-	SpeedMeterMaterial = UMaterialInstanceDynamic::Create(SpeedMeterMaterialConst, NULL);
+	if (SpeedMeterMaterialConst != NULL)
+	{
+		SpeedMeterMaterial = UMaterialInstanceDynamic::Create(SpeedMeterMaterialConst, NULL);
+	}
+
+	if (!IsRunningDedicatedServer())
+	{
+		// nothing is read yet, records are loaded on worker thread when leaderboard is first drawn
+		const FString MapName = UWorld::RemovePIEPrefix(GetWorld()->GetMapName());
+		Leaderboard = MakeShareable(new FVehicleLeaderboard(FPaths::GameSavedDir() / TEXT("Leaderboards") / MapName + TEXT(".vlb")));
+	}
+}
+
+void AVehicleHUD::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// stops worker thread and flushes pending records now, instead of whenever garbage collector gets to HUD
+	Leaderboard.Reset();
+
+	Super::EndPlay(EndPlayReason);
 }
 
 void AVehicleHUD::DrawHUD()
@@ -58,6 +91,299 @@ void AVehicleHUD::DrawHUD()
 	{
 		FString NetModeDesc = (GetNetMode() == NM_Client) ? TEXT("Client") : TEXT("Server");
 		DrawDebugInfoString(NetModeDesc, 256.0f,32.0f, true, true, FLinearColor::White);
+
+		if (GetNetMode() == NM_ListenServer)
+		{
+			DrawInputStats();
+		}
+	}
+
+	if (bDrawHUD)
+	{
+		DrawRacePosition();
+		DrawLapTimes();
+		DrawEventMessages();
+
+		// ask for name once local player finishes
+		AVehiclePlayerState* VehiclePlayerState = PlayerOwner ? Cast<AVehiclePlayerState>(PlayerOwner->PlayerState) : NULL;
+		if (Leaderboard.IsValid() && !bHighscoreSubmitted && !bEnterNamePromptActive && VehiclePlayerState && VehiclePlayerState->GetFinishTime() > 0.0f)
+		{
+			HighScoreName.Init('A', 3);
+			CurrentLetter = 0;
+			bEnterNamePromptActive = true;
+			PlayerOwner->bShowMouseCursor = true;
+			PlayerOwner->bEnableClickEvents = true;
+		}
+
+		if (bEnterNamePromptActive)
+		{
+			DrawHighscorePrompt();
+		}
+		else if (bHighscoreSubmitted)
+		{
+			DrawLeaderboard();
+		}
+	}
+}
+
+void AVehicleHUD::OnGameEvent(const FVehicleGameEvent& Event)
+{
+	const APlayerState* EventPlayerState = Cast<APlayerState>(Event.Actor.Get());
+	const FText PlayerName = FText::FromString(EventPlayerState ? EventPlayerState->PlayerName : FString());
+
+	FText Text;
+	switch (Event.Type)
+	{
+	case EVehicleGameEvent::RaceStarted:		Text = LOCTEXT("RaceStarted", "RACE STARTED"); break;
+	case EVehicleGameEvent::RaceFinished:		Text = LOCTEXT("RaceFinished", "RACE FINISHED"); break;
+	case EVehicleGameEvent::TrackPointReached:	Text = FText::Format(LOCTEXT("TrackPointReached", "CHECKPOINT {0}"), FText::AsNumber(Event.Value + 1)); break;
+	case EVehicleGameEvent::VehicleDied:		Text = FText::Format(LOCTEXT("VehicleDied", "{0} CRASHED"), PlayerName); break;
+	default:									return;
+	}
+
+	const int32 MaxMessages = 4;
+	if (EventMessages.Num() >= MaxMessages)
+	{
+		EventMessages.RemoveAt(0);
+	}
+
+	FVehicleHUDMessage Message;
+	Message.Text = Text;
+	Message.Time = GetWorld()->GetTimeSeconds();
+	EventMessages.Add(Message);
+}
+
+void AVehicleHUD::DrawEventMessages()
+{
+	const float MessageLifetime = 4.0f;
+	const float CurrentTime = GetWorld()->GetTimeSeconds();
+	while (EventMessages.Num() > 0 && CurrentTime - EventMessages[0].Time > MessageLifetime)
+	{
+		EventMessages.RemoveAt(0);
+	}
+
+	UFont* Font = HUDFont ? HUDFont : GEngine->GetMediumFont();
+	float PosY = Canvas->ClipY * 0.2f;
+	for (int32 i = 0; i < EventMessages.Num(); i++)
+	{
+		float SizeX, SizeY;
+		Canvas->StrLen(Font, EventMessages[i].Text.ToString(), SizeX, SizeY);
+
+		// fade out during last second
+		const float Alpha = FMath::Clamp(MessageLifetime - (CurrentTime - EventMessages[i].Time), 0.0f, 1.0f);
+		FCanvasTextItem TextItem(FVector2D((Canvas->ClipX - SizeX * UIScale) * 0.5f, PosY), EventMessages[i].Text, Font, FLinearColor(1.0f, 1.0f, 1.0f, Alpha));
+		TextItem.Scale = FVector2D(UIScale, UIScale);
+		TextItem.EnableShadow(FLinearColor::Black);
+		Canvas->DrawItem(TextItem);
+		PosY += SizeY * UIScale;
+	}
+}
+
+void AVehicleHUD::DrawRacePosition()
+{
+	AVehicleGameState* GameState = GetWorld()->GetGameState<AVehicleGameState>();
+	const int32 Position = (GameState && PlayerOwner) ? GameState->GetRacePosition(PlayerOwner->PlayerState) : 0;
+	if (Position <= 0 || PlaceBackground == NULL)
+	{
+		return;
+	}
+
+	const float Offset = 32.0f * UIScale;
+	const FVector2D BackgroundSize(PlaceBackground->GetSurfaceWidth() * UIScale, PlaceBackground->GetSurfaceHeight() * UIScale);
+	const FVector2D BackgroundPos(Canvas->ClipX - BackgroundSize.X - Offset, Offset);
+	FCanvasTileItem TileItem(BackgroundPos, PlaceBackground->Resource, BackgroundSize, FLinearColor::White);
+	TileItem.BlendMode = SE_BLEND_Translucent;
+	Canvas->DrawItem(TileItem);
+
+	UFont* Font = HUDFont ? HUDFont : GEngine->GetMediumFont();
+	const FText PlaceText = FText::Format(LOCTEXT("RacePosition", "{0}/{1}"), FText::AsNumber(Position), FText::AsNumber(GameState->GetNumRankedRacers()));
+	float SizeX, SizeY;
+	Canvas->StrLen(Font, PlaceText.ToString(), SizeX, SizeY);
+
+	FCanvasTextItem TextItem(BackgroundPos + (BackgroundSize - FVector2D(SizeX, SizeY) * UIScale) * 0.5f, PlaceText, Font, FLinearColor::White);
+	TextItem.Scale = FVector2D(UIScale, UIScale);
+	TextItem.EnableShadow(FLinearColor::Black);
+	Canvas->DrawItem(TextItem);
+}
+
+namespace VehicleHUD
+{
+	/** format time as m:ss.mmm, or dashes if it's not known */
+	FString FormatLapTime(float Time)
+	{
+		if (Time <= 0.0f)
+		{
+			return TEXT("-:--.---");
+		}
+
+		const int32 TimeMs = FMath::RoundToInt(Time * 1000.0f);
+		return FString::Printf(TEXT("%d:%02d.%03d"), TimeMs / 60000, (TimeMs / 1000) % 60, TimeMs % 1000);
+	}
+}
+
+void AVehicleHUD::DrawLapTimes()
+{
+	AVehicleGameState* GameState = GetWorld()->GetGameState<AVehicleGameState>();
+	AVehiclePlayerState* VehiclePlayerState = PlayerOwner ? Cast<AVehiclePlayerState>(PlayerOwner->PlayerState) : NULL;
+	if (GameState == NULL || VehiclePlayerState == NULL || GameState->RaceStartServerTime <= 0.0f)
+	{
+		return;
+	}
+
+	TArray<FString> Lines;
+	TArray<FLinearColor> Colors;
+	const float CurrentLapTime = (VehiclePlayerState->GetFinishTime() > 0.0f) ? 0.0f : GameState->GetTotalTime() - VehiclePlayerState->GetLapStartTime();
+	Lines.Add(FString::Printf(TEXT("LAP %d  %s"), VehiclePlayerState->GetLap() + 1, *VehicleHUD::FormatLapTime(CurrentLapTime)));
+	Colors.Add(FLinearColor::White);
+	Lines.Add(FString::Printf(TEXT("LAST %s"), *VehicleHUD::FormatLapTime(VehiclePlayerState->GetLastLapTime())));
+	Colors.Add(FLinearColor::White);
+	Lines.Add(FString::Printf(TEXT("BEST %s"), *VehicleHUD::FormatLapTime(VehiclePlayerState->GetBestLapTime())));
+	Colors.Add(FLinearColor::White);
+
+	// sectors of last lap, personal bests highlighted
+	for (int32 Sector = 0; Sector < FVehicleRaceProgress::NumSectors; Sector++)
+	{
+		const float SectorTime = VehiclePlayerState->GetLastSectorTime(Sector);
+		const bool bPersonalBest = SectorTime > 0.0f && SectorTime <= VehiclePlayerState->GetBestSectorTime(Sector);
+		Lines.Add(FString::Printf(TEXT("S%d %s"), Sector + 1, *VehicleHUD::FormatLapTime(SectorTime)));
+		Colors.Add(bPersonalBest ? FLinearColor::Green : FLinearColor::White);
+	}
+
+	UFont* Font = HUDFont ? HUDFont : GEngine->GetMediumFont();
+	const float Offset = 32.0f * UIScale;
+	float PosY = Offset + (PlaceBackground ? PlaceBackground->GetSurfaceHeight() * UIScale + Offset : 0.0f);
+	for (int32 i = 0; i < Lines.Num(); i++)
+	{
+		float SizeX, SizeY;
+		Canvas->StrLen(Font, Lines[i], SizeX, SizeY);
+
+		FCanvasTextItem TextItem(FVector2D(Canvas->ClipX - SizeX * UIScale - Offset, PosY), FText::FromString(Lines[i]), Font, Colors[i]);
+		TextItem.Scale = FVector2D(UIScale, UIScale);
+		TextItem.EnableShadow(FLinearColor::Black);
+		Canvas->DrawItem(TextItem);
+		PosY += SizeY * UIScale;
+	}
+}
+
+void AVehicleHUD::DrawHighscorePrompt()
+{
+	UFont* Font = HUDFont ? HUDFont : GEngine->GetMediumFont();
+	float LetterSizeX, LetterSizeY;
+	Canvas->StrLen(Font, TEXT("W"), LetterSizeX, LetterSizeY);
+
+	const FVector2D LetterSize(LetterSizeX * UIScale * 1.5f, LetterSizeY * UIScale);
+	const float ButtonsSizeY = (UpButtonTexture ? UpButtonTexture->GetSurfaceHeight() * UIScale : 0.0f) + (DownButtonTexture ? DownButtonTexture->GetSurfaceHeight() * UIScale : 0.0f);
+	FVector2D Pos((Canvas->ClipX - LetterSize.X * (HighScoreName.Num() + 2)) * 0.5f, (Canvas->ClipY - LetterSize.Y - ButtonsSizeY) * 0.5f);
+
+	const FText Title = LOCTEXT("EnterName", "ENTER YOUR NAME");
+	float TitleSizeX, TitleSizeY;
+	Canvas->StrLen(Font, Title.ToString(), TitleSizeX, TitleSizeY);
+	FCanvasTextItem TitleItem(FVector2D((Canvas->ClipX - TitleSizeX * UIScale) * 0.5f, Pos.Y - TitleSizeY * UIScale * 1.5f), Title, Font, FLinearColor::White);
+	TitleItem.Scale = FVector2D(UIScale, UIScale);
+	TitleItem.EnableShadow(FLinearColor::Black);
+	Canvas->DrawItem(TitleItem);
+
+	for (int32 i = 0; i < HighScoreName.Num(); i++)
+	{
+		const FVector2D LetterPos(Pos.X + LetterSize.X * i, Pos.Y);
+		FCanvasTextItem TextItem(LetterPos, FText::FromString(FString::Chr(HighScoreName[i])), Font, (i == CurrentLetter) ? FLinearColor::Yellow : FLinearColor::White);
+		TextItem.Scale = FVector2D(UIScale, UIScale);
+		TextItem.EnableShadow(FLinearColor::Black);
+		Canvas->DrawItem(TextItem);
+		AddHitBox(LetterPos, LetterSize, FName(TEXT("Letter"), i), true);
+	}
+
+	// buttons change selected letter
+	FVector2D ButtonPos(Pos.X + LetterSize.X * CurrentLetter, Pos.Y + LetterSize.Y);
+	UTexture2D* const Buttons[] = { UpButtonTexture, DownButtonTexture };
+	const TCHAR* const ButtonNames[] = { TEXT("Up"), TEXT("Down") };
+	for (int32 i = 0; i < ARRAY_COUNT(Buttons); i++)
+	{
+		if (Buttons[i])
+		{
+			const FVector2D ButtonSize(Buttons[i]->GetSurfaceWidth() * UIScale, Buttons[i]->GetSurfaceHeight() * UIScale);
+			FCanvasTileItem TileItem(ButtonPos, Buttons[i]->Resource, ButtonSize, FLinearColor::White);
+			TileItem.BlendMode = SE_BLEND_Translucent;
+			Canvas->DrawItem(TileItem);
+			AddHitBox(ButtonPos, ButtonSize, ButtonNames[i], true);
+			ButtonPos.Y += ButtonSize.Y;
+		}
+	}
+
+	const FVector2D OKPos(Pos.X + LetterSize.X * (HighScoreName.Num() + 1), Pos.Y);
+	FCanvasTextItem OKItem(OKPos, LOCTEXT("OK", "OK"), Font, FLinearColor::Green);
+	OKItem.Scale = FVector2D(UIScale, UIScale);
+	OKItem.EnableShadow(FLinearColor::Black);
+	Canvas->DrawItem(OKItem);
+	AddHitBox(OKPos, FVector2D(LetterSize.X * 2.0f, LetterSize.Y), TEXT("OK"), true);
+}
+
+void AVehicleHUD::DrawLeaderboard()
+{
+	// queries only read records in memory, file is loaded on worker thread
+	const int32 MaxShownRecords = 10;
+	TArray<FVehicleLeaderboardEntry> Entries;
+	int32 Rank = 0;
+	const bool bLoaded = Leaderboard->GetTopRecords(EVehicleLeaderboardCategory::RaceTime, MaxShownRecords, Entries)
+		&& Leaderboard->GetPlayerRank(EVehicleLeaderboardCategory::RaceTime, SubmittedName, Rank);
+
+	TArray<FString> Lines;
+	Lines.Add(TEXT("BEST TIMES"));
+	if (!bLoaded)
+	{
+		Lines.Add(TEXT("LOADING"));
+	}
+	for (int32 i = 0; i < Entries.Num(); i++)
+	{
+		Lines.Add(FString::Printf(TEXT("%2d. %-3s %s"), i + 1, *Entries[i].PlayerName, *VehicleHUD::FormatLapTime(Entries[i].Time)));
+	}
+	if (Rank > 0)
+	{
+		Lines.Add(FString::Printf(TEXT("YOUR RANK %d"), Rank));
+	}
+
+	UFont* Font = HUDFont ? HUDFont : GEngine->GetMediumFont();
+	float PosY = Canvas->ClipY * 0.35f;
+	for (int32 i = 0; i < Lines.Num(); i++)
+	{
+		float SizeX, SizeY;
+		Canvas->StrLen(Font, Lines[i], SizeX, SizeY);
+
+		FCanvasTextItem TextItem(FVector2D((Canvas->ClipX - SizeX * UIScale) * 0.5f, PosY), FText::FromString(Lines[i]), Font, FLinearColor::White);
+		TextItem.Scale = FVector2D(UIScale, UIScale);
+		TextItem.EnableShadow(FLinearColor::Black);
+		Canvas->DrawItem(TextItem);
+		PosY += SizeY * UIScale;
+	}
+}
+
+void AVehicleHUD::DrawInputStats()
+{
+	FVehicleInputStats Total;
+	int32 NumVehicles = 0;
+	for (FConstPawnIterator It = GetWorld()->GetPawnIterator(); It; ++It)
+	{
+		AWheeledVehicle* Vehicle = Cast<AWheeledVehicle>(*It);
+		UVehicleMovementComponentBoosted4w* BoostedMovement = Vehicle ? Cast<UVehicleMovementComponentBoosted4w>(Vehicle->GetVehicleMovement()) : NULL;
+		if (BoostedMovement == NULL || Vehicle->IsLocallyControlled())
+		{
+			continue;
+		}
+
+		const FVehicleInputStats& Stats = BoostedMovement->GetInputStats();
+		Total.NumReceivedFrames += Stats.NumReceivedFrames;
+		Total.NumLostFrames += Stats.NumLostFrames;
+		Total.NumLateBatches += Stats.NumLateBatches;
+		Total.NumSkippedFrames += Stats.NumSkippedFrames;
+		Total.NumStarvedUpdates += Stats.NumStarvedUpdates;
+		NumVehicles++;
+	}
+
+	if (NumVehicles > 0)
+	{
+		const FString InputDesc = FString::Printf(TEXT("Input of %d: received %d, lost %d, late %d, skipped %d, starved %d"), NumVehicles,
+			Total.NumReceivedFrames, Total.NumLostFrames, Total.NumLateBatches, Total.NumSkippedFrames, Total.NumStarvedUpdates);
+		DrawDebugInfoString(InputDesc, 256.0f, 48.0f, true, true, FLinearColor::White);
 	}
 }
 
@@ -111,6 +437,7 @@ void AVehicleHUD::ReceiveHitBoxClick(const FName BoxName)
 		if (PlayerOwner)
 		{
 			PlayerOwner->bShowMouseCursor = bEnterNamePromptActive;
+			PlayerOwner->bEnableClickEvents = bEnterNamePromptActive;
 		}
 
 		FString EnteredName = FString();
@@ -119,6 +446,19 @@ void AVehicleHUD::ReceiveHitBoxClick(const FName BoxName)
 			EnteredName.AppendChar(HighScoreName[i]);
 		}
 
+		// written on worker thread, HUD never waits for disk
+		AVehiclePlayerState* VehiclePlayerState = PlayerOwner ? Cast<AVehiclePlayerState>(PlayerOwner->PlayerState) : NULL;
+		if (Leaderboard.IsValid() && VehiclePlayerState && !bHighscoreSubmitted)
+		{
+			Leaderboard->AddRecord(EVehicleLeaderboardCategory::RaceTime, EnteredName, VehiclePlayerState->GetFinishTime());
+			if (VehiclePlayerState->GetBestLapTime() > 0.0f)
+			{
+				Leaderboard->AddRecord(EVehicleLeaderboardCategory::BestLap, EnteredName, VehiclePlayerState->GetBestLapTime());
+			}
+
+			SubmittedName = EnteredName;
+			bHighscoreSubmitted = true;
+		}
 	}
 }
 
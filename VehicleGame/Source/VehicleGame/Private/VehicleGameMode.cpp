@@ -2,15 +2,43 @@
 
 #include "VehicleGame.h"
 #include "Landscape.h"
+#include "VehicleNetStats.h"
+#include "VehicleReplayRecorder.h"
+#include "VehicleTestHarness.h"
+
+const float AVehicleGameMode::PlayerStartOccupancyRadius = 100.0f;
 
 AVehicleGameMode::AVehicleGameMode(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
 	RaceStartTime = 0;
 	RaceFinishTime = 0;	
+	ServerClock = 0.0;
+	ServerClockFrame = 0;
+	RaceStartClock = 0.0;
 	bLockingActive = false;
+	VehicleNetUpdateBudget = 900.0f;
+
+	NumRaceLaps = 1;
+
+	GameEventSendInterval = 0.05f;
+	ImpactEventRadius = 10000.0f;
+	LastGameEventSendTime = 0.0f;
+
+	bRecordReplays = true;
+	ReplaySampleInterval = 0.05f;
+	LastReplaySampleTime = 0.0f;
+
+	// replay viewer only watches
+	FParse::Value(FCommandLine::Get(), TEXT("VehicleReplay="), ReplayFilename);
+	bStartPlayersAsSpectators = ReplayFilename.Len() > 0;
+
+	NextSpawnSlotsId = 0;
+	NumGridPlayerStarts = 0;
+	PlayerStartOccupancyFrame = 0;
 
 	MinRespawnDelay = 0.01f;
 	GameStateClass = AVehicleGameState::StaticClass();
+	PlayerStateClass = AVehiclePlayerState::StaticClass();
 	if ((GEngine != NULL ) && ( GEngine->GameViewport != NULL))
 	{
 		GEngine->GameViewport->SetSuppressTransitionMessage( true );
@@ -26,73 +54,99 @@ void AVehicleGameMode::HandleMatchHasStarted()
 
 AActor* AVehicleGameMode::ChoosePlayerStart(AController* Player)
 {
-	APlayerStart* BestStart = NULL;
+	UpdatePlayerStartOccupancy();
 
 	// find first non occupied start
-	for (int32 i = 0; i < PlayerStarts.Num(); i++)
+	APlayerStart* BestStart = NULL;
+	const int32 FreeIndex = PlayerStartOccupancy.Find(false);
+	if (FreeIndex != INDEX_NONE)
 	{
-		APlayerStart* TestSpot = PlayerStarts[i];
+		BestStart = PlayerStarts[FreeIndex];
 
-		bool bBlocked = false;
-		for (FConstPawnIterator It = GetWorld()->GetPawnIterator(); It; ++It)
+		// pawn spawned there isn't in occupancy until next frame, whole grid may log in at once
+		PlayerStartOccupancy[FreeIndex] = true;
+	}
+
+	return BestStart ? BestStart : Super::ChoosePlayerStart(Player);
+}
+
+void AVehicleGameMode::UpdatePlayerStartOccupancy()
+{
+	if (PlayerStartOccupancyFrame == GFrameCounter && PlayerStartOccupancy.Num() == PlayerStarts.Num())
+	{
+		return;
+	}
+	PlayerStartOccupancyFrame = GFrameCounter;
+
+	// starts are placed in level, grid only changes when streaming adds or removes some
+	if (NumGridPlayerStarts != PlayerStarts.Num())
+	{
+		NumGridPlayerStarts = PlayerStarts.Num();
+		PlayerStartGrid.Empty(PlayerStarts.Num());
+		for (int32 i = 0; i < PlayerStarts.Num(); i++)
 		{
-			if (*It != NULL && ((*It)->GetActorLocation() - TestSpot->GetActorLocation()).SizeSquared2D() < 10000)
-			{
-				bBlocked = true;
-				break;
-			}
+			const FVector Location = PlayerStarts[i]->GetActorLocation();
+			PlayerStartGrid.Add(FIntPoint(FMath::FloorToInt(Location.X / PlayerStartOccupancyRadius), FMath::FloorToInt(Location.Y / PlayerStartOccupancyRadius)), i);
 		}
-		
-		if (!bBlocked)
+	}
+
+	PlayerStartOccupancy.Init(false, PlayerStarts.Num());
+
+	// each pawn checks starts in its cell and the 8 around it, cost doesn't depend on number of starts
+	TArray<int32, TInlineAllocator<8> > CellStarts;
+	for (FConstPawnIterator It = GetWorld()->GetPawnIterator(); It; ++It)
+	{
+		if (*It == NULL)
 		{
-			BestStart = TestSpot;
-			break;
+			continue;
 		}
-	}
 
-	return BestStart ? BestStart : Super::ChoosePlayerStart(Player);
+		const FVector PawnLocation = (*It)->GetActorLocation();
+		const FIntPoint PawnCell(FMath::FloorToInt(PawnLocation.X / PlayerStartOccupancyRadius), FMath::FloorToInt(PawnLocation.Y / PlayerStartOccupancyRadius));
+		for (int32 CellY = PawnCell.Y - 1; CellY <= PawnCell.Y + 1; CellY++)
+		{
+			for (int32 CellX = PawnCell.X - 1; CellX <= PawnCell.X + 1; CellX++)
+			{
+				CellStarts.Reset();
+				PlayerStartGrid.MultiFind(FIntPoint(CellX, CellY), CellStarts);
+				for (int32 i = 0; i < CellStarts.Num(); i++)
+				{
+					if ((PawnLocation - PlayerStarts[CellStarts[i]]->GetActorLocation()).SizeSquared2D() < FMath::Square(PlayerStartOccupancyRadius))
+					{
+						PlayerStartOccupancy[CellStarts[i]] = true;
+					}
+				}
+			}
+		}
+	}
 }
 
 APawn* AVehicleGameMode::SpawnDefaultPawnFor(AController* NewPlayer, class AActor* StartSpot)
 {
 	check(StartSpot);
-	bool bGotStart = false;
-	//APawn* NewPawn = Super::SpawnDefaultPawnFor(NewPlayer, StartSpot);
 	FVector StartLocation = StartSpot->GetActorLocation();
 	FRotator StartRotation(ForceInit);
 	StartRotation.Yaw = StartSpot->GetActorRotation().Yaw;
-	FRotator EachRot = StartRotation;
-	const FVector TraceOffset(0, 0, 250);
-	const float CheckSize = 600.0f;
 
-	// Check the respawn for a valid position. Initially check the first position then 4 directions from there
-	for (int32 iAngle = 0; iAngle < 5; iAngle++)
+	// slots were validated when level loaded, unknown start spot has to wait for its traces
+	FVehicleSpawnSlots* SpawnSlots = FindSpawnSlots(StartSpot);
+	if (SpawnSlots == NULL)
 	{
-		FVector NewLocation = StartLocation;
-
-		FVector RotationOffset = iAngle == 0 ? FVector::ZeroVector : FVector::ForwardVector;
-		RotationOffset *= CheckSize;
-		FVector NewOff = EachRot.RotateVector(RotationOffset);
-
-		const FVector NewPos = StartLocation + NewOff;
-		const FCollisionQueryParams TraceParams(TEXT("SpawnTrace"), true);
-		const FVector TraceStart = NewPos + TraceOffset;
-		const FVector TraceEnd = NewPos - TraceOffset;
-		FHitResult Hit;
-
-		GetWorld()->LineTraceSingle(Hit, TraceStart, TraceEnd, ECC_Vehicle, TraceParams);
+		QueueSpawn(NewPlayer, StartSpot);
+		return NULL;
+	}
 
-		if (Hit.bBlockingHit == true)
+	int32 SlotIndex = INDEX_NONE;
+	if (SpawnSlots->Slots.Num() > 0)
+	{
+		// cars dying at the same place mustn't respawn into each other, if everything is taken they wait for a slot to free up
+		SlotIndex = ReserveSpawnSlot(*SpawnSlots);
+		if (SlotIndex == INDEX_NONE)
 		{
-			ALandscape* LandObject = Cast<ALandscape>(Hit.Actor.Get());
-			if (LandObject != nullptr)
-			{
-				StartLocation = NewPos;
-				bGotStart = true;
-				break;
-			}
+			QueueSpawn(NewPlayer, StartSpot);
+			return NULL;
 		}
-		EachRot.Yaw += 90.0f;
+		StartLocation = SpawnSlots->Slots[SlotIndex];
 	}
 
 	// Move the spawn Z up a little so we drop onto the track
@@ -101,9 +155,287 @@ APawn* AVehicleGameMode::SpawnDefaultPawnFor(AController* NewPlayer, class AActo
 	SpawnInfo.Instigator = Instigator;
 	APawn* ResultPawn = GetWorld()->SpawnActor<APawn>(GetDefaultPawnClassForController(NewPlayer), StartLocation, StartRotation, SpawnInfo);
 	check(ResultPawn != NULL);
+
+	if (SlotIndex != INDEX_NONE)
+	{
+		SpawnSlots->Reservations[SlotIndex] = ResultPawn;
+	}
 	return ResultPawn;
 }
 
+void AVehicleGameMode::QueueSpawn(AController* NewPlayer, AActor* StartSpot)
+{
+	FVehicleSpawnRequest* Request = PendingSpawns.FindByPredicate([NewPlayer](const FVehicleSpawnRequest& Pending) { return Pending.Controller.Get() == NewPlayer; });
+	if (Request == NULL)
+	{
+		Request = &PendingSpawns[PendingSpawns.AddDefaulted()];
+		Request->Controller = NewPlayer;
+	}
+	Request->StartSpot = StartSpot;
+}
+
+bool AVehicleGameMode::CanSpawnAt(AActor* StartSpot)
+{
+	// start spot without landscape around is used as it is
+	FVehicleSpawnSlots* SpawnSlots = FindSpawnSlots(StartSpot);
+	return SpawnSlots && (SpawnSlots->Slots.Num() == 0 || ReserveSpawnSlot(*SpawnSlots) != INDEX_NONE);
+}
+
+void AVehicleGameMode::UpdatePendingSpawns()
+{
+	for (int32 i = 0; i < PendingSpawns.Num(); i++)
+	{
+		AController* Controller = PendingSpawns[i].Controller.Get();
+		AActor* StartSpot = PendingSpawns[i].StartSpot.Get();
+		APlayerController* PC = Cast<APlayerController>(Controller);
+		if (Controller == NULL || Controller->GetPawn() != NULL || (PC && !PlayerCanRestart(PC)))
+		{
+			PendingSpawns.RemoveAt(i--);
+		}
+		else if (StartSpot == NULL || CanSpawnAt(StartSpot))
+		{
+			// restart picks start spot again, spawn is queued again if that one isn't ready
+			PendingSpawns.RemoveAt(i--);
+			RestartPlayer(Controller);
+		}
+	}
+}
+
+int32 AVehicleGameMode::ReserveSpawnSlot(FVehicleSpawnSlots& SpawnSlots)
+{
+	// vehicle further than this from slot left it
+	const float ReleaseDistance = 500.0f;
+
+	// other vehicle closer than this blocks slot
+	const float ClearDistance = 300.0f;
+
+	// only vehicles around start spot can block its slots
+	const float SearchRadius = 2500.0f;
+	TArray<FVector, TInlineAllocator<16> > NearbyPawns;
+	for (FConstPawnIterator It = GetWorld()->GetPawnIterator(); It; ++It)
+	{
+		if (*It && !(*It)->bHidden && FVector::DistSquared2D((*It)->GetActorLocation(), SpawnSlots.StartLocation) < FMath::Square(SearchRadius))
+		{
+			NearbyPawns.Add((*It)->GetActorLocation());
+		}
+	}
+
+	for (int32 i = 0; i < SpawnSlots.Slots.Num(); i++)
+	{
+		const FVector& Slot = SpawnSlots.Slots[i];
+		APawn* ReservedBy = SpawnSlots.Reservations[i].Get();
+		if (ReservedBy && !ReservedBy->bTearOff && !ReservedBy->IsPendingKill() && FVector::DistSquared2D(ReservedBy->GetActorLocation(), Slot) < FMath::Square(ReleaseDistance))
+		{
+			continue;
+		}
+		SpawnSlots.Reservations[i] = NULL;
+
+		bool bBlocked = false;
+		for (int32 PawnIndex = 0; PawnIndex < NearbyPawns.Num() && !bBlocked; PawnIndex++)
+		{
+			bBlocked = FVector::DistSquared2D(NearbyPawns[PawnIndex], Slot) < FMath::Square(ClearDistance);
+		}
+
+		if (!bBlocked)
+		{
+			return i;
+		}
+	}
+
+	return INDEX_NONE;
+}
+
+int32 AVehicleGameMode::GetSpawnCandidates(AActor* StartSpot, FVector* OutCandidates) const
+{
+	const FVector StartLocation = StartSpot->GetActorLocation();
+	FRotator EachRot(ForceInit);
+	EachRot.Yaw = StartSpot->GetActorRotation().Yaw;
+
+	// track point: lattice of lanes across its trigger, rows behind it so respawned cars drive through it
+	AVehicleTrackPoint* TrackPoint = Cast<AVehicleTrackPoint>(StartSpot);
+	if (TrackPoint)
+	{
+		const int32 NumRows = 3;
+		const int32 NumLanes = 5;
+		const float RowSpacing = 700.0f;
+		const float LaneSpacing = 400.0f;
+		checkAtCompile(NumRows * NumLanes <= FVehicleSpawnSlots::MaxCandidates, TooManyTrackPointSpawnCandidates);
+
+		// rows follow track centerline when point is part of it, so they stay on the road in corners
+		AVehicleGameState* GameState = GetVehicleGameState();
+		const FVehicleTrackLayout* TrackLayout = GameState ? &GameState->GetTrackLayout() : NULL;
+		const int32 TrackPointIndex = (TrackLayout && TrackLayout->IsValid()) ? TrackLayout->TrackPoints.Find(TrackPoint) : INDEX_NONE;
+
+		int32 NumCandidates = 0;
+		for (int32 Row = 0; Row < NumRows; Row++)
+		{
+			FVector RowLocation = StartLocation + EachRot.RotateVector(FVector(-Row * RowSpacing, 0.0f, 0.0f));
+			FVector RowRight = EachRot.RotateVector(FVector::RightVector);
+			if (TrackPointIndex != INDEX_NONE && Row > 0)
+			{
+				const float RowDistance = TrackLayout->PointDistances[TrackPointIndex] - Row * RowSpacing;
+				RowLocation = TrackLayout->GetLocationAtDistance(RowDistance);
+				RowRight = FVector::CrossProduct(FVector::UpVector, TrackLayout->GetDirectionAtDistance(RowDistance));
+			}
+
+			for (int32 Lane = 0; Lane < NumLanes; Lane++)
+			{
+				// middle lane first, then alternating sides
+				const float LaneOffset = ((Lane + 1) / 2) * LaneSpacing * ((Lane % 2) ? -1.0f : 1.0f);
+				OutCandidates[NumCandidates++] = RowLocation + RowRight * LaneOffset;
+			}
+		}
+		return NumCandidates;
+	}
+
+	// the start spot first, then 4 directions from there
+	const float CheckSize = 600.0f;
+	const int32 NumCandidates = 5;
+	for (int32 iAngle = 0; iAngle < NumCandidates; iAngle++)
+	{
+		const FVector RotationOffset = (iAngle == 0) ? FVector::ZeroVector : FVector::ForwardVector * CheckSize;
+		OutCandidates[iAngle] = StartLocation + EachRot.RotateVector(RotationOffset);
+		EachRot.Yaw += 90.0f;
+	}
+	return NumCandidates;
+}
+
+bool AVehicleGameMode::IsSpawnCandidateValid(const FHitResult& Hit) const
+{
+	return Hit.bBlockingHit && Cast<ALandscape>(Hit.Actor.Get()) != NULL;
+}
+
+void AVehicleGameMode::BakeSpawnSlots()
+{
+	const double StartTime = FPlatformTime::Seconds();
+
+	TArray<AActor*> StartSpots;
+	for (int32 i = 0; i < PlayerStarts.Num(); i++)
+	{
+		StartSpots.Add(PlayerStarts[i]);
+	}
+	for (TActorIterator<AVehicleTrackPoint> It(GetWorld()); It; ++It)
+	{
+		StartSpots.Add(*It);
+	}
+
+	const FVector TraceOffset(0, 0, 250);
+	const FCollisionQueryParams TraceParams(TEXT("SpawnTrace"), true);
+	int32 NumSlots = 0;
+	for (int32 i = 0; i < StartSpots.Num(); i++)
+	{
+		FVehicleSpawnSlots& SpawnSlots = SpawnSlotCache.Add(StartSpots[i], FVehicleSpawnSlots());
+		SpawnSlots.Id = NextSpawnSlotsId++;
+		SpawnSlots.StartLocation = StartSpots[i]->GetActorLocation();
+
+		FVector Candidates[FVehicleSpawnSlots::MaxCandidates];
+		const int32 NumCandidates = GetSpawnCandidates(StartSpots[i], Candidates);
+		for (int32 CandidateIndex = 0; CandidateIndex < NumCandidates; CandidateIndex++)
+		{
+			FHitResult Hit;
+			GetWorld()->LineTraceSingle(Hit, Candidates[CandidateIndex] + TraceOffset, Candidates[CandidateIndex] - TraceOffset, ECC_Vehicle, TraceParams);
+			if (IsSpawnCandidateValid(Hit))
+			{
+				SpawnSlots.AddSlot(Candidates[CandidateIndex]);
+			}
+		}
+		NumSlots += SpawnSlots.Slots.Num();
+	}
+
+	UE_LOG(LogVehicle, Log, TEXT("Found %d spawn slots for %d start spots in %.1f ms"), NumSlots, StartSpots.Num(), (FPlatformTime::Seconds() - StartTime) * 1000.0);
+}
+
+FVehicleSpawnSlots* AVehicleGameMode::FindSpawnSlots(AActor* StartSpot)
+{
+	FVehicleSpawnSlots* SpawnSlots = SpawnSlotCache.Find(StartSpot);
+	if (SpawnSlots && SpawnSlots->NumPendingTraces > 0)
+	{
+		return NULL;
+	}
+
+	if (SpawnSlots && SpawnSlots->StartLocation.Equals(StartSpot->GetActorLocation(), 1.0f))
+	{
+		return SpawnSlots;
+	}
+
+	// start spot spawned or moved after level load: validate it without blocking this spawn
+	if (SpawnSlots == NULL)
+	{
+		SpawnSlots = &SpawnSlotCache.Add(StartSpot, FVehicleSpawnSlots());
+	}
+	SpawnSlots->Id = NextSpawnSlotsId++;
+	SpawnSlots->StartLocation = StartSpot->GetActorLocation();
+	SpawnSlots->Slots.Reset();
+	SpawnSlots->Reservations.Reset();
+	SpawnSlots->NumCandidates = GetSpawnCandidates(StartSpot, SpawnSlots->CandidateLocations);
+	SpawnSlots->NumPendingTraces = SpawnSlots->NumCandidates;
+
+	const FVector TraceOffset(0, 0, 250);
+	const FCollisionQueryParams TraceParams(TEXT("SpawnTrace"), true);
+	FTraceDelegate TraceDelegate;
+	TraceDelegate.BindUObject(this, &AVehicleGameMode::OnSpawnSlotTraceDone);
+	for (int32 CandidateIndex = 0; CandidateIndex < SpawnSlots->NumCandidates; CandidateIndex++)
+	{
+		const FVector& Candidate = SpawnSlots->CandidateLocations[CandidateIndex];
+		SpawnSlots->bCandidateValid[CandidateIndex] = false;
+
+		// user data tells candidate and which entry it belongs to
+		const uint32 UserData = SpawnSlots->Id * FVehicleSpawnSlots::MaxCandidates + CandidateIndex;
+		GetWorld()->AsyncLineTrace(Candidate + TraceOffset, Candidate - TraceOffset, ECC_Vehicle, TraceParams, FCollisionResponseParams::DefaultResponseParam, &TraceDelegate, UserData);
+	}
+
+	return NULL;
+}
+
+void AVehicleGameMode::OnSpawnSlotTraceDone(const FTraceHandle& TraceHandle, FTraceDatum& TraceData)
+{
+	const uint32 Id = TraceData.UserData / FVehicleSpawnSlots::MaxCandidates;
+	const int32 CandidateIndex = TraceData.UserData % FVehicleSpawnSlots::MaxCandidates;
+
+	// start spot may have moved again meanwhile, then id doesn't match anymore
+	for (TMap<TWeakObjectPtr<AActor>, FVehicleSpawnSlots>::TIterator It(SpawnSlotCache); It; ++It)
+	{
+		FVehicleSpawnSlots& SpawnSlots = It.Value();
+		if (SpawnSlots.Id != Id || SpawnSlots.NumPendingTraces <= 0)
+		{
+			continue;
+		}
+
+		SpawnSlots.bCandidateValid[CandidateIndex] = TraceData.OutHits.Num() > 0 && IsSpawnCandidateValid(TraceData.OutHits[0]);
+		SpawnSlots.NumPendingTraces--;
+		if (SpawnSlots.NumPendingTraces == 0)
+		{
+			for (int32 i = 0; i < SpawnSlots.NumCandidates; i++)
+			{
+				if (SpawnSlots.bCandidateValid[i])
+				{
+					SpawnSlots.AddSlot(SpawnSlots.CandidateLocations[i]);
+				}
+			}
+		}
+		break;
+	}
+}
+
+void AVehicleGameMode::PreLogin(const FString& Options, const FString& Address, const TSharedPtr<class FUniqueNetId>& UniqueId, FString& ErrorMessage)
+{
+	Super::PreLogin(Options, Address, UniqueId, ErrorMessage);
+
+	if (ErrorMessage.IsEmpty())
+	{
+		// forget logins that never finished
+		const double CurrentTime = FPlatformTime::Seconds();
+		for (TMultiMap<FString, double>::TIterator It(PendingLoginTimes); It; ++It)
+		{
+			if (CurrentTime - It.Value() > 300.0)
+			{
+				It.RemoveCurrent();
+			}
+		}
+		PendingLoginTimes.Add(Address, CurrentTime);
+	}
+}
+
 void AVehicleGameMode::PostLogin(APlayerController* NewPlayer)
 {
 	AVehiclePlayerController* VehiclePC = Cast<AVehiclePlayerController>(NewPlayer);
@@ -117,7 +449,72 @@ void AVehicleGameMode::PostLogin(APlayerController* NewPlayer)
 		}
 	}
 
+	if (VehiclePC && !VehiclePC->IsLocalController())
+	{
+		// players on one machine share address, oldest login is the one finishing first
+		const FString Address = VehiclePC->GetPlayerNetworkAddress();
+		TArray<double> LoginTimes;
+		PendingLoginTimes.MultiFind(Address, LoginTimes);
+		if (LoginTimes.Num() > 0)
+		{
+			LoginTimes.Sort();
+			PendingLoginTimes.RemoveSingle(Address, LoginTimes[0]);
+			VehiclePC->SetLoginStartTime(LoginTimes[0]);
+		}
+	}
+
 	Super::PostLogin(NewPlayer);
+
+	if (VehiclePC && !VehiclePC->IsLocalController() && HasRaceStarted())
+	{
+		SendRaceSnapshot(VehiclePC);
+	}
+}
+
+void AVehicleGameMode::SendRaceSnapshot(AVehiclePlayerController* VehiclePC)
+{
+	AVehicleGameState* GameState = GetVehicleGameState();
+	if (GameState == NULL)
+	{
+		return;
+	}
+
+	FVehicleRaceSnapshot Snapshot;
+	Snapshot.ServerTime = GetWorld()->GetTimeSeconds();
+	Snapshot.RaceStartServerTime = GameState->RaceStartServerTime;
+	Snapshot.RaceFinishServerTime = GameState->RaceFinishServerTime;
+	Snapshot.bIsRaceActive = GameState->bIsRaceActive;
+
+	for (int32 i = 0; i < GameState->PlayerArray.Num(); i++)
+	{
+		AVehiclePlayerState* VehiclePlayerState = Cast<AVehiclePlayerState>(GameState->PlayerArray[i]);
+		if (VehiclePlayerState == NULL || VehiclePlayerState == VehiclePC->PlayerState)
+		{
+			continue;
+		}
+
+		FVehicleRaceSnapshotRacer& Racer = Snapshot.Racers[Snapshot.Racers.Add(FVehicleRaceSnapshotRacer())];
+		Racer.PlayerId = VehiclePlayerState->PlayerId;
+		Racer.Progress = VehiclePlayerState->GetRaceProgress();
+
+		AController* Controller = Cast<AController>(VehiclePlayerState->GetOwner());
+		AWheeledVehicle* Vehicle = Controller ? Cast<AWheeledVehicle>(Controller->GetPawn()) : NULL;
+		UVehicleMovementComponentBoosted4w* BoostedMovement = Vehicle ? Cast<UVehicleMovementComponentBoosted4w>(Vehicle->GetVehicleMovement()) : NULL;
+		if (BoostedMovement && !Vehicle->bTearOff)
+		{
+			Racer.bHasVehicle = true;
+			Racer.VehicleState = BoostedMovement->GetReplicatedVehicleState();
+
+			// calm vehicles update rarely, their channels would open one by one
+			Vehicle->ForceNetUpdate();
+		}
+		VehiclePlayerState->ForceNetUpdate();
+	}
+	GameState->ForceNetUpdate();
+
+	UE_LOG(LogVehicle, Log, TEXT("Sending race snapshot with %d racers to %s"), Snapshot.Racers.Num(), *VehiclePC->GetName());
+	Snapshot.StatsClass = VehiclePC->GetClass();
+	VehiclePC->ClientReceiveRaceSnapshot(Snapshot);
 }
 
 void AVehicleGameMode::BroadcastRaceState()
@@ -140,9 +537,52 @@ void AVehicleGameMode::StartRace()
 		if (GameState != NULL)
 		{			
 			GameState->bIsRaceActive = true;
+			GameState->RaceStartServerTime = GetWorld()->GetTimeSeconds();
+			GameState->RaceFinishServerTime = 0;
+
+			for (int32 i = 0; i < GameState->PlayerArray.Num(); i++)
+			{
+				AVehiclePlayerState* VehiclePlayerState = Cast<AVehiclePlayerState>(GameState->PlayerArray[i]);
+				if (VehiclePlayerState)
+				{
+					VehiclePlayerState->ResetRaceProgress();
+				}
+			}
+		}
+
+		// everyone starts from the grid, gates crossed while waiting don't count
+		for (TMap<TWeakObjectPtr<AVehiclePlayerController>, FVehicleGateProgress>::TIterator It(GateProgress); It; ++It)
+		{
+			It.Value() = FVehicleGateProgress();
 		}
+
 		RaceStartTime = GetWorld()->GetTimeSeconds();
+		RaceStartClock = GetServerClock();
 		BroadcastRaceState();
+
+		bool bReplayStarted = false;
+		if (bRecordReplays && GetNetMode() != NM_Standalone)
+		{
+			if (!ReplayRecorder.IsValid())
+			{
+				ReplayRecorder = MakeShareable(new FVehicleReplayRecorder());
+			}
+
+			const FString MapName = GetWorld()->GetMapName();
+			const FString Filename = FPaths::GameSavedDir() / TEXT("Replays") / FString::Printf(TEXT("Race-%s-%s.vreplay"), *MapName, *FDateTime::Now().ToString());
+			bReplayStarted = ReplayRecorder->Start(Filename, MapName);
+		}
+
+		// added between replay start and its first frame, so the frame carries it
+		FVehicleGameEvent Event;
+		Event.Type = EVehicleGameEvent::RaceStarted;
+		AddGameEvent(Event);
+
+		if (bReplayStarted)
+		{
+			ReplayRecorder->RecordFrame(GetWorld());
+			LastReplaySampleTime = RaceStartTime;
+		}
 	}
 }
 
@@ -153,20 +593,343 @@ void AVehicleGameMode::FinishRace()
 		AVehicleGameState* GameState = GetGameState<AVehicleGameState>();
 		if (GameState != NULL)
 		{
+			// finish times were stamped as each racer crossed finish line, ones still racing get none
 			GameState->bIsRaceActive = false;
+			GameState->RaceFinishServerTime = GetWorld()->GetTimeSeconds();
 		}
 		RaceFinishTime = GetWorld()->GetTimeSeconds();
 		BroadcastRaceState();
+
+		FVehicleGameEvent Event;
+		Event.Type = EVehicleGameEvent::RaceFinished;
+		AddGameEvent(Event);
+
+		if (ReplayRecorder.IsValid() && ReplayRecorder->IsRecording())
+		{
+			ReplayRecorder->RecordFrame(GetWorld());
+			ReplayRecorder->Stop();
+		}
+	}
+}
+
+void AVehicleGameMode::AddGameEvent(const FVehicleGameEvent& Event)
+{
+	// replays store race events only, vehicle of racer event is found through player state's owner
+	if (ReplayRecorder.IsValid() && Event.Type != EVehicleGameEvent::Impact)
+	{
+		AActor* Vehicle = Event.Actor.Get();
+		APlayerState* EventPlayerState = Cast<APlayerState>(Vehicle);
+		if (EventPlayerState)
+		{
+			AController* Controller = Cast<AController>(EventPlayerState->GetOwner());
+			Vehicle = Controller ? Controller->GetPawn() : NULL;
+		}
+		ReplayRecorder->AddEvent((EVehicleGameEvent::Type)Event.Type, Vehicle, Event.Value);
+	}
+
+	// every vehicle collides on server, impacts are only needed by remote clients
+	if (Event.Type == EVehicleGameEvent::Impact && GetNetMode() == NM_Standalone)
+	{
+		return;
+	}
+
+	// vehicle scraping along wall hits every frame, strongest impact is enough
+	if (Event.Type == EVehicleGameEvent::Impact)
+	{
+		for (int32 i = 0; i < PendingGameEvents.Num(); i++)
+		{
+			FVehicleGameEvent& PendingEvent = PendingGameEvents[i];
+			if (PendingEvent.Type == EVehicleGameEvent::Impact && PendingEvent.Actor == Event.Actor)
+			{
+				if (Event.Magnitude > PendingEvent.Magnitude)
+				{
+					PendingEvent = Event;
+				}
+				return;
+			}
+		}
+	}
+
+	PendingGameEvents.Add(Event);
+}
+
+void AVehicleGameMode::SendGameEvents()
+{
+	FVehicleGameEventBatch Batch;
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		// local players get the same batch without going through network
+		AVehiclePlayerController* VehiclePC = Cast<AVehiclePlayerController>(*It);
+		UNetConnection* Connection = VehiclePC ? VehiclePC->GetNetConnection() : NULL;
+		const bool bLocalPlayer = VehiclePC && VehiclePC->IsLocalController();
+		if (Connection == NULL && !bLocalPlayer)
+		{
+			continue;
+		}
+
+		FVector ViewLocation;
+		FRotator ViewRotation;
+		VehiclePC->GetPlayerViewPoint(ViewLocation, ViewRotation);
+
+		Batch.Events.Reset();
+		for (int32 i = 0; i < PendingGameEvents.Num() && Batch.Events.Num() < FVehicleGameEventBatch::MaxEvents; i++)
+		{
+			const FVehicleGameEvent& Event = PendingGameEvents[i];
+			AActor* EventActor = Event.Actor.Get();
+			if (Event.HasActor() && EventActor == NULL)
+			{
+				continue;
+			}
+
+			if (Event.Type == EVehicleGameEvent::Impact)
+			{
+				// owner simulates his own vehicle, others need it replicated and close enough to see
+				if (bLocalPlayer || EventActor == VehiclePC->GetPawn() || !Connection->ActorChannels.Contains(EventActor) ||
+					FVector::DistSquared(Event.Location, ViewLocation) > FMath::Square(ImpactEventRadius))
+				{
+					continue;
+				}
+			}
+			else if (Event.Type == EVehicleGameEvent::TrackPointReached)
+			{
+				// progress of others is replicated in their player states
+				if (EventActor != VehiclePC->PlayerState)
+				{
+					continue;
+				}
+			}
+
+			Batch.Events.Add(Event);
+		}
+
+		if (Batch.Events.Num() > 0)
+		{
+			Batch.StatsClass = VehiclePC->GetClass();
+			VehiclePC->ClientReceiveGameEvents(Batch);
+		}
 	}
+
+	PendingGameEvents.Reset();
 }
 
 void AVehicleGameMode::Tick(float DeltaSeconds)
 {
-	AVehicleGameState* GameState = GetGameState<AVehicleGameState>();
-	if (GameState != NULL)
+	// every frame must advance the clock, even without anyone asking for it
+	GetServerClock();
+
+	UpdateTrackGates();
+
+	if (PendingSpawns.Num() > 0)
+	{
+		UpdatePendingSpawns();
+	}
+
+	if (GetNetMode() != NM_Standalone)
+	{
+		UpdateVehicleNetFrequencies();
+	}
+
+	if (TestHarness.IsValid())
+	{
+		TestHarness->Tick(this);
+	}
+
+	if (PendingGameEvents.Num() > 0 && GetWorld()->GetTimeSeconds() - LastGameEventSendTime >= GameEventSendInterval)
+	{
+		LastGameEventSendTime = GetWorld()->GetTimeSeconds();
+		SendGameEvents();
+	}
+
+	if (ReplayRecorder.IsValid() && ReplayRecorder->IsRecording() && GetWorld()->GetTimeSeconds() - LastReplaySampleTime >= ReplaySampleInterval)
+	{
+		LastReplaySampleTime = GetWorld()->GetTimeSeconds();
+		ReplayRecorder->RecordFrame(GetWorld());
+	}
+}
+
+double AVehicleGameMode::GetServerClock()
+{
+	// components ticking before game mode ask for it too, first caller in frame advances it
+	if (ServerClockFrame != GFrameCounter)
+	{
+		ServerClockFrame = GFrameCounter;
+		ServerClock += GetWorld()->GetDeltaSeconds();
+	}
+	return ServerClock;
+}
+
+double AVehicleGameMode::GetRaceStartClock() const
+{
+	return RaceStartClock;
+}
+
+void AVehicleGameMode::UpdateTrackGates()
+{
+	AVehicleGameState* GameState = GetVehicleGameState();
+	if (GameState == NULL || GameState->GetTrackLayout().Gates.Num() == 0)
+	{
+		return;
+	}
+
+	const FVehicleTrackLayout& TrackLayout = GameState->GetTrackLayout();
+	GateSweeps.Reset();
+	GateSweepControllers.Reset();
+
+	// each racer is tested only against gate it has to cross next, so skipped checkpoints never count
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		AVehiclePlayerController* VehiclePC = Cast<AVehiclePlayerController>(*It);
+		AWheeledVehicle* Vehicle = VehiclePC ? Cast<AWheeledVehicle>(VehiclePC->GetPawn()) : NULL;
+		UVehicleMovementComponentBoosted4w* BoostedMovement = Vehicle ? Cast<UVehicleMovementComponentBoosted4w>(Vehicle->GetVehicleMovement()) : NULL;
+		if (BoostedMovement == NULL || BoostedMovement->GetStateHistory().GetNumSamples() < 2)
+		{
+			continue;
+		}
+
+		const int32 NextGate = TrackLayout.GetNextGate(GateProgress.FindOrAdd(VehiclePC).LastGate);
+		if (NextGate == INDEX_NONE)
+		{
+			continue;
+		}
+
+		// two newest history samples are body states at the end of previous and current tick
+		const FVehicleStateHistory& StateHistory = BoostedMovement->GetStateHistory();
+		FVehicleGateSweep& Sweep = GateSweeps[GateSweeps.AddUninitialized()];
+		Sweep.Start = StateHistory.GetSample(1).Location;
+		Sweep.End = StateHistory.GetSample(0).Location;
+		Sweep.StartTime = StateHistory.GetSample(1).Time;
+		Sweep.EndTime = StateHistory.GetSample(0).Time;
+		Sweep.Gate = NextGate;
+		GateSweepControllers.Add(VehiclePC);
+	}
+
+	TrackLayout.FindGateCrossings(GateSweeps, GateSweepAlphas);
+
+	for (int32 i = 0; i < GateSweeps.Num(); i++)
+	{
+		if (GateSweepAlphas[i] >= 0.0f)
+		{
+			const FVehicleGateSweep& Sweep = GateSweeps[i];
+			const double CrossingTime = Sweep.StartTime + (Sweep.EndTime - Sweep.StartTime) * GateSweepAlphas[i];
+			OnGateCrossed(GateSweepControllers[i], Sweep.Gate, CrossingTime);
+		}
+	}
+
+	if (IsRaceActive() && HaveAllRacersFinished())
+	{
+		FinishRace();
+	}
+}
+
+void AVehicleGameMode::OnGateCrossed(AVehiclePlayerController* VehiclePC, int32 Gate, double CrossingTime)
+{
+	AVehicleGameState* GameState = GetVehicleGameState();
+	const FVehicleTrackLayout& TrackLayout = GameState->GetTrackLayout();
+	FVehicleGateProgress& Progress = GateProgress.FindOrAdd(VehiclePC);
+
+	// lap ends when first gate is reached coming from the last one
+	const bool bLapCompleted = TrackLayout.bClosedLoop && Gate == 0 && Progress.LastGate == TrackLayout.Gates.Num() - 1;
+	if (bLapCompleted)
+	{
+		Progress.NumLaps++;
+	}
+	Progress.LastGate = Gate;
+
+	VehiclePC->OnTrackPointReached(TrackLayout.TrackPoints[Gate], CrossingTime);
+
+	// each racer finishes at his own crossing, the rest keep racing
+	const bool bFinishLine = TrackLayout.bClosedLoop ? (bLapCompleted && Progress.NumLaps >= NumRaceLaps) : (Gate == TrackLayout.Gates.Num() - 1);
+	if (bFinishLine && !Progress.bFinished && IsRaceActive())
+	{
+		Progress.bFinished = true;
+		VehiclePC->OnFinishLineReached();
+	}
+}
+
+bool AVehicleGameMode::HaveAllRacersFinished() const
+{
+	int32 NumRacers = 0;
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		AVehiclePlayerController* VehiclePC = Cast<AVehiclePlayerController>(*It);
+		if (VehiclePC == NULL || VehiclePC->PlayerState == NULL || VehiclePC->PlayerState->bIsSpectator || VehiclePC->PlayerState->bOnlySpectator)
+		{
+			continue;
+		}
+
+		const FVehicleGateProgress* Progress = GateProgress.Find(VehiclePC);
+		if (Progress == NULL || !Progress->bFinished)
+		{
+			return false;
+		}
+		NumRacers++;
+	}
+
+	return NumRacers > 0;
+}
+
+void AVehicleGameMode::StartPlay()
+{
+	// match start spawns players already, their start spots must be validated by then
+	BakeSpawnSlots();
+
+	Super::StartPlay();
+
+	if (ReplayFilename.Len() > 0)
+	{
+		AVehicleReplayPlayer* ReplayPlayer = GetWorld()->SpawnActor<AVehicleReplayPlayer>();
+		if (ReplayPlayer == NULL || !ReplayPlayer->LoadReplay(ReplayFilename))
+		{
+			UE_LOG(LogVehicle, Warning, TEXT("Failed to play replay %s"), *ReplayFilename);
+		}
+	}
+
+	TestHarness = FVehicleServerTestHarness::CreateFromCommandLine();
+	if (TestHarness.IsValid())
+	{
+		TestHarness->OnStartPlay(this);
+	}
+}
+
+void AVehicleGameMode::Logout(AController* Exiting)
+{
+	GateProgress.Remove(Cast<AVehiclePlayerController>(Exiting));
+
+	Super::Logout(Exiting);
+}
+
+void AVehicleGameMode::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Super::EndPlay(EndPlayReason);
+
+	// writer thread finishes the file
+	ReplayRecorder.Reset();
+}
+
+void AVehicleGameMode::UpdateVehicleNetFrequencies()
+{
+	TArray<AWheeledVehicle*, TInlineAllocator<64> > Vehicles;
+	TArray<float, TInlineAllocator<64> > Frequencies;
+	float TotalFrequency = 0.0f;
+
+	for (FConstPawnIterator It = GetWorld()->GetPawnIterator(); It; ++It)
+	{
+		AWheeledVehicle* Vehicle = Cast<AWheeledVehicle>(*It);
+		UVehicleMovementComponentBoosted4w* BoostedMovement = Vehicle ? Cast<UVehicleMovementComponentBoosted4w>(Vehicle->GetVehicleMovement()) : NULL;
+		if (BoostedMovement)
+		{
+			const float Frequency = BoostedMovement->GetDesiredNetUpdateFrequency();
+			Vehicles.Add(Vehicle);
+			Frequencies.Add(Frequency);
+			TotalFrequency += Frequency;
+		}
+	}
+
+	// over budget: scale everyone down evenly, calm vehicles still get an update now and then
+	const float Scale = (TotalFrequency > VehicleNetUpdateBudget && TotalFrequency > 0.0f) ? VehicleNetUpdateBudget / TotalFrequency : 1.0f;
+	for (int32 i = 0; i < Vehicles.Num(); i++)
 	{
-		const float CurrentTime = IsRaceActive() ? GetWorld()->GetTimeSeconds() : RaceFinishTime;
-		GameState->TotalTime = CurrentTime - RaceStartTime;
+		Vehicles[i]->NetUpdateFrequency = FMath::Max(Frequencies[i] * Scale, 1.0f);
 	}
 }
 
@@ -216,13 +979,21 @@ float AVehicleGameMode::GetRaceTimer() const
 	AVehicleGameState* GameState = GetGameState<AVehicleGameState>();
 	if (GameState != NULL)
 	{
-		return GameState->TotalTime;
+		return GameState->GetTotalTime();
 	}
 	// We shouldn't really not have a game state but just in case
 	const float CurrentTime = IsRaceActive() ? GetWorld()->GetTimeSeconds() : RaceFinishTime;
 	return CurrentTime - RaceStartTime;
 }
 
+void AVehicleGameMode::OnRaceDigestReported(AVehiclePlayerController* VehiclePC, const FVehicleRaceDigest& Digest, int32 NumCorrections)
+{
+	if (TestHarness.IsValid())
+	{
+		TestHarness->OnRaceDigestReported(VehiclePC, Digest, NumCorrections);
+	}
+}
+
 AVehicleGameState* AVehicleGameMode::GetVehicleGameState() const
 {
 	return GetGameState<AVehicleGameState>();
@@ -13,6 +13,12 @@ class FVehicleGameModule : public FDefaultGameModuleImpl
 {
 	virtual void StartupModule() override
 	{
+		// dedicated server never shows any UI, don't load menu styles and their textures
+		if (IsRunningDedicatedServer())
+		{
+			return;
+		}
+
 		//Hot reload hack
 		FSlateStyleRegistry::UnRegisterSlateStyle(FVehicleStyle::GetStyleSetName());
 		FVehicleStyle::Initialize();
@@ -20,7 +26,10 @@ class FVehicleGameModule : public FDefaultGameModuleImpl
 
 	virtual void ShutdownModule() override
 	{
-		FVehicleStyle::Shutdown();
+		if (!IsRunningDedicatedServer())
+		{
+			FVehicleStyle::Shutdown();
+		}
 	}
 };
 
@@ -1,13 +1,51 @@
 // Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
 
 #include "VehicleGame.h"
+#include "VehicleNetStats.h"
+
+bool FVehicleStandings::NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess)
+{
+	const int64 StartBits = FVehicleNetStats::GetArchiveBits(Ar);
+
+	uint32 NumRacers = PlayerIds.Num();
+	Ar.SerializeIntPacked(NumRacers);
+	if (Ar.IsLoading())
+	{
+		if (NumRacers > 255)
+		{
+			Ar.SetError();
+			bOutSuccess = false;
+			return true;
+		}
+		PlayerIds.Reset();
+		PlayerIds.AddUninitialized(NumRacers);
+	}
+
+	// player ids are small, most of them fit in one byte
+	for (int32 i = 0; i < PlayerIds.Num(); i++)
+	{
+		Ar.SerializeIntPacked((uint32&)PlayerIds[i]);
+	}
+
+	if (Ar.IsSaving())
+	{
+		FVehicleNetStats::AddPropertyUpdate(AVehicleGameState::StaticClass(), FVehicleNetStats::GetArchiveBits(Ar) - StartBits);
+	}
+
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
 
 AVehicleGameState::AVehicleGameState(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
 	NumRacers = 0;
 	TotalTime = 0;
+	RaceStartServerTime = 0;
+	RaceFinishServerTime = 0;
 	bTimerPaused = false;
 	bIsRaceActive = false;
+	bTrackLayoutBuilt = false;
+	bStandingsMembersChanged = false;
 	// need to tick when paused to check king state.
 	PrimaryActorTick.bCanEverTick = true;
 	SetTickableWhenPaused(true);
@@ -18,18 +56,205 @@ void AVehicleGameState::GetLifetimeReplicatedProps( TArray< FLifetimeProperty >
 	Super::GetLifetimeReplicatedProps( OutLifetimeProps );
 
 	DOREPLIFETIME( AVehicleGameState, NumRacers );
-	DOREPLIFETIME( AVehicleGameState, TotalTime );
+	DOREPLIFETIME( AVehicleGameState, RaceStartServerTime );
+	DOREPLIFETIME( AVehicleGameState, RaceFinishServerTime );
 	DOREPLIFETIME( AVehicleGameState, bTimerPaused );
 	DOREPLIFETIME( AVehicleGameState, bIsRaceActive );
-	
+	DOREPLIFETIME( AVehicleGameState, Standings );
+}
+
+void AVehicleGameState::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	// keep property up to date for blueprints reading it directly
+	TotalTime = GetTotalTime();
+
+	if (Role == ROLE_Authority)
+	{
+		UpdateStandings();
+	}
+}
+
+void AVehicleGameState::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	FVehicleNetStats::FScopedReplicationTimer ReplicationTimer(GetClass());
+
+	Super::PreReplication(ChangedPropertyTracker);
+}
+
+void AVehicleGameState::AddPlayerState(APlayerState* PlayerState)
+{
+	Super::AddPlayerState(PlayerState);
+
+	AVehiclePlayerState* VehiclePlayerState = Cast<AVehiclePlayerState>(PlayerState);
+	if (Role == ROLE_Authority && VehiclePlayerState && !PlayerState->bIsInactive)
+	{
+		// new racers start last, first update moves them where they belong
+		FVehicleStandingsEntry& Entry = StandingsEntries[StandingsEntries.Add(FVehicleStandingsEntry())];
+		Entry.PlayerState = VehiclePlayerState;
+		bStandingsMembersChanged = true;
+	}
+}
+
+void AVehicleGameState::RemovePlayerState(APlayerState* PlayerState)
+{
+	Super::RemovePlayerState(PlayerState);
+
+	for (int32 i = 0; i < StandingsEntries.Num(); i++)
+	{
+		if (StandingsEntries[i].PlayerState == PlayerState)
+		{
+			StandingsEntries.RemoveAt(i);
+			bStandingsMembersChanged = true;
+			break;
+		}
+	}
+}
+
+void AVehicleGameState::UpdateStandings()
+{
+	for (int32 i = StandingsEntries.Num() - 1; i >= 0; i--)
+	{
+		if (!StandingsEntries[i].PlayerState.IsValid())
+		{
+			StandingsEntries.RemoveAt(i);
+			bStandingsMembersChanged = true;
+		}
+	}
+
+	// spectator flags are set after player state is added, and can change later
+	for (int32 i = 0; i < StandingsEntries.Num(); i++)
+	{
+		FVehicleStandingsEntry& Entry = StandingsEntries[i];
+		const bool bRanked = IsRankedRacer(Entry.PlayerState.Get());
+		if (Entry.bRanked != bRanked)
+		{
+			Entry.bRanked = bRanked;
+			bStandingsMembersChanged = true;
+		}
+		Entry.SortKey = bRanked ? GetStandingsKey(Entry) : MIN_int64;
+	}
+
+	// order barely changes between frames, so insertion sort is a single pass with an occasional swap of neighbours
+	bool bOrderChanged = bStandingsMembersChanged;
+	for (int32 i = 1; i < StandingsEntries.Num(); i++)
+	{
+		if (StandingsEntries[i - 1].SortKey >= StandingsEntries[i].SortKey)
+		{
+			continue;
+		}
+
+		const FVehicleStandingsEntry Entry = StandingsEntries[i];
+		int32 InsertIndex = i;
+		while (InsertIndex > 0 && StandingsEntries[InsertIndex - 1].SortKey < Entry.SortKey)
+		{
+			StandingsEntries[InsertIndex] = StandingsEntries[InsertIndex - 1];
+			InsertIndex--;
+		}
+		StandingsEntries[InsertIndex] = Entry;
+		bOrderChanged = true;
+	}
+
+	// equal keys keep previous order, so replicated array only changes when someone really overtakes
+	if (bOrderChanged)
+	{
+		Standings.PlayerIds.Reset();
+		for (int32 i = 0; i < StandingsEntries.Num(); i++)
+		{
+			if (StandingsEntries[i].bRanked)
+			{
+				Standings.PlayerIds.Add(StandingsEntries[i].PlayerState->PlayerId);
+			}
+		}
+		bStandingsMembersChanged = false;
+	}
+}
+
+int64 AVehicleGameState::GetStandingsKey(FVehicleStandingsEntry& Entry)
+{
+	const AVehiclePlayerState* VehiclePlayerState = Entry.PlayerState.Get();
+	const FVehicleRaceProgress Progress = VehiclePlayerState->GetRaceProgress();
+
+	// finished racers are ahead of everyone still racing, in order of finish
+	if (Progress.FinishTimeMs > 0)
+	{
+		return (1LL << 62) - Progress.FinishTimeMs;
+	}
+
+	// distance is measured from last checkpoint, which ranks the same as distance to next one
+	AController* Controller = Cast<AController>(VehiclePlayerState->GetOwner());
+	AWheeledVehicle* Vehicle = Controller ? Cast<AWheeledVehicle>(Controller->GetPawn()) : NULL;
+	UVehicleMovementComponentBoosted4w* BoostedMovement = Vehicle ? Cast<UVehicleMovementComponentBoosted4w>(Vehicle->GetVehicleMovement()) : NULL;
+	const int32 TrackPointIndex = VehiclePlayerState->GetTrackPointIndex();
+	const FVehicleTrackLayout& Layout = GetTrackLayout();
+
+	float VehicleDistance = 0.0f;
+	if (BoostedMovement && BoostedMovement->GetTrackDistance(VehicleDistance))
+	{
+		Entry.CheckpointGap = Layout.GetTrackGap(Layout.PointDistances[FMath::Max(TrackPointIndex, 0)], VehicleDistance);
+	}
+
+	const int64 Checkpoints = Progress.Lap * 256 + TrackPointIndex + 1;
+	const int64 Gap = FMath::Clamp(FMath::RoundToInt(Entry.CheckpointGap), -(1 << 30), 1 << 30) + (1 << 30);
+	return (Checkpoints << 32) | Gap;
+}
+
+bool AVehicleGameState::IsRankedRacer(const APlayerState* PlayerState) const
+{
+	return PlayerState && !PlayerState->bIsSpectator && !PlayerState->bOnlySpectator && !PlayerState->bIsInactive;
+}
+
+int32 AVehicleGameState::GetRacePosition(const APlayerState* PlayerState) const
+{
+	return PlayerState ? Standings.PlayerIds.Find(PlayerState->PlayerId) + 1 : 0;
+}
+
+int32 AVehicleGameState::GetNumRankedRacers() const
+{
+	return Standings.PlayerIds.Num();
+}
+
+const FVehicleStandings& AVehicleGameState::GetStandings() const
+{
+	return Standings;
 }
 
 float AVehicleGameState::GetTotalTime()
 {
-	return TotalTime;
+	if (RaceStartServerTime <= 0.0f)
+	{
+		return 0.0f;
+	}
+
+	// every client runs race clock on its own, server doesn't send anything until race finishes
+	const float CurrentTime = (RaceFinishServerTime > 0.0f) ? RaceFinishServerTime : GetServerWorldTime();
+	return FMath::Max(0.0f, CurrentTime - RaceStartServerTime);
+}
+
+float AVehicleGameState::GetServerWorldTime() const
+{
+	if (Role == ROLE_Authority)
+	{
+		return GetWorld()->GetTimeSeconds();
+	}
+
+	AVehiclePlayerController* LocalPC = Cast<AVehiclePlayerController>(GEngine->GetFirstLocalPlayerController(GetWorld()));
+	return LocalPC ? LocalPC->GetServerWorldTime() : GetWorld()->GetTimeSeconds();
 }
 
 bool AVehicleGameState::IsRaceActive() const
 {
 	return bIsRaceActive;
-}
\ No newline at end of file
+}
+
+const FVehicleTrackLayout& AVehicleGameState::GetTrackLayout()
+{
+	if (!bTrackLayoutBuilt)
+	{
+		TrackLayout.Build(GetWorld());
+		bTrackLayoutBuilt = true;
+	}
+
+	return TrackLayout;
+}
@@ -18,8 +18,10 @@ public class VehicleGame : ModuleRules
 		PrivateDependencyModuleNames.AddRange(
 			new string[] {
 				"InputCore",
+				"Networking",
 				"Slate",
 				"SlateCore",
+				"Sockets",
 				"VehicleGameLoadingScreen",
 			}
 		);
@@ -28,6 +30,9 @@ public class VehicleGame : ModuleRules
 			new string[] {
 				"VehicleGame/Private/UI/Widgets",
 				"VehicleGame/Private/UI/Style",
+				"VehicleGame/Private/Net",
+				"VehicleGame/Private/Replay",
+				"VehicleGame/Private/Leaderboard",
 			}
 		);
 	}
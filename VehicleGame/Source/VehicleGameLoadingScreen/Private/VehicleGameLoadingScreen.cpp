@@ -81,6 +81,12 @@ class FVehicleGameLoadingScreenModule : public IVehicleGameLoadingScreenModule
 public:
 	virtual void StartupModule() override
 	{
+		// dedicated server has no viewport to show the loading screen in
+		if (IsRunningDedicatedServer())
+		{
+			return;
+		}
+
 		//force load for cooker reference
 		LoadObject<UObject>(NULL, TEXT("/Game/UI/Menu/LoadingScreen.LoadingScreen")/*, NULL, LOAD_None, NULL*/);
 
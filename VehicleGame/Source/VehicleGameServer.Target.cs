@@ -0,0 +1,53 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+using UnrealBuildTool;
+using System.Collections.Generic;
+
+public class VehicleGameServerTarget : TargetRules
+{
+	public VehicleGameServerTarget(TargetInfo Target)
+	{
+		Type = TargetType.Server;
+	}
+
+	//
+	// TargetRules interface.
+	//
+
+	public override void SetupBinaries(
+		TargetInfo Target,
+		ref List<UEBuildBinaryConfiguration> OutBuildBinaryConfigurations,
+		ref List<string> OutExtraModuleNames
+		)
+	{
+		OutExtraModuleNames.Add("VehicleGame");
+	}
+
+    public override List<UnrealTargetPlatform> GUBP_GetPlatforms_MonolithicOnly(UnrealTargetPlatform HostPlatform)
+    {
+		List<UnrealTargetPlatform> Platforms = null;
+
+		switch (HostPlatform)
+		{
+			case UnrealTargetPlatform.Linux:
+				Platforms = new List<UnrealTargetPlatform> { HostPlatform };
+				break;
+
+			case UnrealTargetPlatform.Win64:
+				// race servers are hosted on Linux, cross-compiled from the Windows build machines
+				Platforms = new List<UnrealTargetPlatform> { HostPlatform, UnrealTargetPlatform.Linux };
+				break;
+
+			default:
+				Platforms = new List<UnrealTargetPlatform>();
+				break;
+		}
+
+		return Platforms;
+    }
+
+    public override List<UnrealTargetConfiguration> GUBP_GetConfigs_MonolithicOnly(UnrealTargetPlatform HostPlatform, UnrealTargetPlatform Platform)
+    {
+        return new List<UnrealTargetConfiguration> { UnrealTargetConfiguration.Development, UnrealTargetConfiguration.Test };
+    }
+}